@@ -22,6 +22,18 @@ namespace vks
 	*/
 	VkResult Buffer::map(VkDeviceSize size, VkDeviceSize offset)
 	{
+#if defined(USE_VMA)
+		if (allocation)
+		{
+			// VMA maps the whole allocation, so the requested offset is applied to the returned pointer
+			VkResult result = vmaMapMemory(allocator, allocation, &mapped);
+			if (result == VK_SUCCESS)
+			{
+				mapped = static_cast<uint8_t*>(mapped) + offset;
+			}
+			return result;
+		}
+#endif
 		return vkMapMemory(device, memory, offset, size, 0, &mapped);
 	}
 
@@ -34,6 +46,14 @@ namespace vks
 	{
 		if (mapped)
 		{
+#if defined(USE_VMA)
+			if (allocation)
+			{
+				vmaUnmapMemory(allocator, allocation);
+				mapped = nullptr;
+				return;
+			}
+#endif
 			vkUnmapMemory(device, memory);
 			mapped = nullptr;
 		}
@@ -48,6 +68,12 @@ namespace vks
 	*/
 	VkResult Buffer::bind(VkDeviceSize offset)
 	{
+#if defined(USE_VMA)
+		if (allocation)
+		{
+			return vmaBindBufferMemory2(allocator, allocation, offset, buffer, nullptr);
+		}
+#endif
 		return vkBindBufferMemory(device, buffer, memory, offset);
 	}
 
@@ -90,6 +116,12 @@ namespace vks
 	*/
 	VkResult Buffer::flush(VkDeviceSize size, VkDeviceSize offset)
 	{
+#if defined(USE_VMA)
+		if (allocation)
+		{
+			return vmaFlushAllocation(allocator, allocation, offset, size);
+		}
+#endif
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
@@ -110,6 +142,12 @@ namespace vks
 	*/
 	VkResult Buffer::invalidate(VkDeviceSize size, VkDeviceSize offset)
 	{
+#if defined(USE_VMA)
+		if (allocation)
+		{
+			return vmaInvalidateAllocation(allocator, allocation, offset, size);
+		}
+#endif
 		VkMappedMemoryRange mappedRange = {};
 		mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
 		mappedRange.memory = memory;
@@ -127,6 +165,15 @@ namespace vks
 		{
 			vkDestroyBuffer(device, buffer, nullptr);
 		}
+#if defined(USE_VMA)
+		if (allocation)
+		{
+			// The device memory block is owned by the allocator and must not be freed directly
+			vmaFreeMemory(allocator, allocation);
+			allocation = VK_NULL_HANDLE;
+			memory = VK_NULL_HANDLE;
+		}
+#endif
 		if (memory)
 		{
 			vkFreeMemory(device, memory, nullptr);
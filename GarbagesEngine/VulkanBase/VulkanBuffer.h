@@ -14,6 +14,15 @@
 
 #include "vulkan/vulkan.h"
 #include "VulkanTools.h"
+
+#if defined(USE_VMA)
+#include "vma/vk_mem_alloc.h"
+#else
+// Opaque allocator handles so allocation members exist regardless of whether VMA is compiled in
+VK_DEFINE_HANDLE(VmaAllocator)
+VK_DEFINE_HANDLE(VmaAllocation)
+#endif
+
 namespace vks
 {	
 	/**
@@ -29,6 +38,10 @@ namespace vks
 		VkDeviceSize size = 0;
 		VkDeviceSize alignment = 0;
 		void* mapped = nullptr;
+		/** @brief Allocator the memory was sub-allocated from, null if the buffer owns a dedicated vkAllocateMemory block */
+		VmaAllocator allocator = VK_NULL_HANDLE;
+		/** @brief Sub-allocation backing this buffer, memory then points to the shared device memory block */
+		VmaAllocation allocation = VK_NULL_HANDLE;
 		/** @brief Usage flags to be filled by external source at buffer creation (to query at some later point) */
 		VkBufferUsageFlags usageFlags;
 		/** @brief Memory property flags to be filled by external source at buffer creation (to query at some later point) */
@@ -79,6 +79,12 @@ namespace vks
 	*/
 	VulkanDevice::~VulkanDevice()
 	{
+#if defined(USE_VMA)
+		if (allocator)
+		{
+			vmaDestroyAllocator(allocator);
+		}
+#endif
 		if (commandPool)
 		{
 			vkDestroyCommandPool(logicalDevice, commandPool, nullptr);
@@ -319,6 +325,32 @@ namespace vks
 		return result;
 	}
 
+	/**
+	* Create the memory allocator used to sub-allocate buffers and images from larger device memory blocks
+	*
+	* @param instance Instance the device has been created from
+	* @param apiVersion Vulkan API version the instance has been created with
+	*
+	* @return VkResult of the allocator creation, VK_SUCCESS if VMA support has been disabled at compile time
+	*
+	* @note Needs to be called after the logical device has been created
+	*/
+	VkResult VulkanDevice::createAllocator(VkInstance instance, uint32_t apiVersion)
+	{
+#if defined(USE_VMA)
+		assert(logicalDevice);
+		VmaAllocatorCreateInfo allocatorCreateInfo{};
+		allocatorCreateInfo.physicalDevice = physicalDevice;
+		allocatorCreateInfo.device = logicalDevice;
+		allocatorCreateInfo.instance = instance;
+		// With Vulkan 1.1 and up VMA asks the driver whether a resource requires or prefers a dedicated allocation
+		allocatorCreateInfo.vulkanApiVersion = apiVersion;
+		return vmaCreateAllocator(&allocatorCreateInfo, &allocator);
+#else
+		return VK_SUCCESS;
+#endif
+	}
+
 	/**
 	* Create a buffer on the device
 	*
@@ -330,6 +362,8 @@ namespace vks
 	* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
 	*
 	* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
+	*
+	* @note Always does a separate vkAllocateMemory as callers own the returned memory handle and release it with vkFreeMemory
 	*/
 	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data)
 	{
@@ -388,6 +422,8 @@ namespace vks
 	* @param data Pointer to the data that should be copied to the buffer after creation (optional, if not set, no data is copied over)
 	*
 	* @return VK_SUCCESS if buffer handle and memory have been created and (optionally passed) data has been copied
+	*
+	* @note If an allocator has been created the memory is sub-allocated from it, otherwise the buffer gets its own device memory allocation
 	*/
 	VkResult VulkanDevice::createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data)
 	{
@@ -399,19 +435,34 @@ namespace vks
 
 		// Create the memory backing up the buffer handle
 		VkMemoryRequirements memReqs;
-		VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
 		vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &memReqs);
-		memAlloc.allocationSize = memReqs.size;
-		// Find a memory type index that fits the properties of the buffer
-		memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
-		// If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
-		VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-		if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
-			allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-			allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-			memAlloc.pNext = &allocFlagsInfo;
+#if defined(USE_VMA)
+		// Buffers with device addresses would require the allocator to be created with buffer device address support, so they keep their own allocation
+		if (allocator && !(usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT))
+		{
+			VmaAllocationCreateInfo allocCreateInfo{};
+			allocCreateInfo.requiredFlags = memoryPropertyFlags;
+			VmaAllocationInfo allocInfo{};
+			VK_CHECK_RESULT(vmaAllocateMemoryForBuffer(allocator, buffer->buffer, &allocCreateInfo, &buffer->allocation, &allocInfo));
+			buffer->allocator = allocator;
+			buffer->memory = allocInfo.deviceMemory;
+		}
+		else
+#endif
+		{
+			VkMemoryAllocateInfo memAlloc = vks::initializers::memoryAllocateInfo();
+			memAlloc.allocationSize = memReqs.size;
+			// Find a memory type index that fits the properties of the buffer
+			memAlloc.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+			// If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also need to enable the appropriate flag during allocation
+			VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
+			if (usageFlags & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
+				allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
+				allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
+				memAlloc.pNext = &allocFlagsInfo;
+			}
+			VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
 		}
-		VK_CHECK_RESULT(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, &buffer->memory));
 
 		buffer->alignment = memReqs.alignment;
 		buffer->size = size;
@@ -436,6 +487,125 @@ namespace vks
 		return buffer->bind();
 	}
 
+	/**
+	* Allocate device memory for an image and bind it
+	*
+	* @param image Image to allocate the memory for
+	* @param memoryPropertyFlags Memory properties for the image memory (usually device local)
+	* @param memory Pointer to the memory handle the image has been bound to
+	* @param allocation Pointer to the allocator's allocation handle, set to VK_NULL_HANDLE if the memory has been allocated directly
+	*
+	* @return VkResult of the allocation or bind call
+	*
+	* @note Release the memory with freeMemory, which picks the matching path
+	*/
+	VkResult VulkanDevice::allocateImageMemory(VkImage image, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceMemory *memory, VmaAllocation *allocation)
+	{
+		*allocation = VK_NULL_HANDLE;
+#if defined(USE_VMA)
+		if (allocator)
+		{
+			// VMA decides on its own if the image requires (or the driver prefers) a dedicated allocation
+			VmaAllocationCreateInfo allocCreateInfo{};
+			allocCreateInfo.requiredFlags = memoryPropertyFlags;
+			VmaAllocationInfo allocInfo{};
+			VkResult result = vmaAllocateMemoryForImage(allocator, image, &allocCreateInfo, allocation, &allocInfo);
+			if (result != VK_SUCCESS)
+			{
+				return result;
+			}
+			*memory = allocInfo.deviceMemory;
+			return vmaBindImageMemory(allocator, *allocation, image);
+		}
+#endif
+		VkMemoryRequirements memReqs;
+		vkGetImageMemoryRequirements(logicalDevice, image, &memReqs);
+		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
+		memAllocInfo.allocationSize = memReqs.size;
+		memAllocInfo.memoryTypeIndex = getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags);
+		VkResult result = vkAllocateMemory(logicalDevice, &memAllocInfo, nullptr, memory);
+		if (result != VK_SUCCESS)
+		{
+			return result;
+		}
+		return vkBindImageMemory(logicalDevice, image, *memory, 0);
+	}
+
+	/**
+	* Release memory acquired with allocateImageMemory (or allocated directly by the caller)
+	*
+	* @param memory Device memory handle, only freed directly if there is no allocation
+	* @param allocation Allocation handle returned by the allocator (may be VK_NULL_HANDLE)
+	*/
+	void VulkanDevice::freeMemory(VkDeviceMemory memory, VmaAllocation allocation)
+	{
+#if defined(USE_VMA)
+		if (allocation)
+		{
+			vmaFreeMemory(allocator, allocation);
+			return;
+		}
+#endif
+		if (memory)
+		{
+			vkFreeMemory(logicalDevice, memory, nullptr);
+		}
+	}
+
+	/**
+	* Get a summary of the device memory managed by the allocator
+	*
+	* @return Block and allocation counts and sizes summed up over all memory heaps
+	*
+	* @note Reads the allocator's cached heap budgets, so this is cheap enough to be called every frame
+	*/
+	VulkanDevice::MemoryStatistics VulkanDevice::getMemoryStatistics() const
+	{
+		MemoryStatistics statistics{};
+#if defined(USE_VMA)
+		if (allocator)
+		{
+			std::vector<VmaBudget> budgets(memoryProperties.memoryHeapCount);
+			vmaGetHeapBudgets(allocator, budgets.data());
+			for (const VmaBudget& budget : budgets)
+			{
+				statistics.blockCount += budget.statistics.blockCount;
+				statistics.allocationCount += budget.statistics.allocationCount;
+				statistics.blockBytes += budget.statistics.blockBytes;
+				statistics.allocationBytes += budget.statistics.allocationBytes;
+			}
+		}
+#endif
+		return statistics;
+	}
+
+	/**
+	* Write detailed per heap statistics of the allocator to the log
+	*/
+	void VulkanDevice::logMemoryStatistics() const
+	{
+#if defined(USE_VMA)
+		if (!allocator)
+		{
+			return;
+		}
+		VmaTotalStatistics totalStatistics{};
+		vmaCalculateStatistics(allocator, &totalStatistics);
+		for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+		{
+			const VmaDetailedStatistics& heap = totalStatistics.memoryHeap[i];
+			if (heap.statistics.blockCount == 0)
+			{
+				continue;
+			}
+			spdlog::info("Memory heap {}: {} allocations in {} blocks, {} of {} bytes in use, allocation sizes {} - {} bytes",
+				i, heap.statistics.allocationCount, heap.statistics.blockCount, heap.statistics.allocationBytes, heap.statistics.blockBytes, heap.allocationSizeMin, heap.allocationSizeMax);
+		}
+		const VmaDetailedStatistics& total = totalStatistics.total;
+		spdlog::info("Device memory: {} allocations in {} blocks, {} unused ranges", total.statistics.allocationCount, total.statistics.blockCount, total.unusedRangeCount);
+#endif
+	}
+
 	/**
 	* Copy buffer data from src to dst using VkCmdCopyBuffer
 	* 
@@ -40,6 +40,8 @@ struct VulkanDevice
 	std::vector<std::string> supportedExtensions;
 	/** @brief Default command pool for the graphics queue family index */
 	VkCommandPool commandPool = VK_NULL_HANDLE;
+	/** @brief Memory allocator used to sub-allocate buffer and image memory, null if VMA is disabled or has not been created yet */
+	VmaAllocator allocator = VK_NULL_HANDLE;
 	/** @brief Contains queue family indices */
 	struct
 	{
@@ -47,6 +49,14 @@ struct VulkanDevice
 		uint32_t compute;
 		uint32_t transfer;
 	} queueFamilyIndices;
+	/** @brief Summary of the memory currently held by the allocator */
+	struct MemoryStatistics
+	{
+		uint32_t     blockCount      = 0;
+		uint32_t     allocationCount = 0;
+		VkDeviceSize blockBytes      = 0;
+		VkDeviceSize allocationBytes = 0;
+	};
 	operator VkDevice() const
 	{
 		return logicalDevice;
@@ -56,8 +66,13 @@ struct VulkanDevice
 	uint32_t        getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties, VkBool32 *memTypeFound = nullptr) const;
 	uint32_t        getQueueFamilyIndex(VkQueueFlags queueFlags) const;
 	VkResult        createLogicalDevice(VkPhysicalDeviceFeatures enabledFeatures, std::vector<const char *> enabledExtensions, void *pNextChain, bool useSwapChain = true, VkQueueFlags requestedQueueTypes = VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+	VkResult        createAllocator(VkInstance instance, uint32_t apiVersion);
 	VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceSize size, VkBuffer *buffer, VkDeviceMemory *memory, void *data = nullptr);
 	VkResult        createBuffer(VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags, vks::Buffer *buffer, VkDeviceSize size, void *data = nullptr);
+	VkResult        allocateImageMemory(VkImage image, VkMemoryPropertyFlags memoryPropertyFlags, VkDeviceMemory *memory, VmaAllocation *allocation);
+	void            freeMemory(VkDeviceMemory memory, VmaAllocation allocation);
+	MemoryStatistics getMemoryStatistics() const;
+	void            logMemoryStatistics() const;
 	void            copyBuffer(vks::Buffer *src, vks::Buffer *dst, VkQueue queue, VkBufferCopy *copyRegion = nullptr);
 	VkCommandPool   createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags createFlags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
 	VkCommandBuffer createCommandBuffer(VkCommandBufferLevel level, VkCommandPool pool, bool begin = false);
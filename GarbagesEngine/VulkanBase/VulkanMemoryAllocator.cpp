@@ -0,0 +1,19 @@
+/*
+ * Vulkan Memory Allocator implementation
+ *
+ * Compiles the bundled single header VMA library into the base library
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#if defined(USE_VMA)
+
+// Debug builds keep VMA's leak assert, release builds compile asserts out so allocations still alive at shutdown are logged instead
+#if defined(NDEBUG)
+#include <spdlog/spdlog.h>
+#define VMA_ASSERT_LEAK(expr) do { if (!(expr)) { spdlog::warn("VMA: {}", #expr); } } while (0)
+#endif
+#define VMA_IMPLEMENTATION
+#include "vma/vk_mem_alloc.h"
+
+#endif
@@ -21,6 +21,7 @@
 #include "VulkanBuffer.h"
 #include "VulkanDevice.h"
 #include "VulkanTools.h"
+#include "VulkanUploadBatch.h"
 
 #if defined(__ANDROID__)
 #	include <android/asset_manager.h>
@@ -35,6 +36,8 @@ class Texture
 	VkImage               image;
 	VkImageLayout         imageLayout;
 	VkDeviceMemory        deviceMemory;
+	/** @brief Sub-allocation backing the image if it was allocated through the device's memory allocator */
+	VmaAllocation         allocation = VK_NULL_HANDLE;
 	VkImageView           view;
 	uint32_t              width, height;
 	uint32_t              mipLevels;
@@ -57,7 +60,8 @@ class Texture2D : public Texture
 	    VkQueue            copyQueue,
 	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
 	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-	    bool               forceLinear     = false);
+	    bool               forceLinear     = false,
+	    vks::UploadBatch * uploadBatch     = nullptr);
 	void fromBuffer(
 	    void *             buffer,
 	    VkDeviceSize       bufferSize,
@@ -68,7 +72,8 @@ class Texture2D : public Texture
 	    VkQueue            copyQueue,
 	    VkFilter           filter          = VK_FILTER_LINEAR,
 	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
-	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    vks::UploadBatch * uploadBatch     = nullptr);
 };
 
 class Texture2DArray : public Texture
@@ -80,7 +85,8 @@ class Texture2DArray : public Texture
 	    vks::VulkanDevice *device,
 	    VkQueue            copyQueue,
 	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
-	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    vks::UploadBatch * uploadBatch     = nullptr);
 };
 
 class TextureCubeMap : public Texture
@@ -92,6 +98,7 @@ class TextureCubeMap : public Texture
 	    vks::VulkanDevice *device,
 	    VkQueue            copyQueue,
 	    VkImageUsageFlags  imageUsageFlags = VK_IMAGE_USAGE_SAMPLED_BIT,
-	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+	    VkImageLayout      imageLayout     = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	    vks::UploadBatch * uploadBatch     = nullptr);
 };
 }        // namespace vks
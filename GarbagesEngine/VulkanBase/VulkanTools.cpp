@@ -8,6 +8,13 @@
 
 #include "VulkanTools.h"
 
+#if !defined(_WIN32) && !defined(__ANDROID__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
 // iOS & macOS: getAssetPath() and getShaderBasePath() implemented externally for access to Obj-C++ path utilities
 const std::string getAssetPath()
@@ -428,6 +435,114 @@ namespace vks
 			return !f.fail();
 		}
 
+		MappedFile::~MappedFile()
+		{
+			close();
+		}
+
+		MappedFile::MappedFile(MappedFile&& other) noexcept
+		{
+			*this = std::move(other);
+		}
+
+		MappedFile& MappedFile::operator=(MappedFile&& other) noexcept
+		{
+			if (this != &other) {
+				close();
+				std::swap(mappedData, other.mappedData);
+				std::swap(mappedSize, other.mappedSize);
+#if defined(_WIN32)
+				std::swap(fileHandle, other.fileHandle);
+				std::swap(mappingHandle, other.mappingHandle);
+#elif defined(__ANDROID__)
+				std::swap(assetData, other.assetData);
+#endif
+			}
+			return *this;
+		}
+
+		bool MappedFile::open(const std::string& filename)
+		{
+			close();
+#if defined(_WIN32)
+			fileHandle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+			if (fileHandle == INVALID_HANDLE_VALUE) {
+				return false;
+			}
+			LARGE_INTEGER fileSize{};
+			if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart == 0) {
+				close();
+				return false;
+			}
+			mappingHandle = CreateFileMappingA(fileHandle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			if (!mappingHandle) {
+				close();
+				return false;
+			}
+			mappedData = static_cast<const unsigned char*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+			mappedSize = static_cast<size_t>(fileSize.QuadPart);
+#elif defined(__ANDROID__)
+			AAsset* asset = AAssetManager_open(androidApp->activity->assetManager, filename.c_str(), AASSET_MODE_STREAMING);
+			if (!asset) {
+				return false;
+			}
+			assetData.resize(AAsset_getLength(asset));
+			AAsset_read(asset, assetData.data(), assetData.size());
+			AAsset_close(asset);
+			mappedData = assetData.data();
+			mappedSize = assetData.size();
+#else
+			int fd = ::open(filename.c_str(), O_RDONLY);
+			if (fd < 0) {
+				return false;
+			}
+			struct stat fileStat{};
+			if ((fstat(fd, &fileStat) != 0) || (fileStat.st_size == 0)) {
+				::close(fd);
+				return false;
+			}
+			void* mapping = mmap(nullptr, static_cast<size_t>(fileStat.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+			// The mapping stays valid after the descriptor has been closed
+			::close(fd);
+			if (mapping == MAP_FAILED) {
+				return false;
+			}
+			mappedData = static_cast<const unsigned char*>(mapping);
+			mappedSize = static_cast<size_t>(fileStat.st_size);
+#endif
+			if (!mappedData) {
+				close();
+				return false;
+			}
+			return true;
+		}
+
+		void MappedFile::close()
+		{
+#if defined(_WIN32)
+			if (mappedData) {
+				UnmapViewOfFile(mappedData);
+			}
+			if (mappingHandle) {
+				CloseHandle(mappingHandle);
+				mappingHandle = nullptr;
+			}
+			if (fileHandle != INVALID_HANDLE_VALUE) {
+				CloseHandle(fileHandle);
+				fileHandle = INVALID_HANDLE_VALUE;
+			}
+#elif defined(__ANDROID__)
+			assetData.clear();
+			assetData.shrink_to_fit();
+#else
+			if (mappedData) {
+				munmap(const_cast<unsigned char*>(mappedData), mappedSize);
+			}
+#endif
+			mappedData = nullptr;
+			mappedSize = 0;
+		}
+
 		uint32_t alignedSize(uint32_t value, uint32_t alignment)
         {
 	        return (value + alignment - 1) & ~(alignment - 1);
@@ -132,6 +132,33 @@ namespace vks
 		/** @brief Checks if a file exists */
 		bool fileExists(const std::string &filename);
 
+		/** @brief Read-only view of a whole file mapped into memory, the mapping is released on destruction */
+		class MappedFile
+		{
+		public:
+			MappedFile() = default;
+			~MappedFile();
+			MappedFile(const MappedFile&) = delete;
+			MappedFile& operator=(const MappedFile&) = delete;
+			MappedFile(MappedFile&& other) noexcept;
+			MappedFile& operator=(MappedFile&& other) noexcept;
+			/** @brief Maps the file, returns false if it can't be opened or is empty */
+			bool open(const std::string& filename);
+			void close();
+			const unsigned char* data() const { return mappedData; }
+			size_t size() const { return mappedSize; }
+		private:
+			const unsigned char* mappedData = nullptr;
+			size_t mappedSize = 0;
+#if defined(_WIN32)
+			HANDLE fileHandle = INVALID_HANDLE_VALUE;
+			HANDLE mappingHandle = nullptr;
+#elif defined(__ANDROID__)
+			// Assets are stored compressed inside the apk, so they are read into memory instead
+			std::vector<unsigned char> assetData;
+#endif
+		};
+
 		uint32_t alignedSize(uint32_t value, uint32_t alignment);
 		VkDeviceSize alignedVkSize(VkDeviceSize value, VkDeviceSize alignment);
 	}
@@ -311,13 +311,21 @@ namespace vks
 	}
 
 	/** Update vertex and index buffer containing the imGui elements when required */
-	bool UIOverlay::update()
+	bool UIOverlay::update(uint32_t frameIndex)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		bool updateCmdBuffers = false;
 
 		if (!imDrawData) { return false; };
 
+		if (frameBuffers.size() < maxConcurrentFrames) {
+			frameBuffers.resize(maxConcurrentFrames);
+		}
+		vks::Buffer& vertexBuffer = frameBuffers[frameIndex].vertexBuffer;
+		vks::Buffer& indexBuffer = frameBuffers[frameIndex].indexBuffer;
+		int32_t& vertexCount = frameBuffers[frameIndex].vertexCount;
+		int32_t& indexCount = frameBuffers[frameIndex].indexCount;
+
 		// Note: Alignment is done inside buffer creation
 		VkDeviceSize vertexBufferSize = imDrawData->TotalVtxCount * sizeof(ImDrawVert);
 		VkDeviceSize indexBufferSize = imDrawData->TotalIdxCount * sizeof(ImDrawIdx);
@@ -367,13 +375,19 @@ namespace vks
 		return updateCmdBuffers;
 	}
 
-	void UIOverlay::draw(const VkCommandBuffer commandBuffer)
+	void UIOverlay::draw(const VkCommandBuffer commandBuffer, uint32_t frameIndex)
 	{
 		ImDrawData* imDrawData = ImGui::GetDrawData();
 		int32_t vertexOffset = 0;
 		int32_t indexOffset = 0;
 
-		if ((!imDrawData) || (imDrawData->CmdListsCount == 0)) {
+		if ((!imDrawData) || (imDrawData->CmdListsCount == 0) || (frameIndex >= frameBuffers.size())) {
+			return;
+		}
+
+		const vks::Buffer& vertexBuffer = frameBuffers[frameIndex].vertexBuffer;
+		const vks::Buffer& indexBuffer = frameBuffers[frameIndex].indexBuffer;
+		if ((vertexBuffer.buffer == VK_NULL_HANDLE) || (indexBuffer.buffer == VK_NULL_HANDLE)) {
 			return;
 		}
 
@@ -417,8 +431,10 @@ namespace vks
 
 	void UIOverlay::freeResources()
 	{
-		vertexBuffer.destroy();
-		indexBuffer.destroy();
+		for (auto& buffers : frameBuffers) {
+			buffers.vertexBuffer.destroy();
+			buffers.indexBuffer.destroy();
+		}
 		vkDestroyImageView(device->logicalDevice, fontView, nullptr);
 		vkDestroyImage(device->logicalDevice, fontImage, nullptr);
 		vkFreeMemory(device->logicalDevice, fontMemory, nullptr);
@@ -0,0 +1,231 @@
+/*
+* Vulkan upload batch class
+*
+* Records the staging copies of many buffers and images into a single command buffer that is submitted once
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "VulkanUploadBatch.h"
+
+namespace vks
+{
+	/**
+	* Create an upload batch, no Vulkan objects are created until the first copy is recorded
+	*
+	* @param device Vulkan device the uploaded resources belong to
+	* @param queue Queue the batch is submitted to, must belong to the family of the device's default command pool
+	* @param (Optional) stagingBlockSize Size of the staging blocks, pass 0 for single use batches to size staging memory exactly
+	*/
+	UploadBatch::UploadBatch(vks::VulkanDevice* device, VkQueue queue, VkDeviceSize stagingBlockSize)
+		: device(device), queue(queue), stagingBlockSize(stagingBlockSize)
+	{
+	}
+
+	/**
+	* Submit any outstanding copies and wait for all of them before releasing the staging memory
+	*/
+	UploadBatch::~UploadBatch()
+	{
+		flush();
+		for (auto& block : freeBlocks) {
+			block.unmap();
+			block.destroy();
+		}
+	}
+
+	VkCommandBuffer UploadBatch::getCommandBuffer()
+	{
+		if (commandBuffer == VK_NULL_HANDLE) {
+			commandBuffer = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		}
+		return commandBuffer;
+	}
+
+	/**
+	* Reserve host visible staging memory for the current batch
+	*
+	* @param size Size of the region in bytes
+	* @param (Optional) alignment Alignment of the region's offset, must be a multiple of the texel block size for buffer to image copies
+	*
+	* @return Staging buffer, offset and mapped pointer of the region, valid until the batch has completed
+	*/
+	UploadBatch::StagingRegion UploadBatch::allocateStaging(VkDeviceSize size, VkDeviceSize alignment)
+	{
+		StagingRegion region{};
+		if (!activeBlocks.empty()) {
+			vks::Buffer& block = activeBlocks.back();
+			VkDeviceSize offset = (activeBlockOffset + alignment - 1) / alignment * alignment;
+			if (offset + size <= block.size) {
+				activeBlockOffset = offset + size;
+				region.buffer = block.buffer;
+				region.offset = offset;
+				region.data = static_cast<uint8_t*>(block.mapped) + offset;
+				return region;
+			}
+		}
+
+		vks::Buffer block;
+		if ((size <= stagingBlockSize) && !freeBlocks.empty()) {
+			block = freeBlocks.back();
+			freeBlocks.pop_back();
+		}
+		else {
+			VK_CHECK_RESULT(device->createBuffer(
+				VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+				VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+				&block,
+				std::max(size, stagingBlockSize)));
+			VK_CHECK_RESULT(block.map());
+		}
+		activeBlocks.push_back(block);
+		activeBlockOffset = size;
+		region.buffer = block.buffer;
+		region.offset = 0;
+		region.data = block.mapped;
+		return region;
+	}
+
+	/**
+	* Stage data and record a copy into a buffer
+	*
+	* @param dstBuffer Destination buffer, needs VK_BUFFER_USAGE_TRANSFER_DST_BIT
+	* @param data Data to upload, copied into staging memory right away
+	* @param size Size of the data in bytes
+	* @param (Optional) dstOffset Byte offset into the destination buffer
+	*/
+	void UploadBatch::copyToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset)
+	{
+		StagingRegion staging = allocateStaging(size);
+		memcpy(staging.data, data, size);
+		VkBufferCopy copyRegion{};
+		copyRegion.srcOffset = staging.offset;
+		copyRegion.dstOffset = dstOffset;
+		copyRegion.size = size;
+		vkCmdCopyBuffer(getCommandBuffer(), staging.buffer, dstBuffer, 1, &copyRegion);
+	}
+
+	/**
+	* Stage data and record a copy into an image, including the layout transitions before and after the copy
+	*
+	* @param image Destination image in VK_IMAGE_LAYOUT_UNDEFINED, needs VK_IMAGE_USAGE_TRANSFER_DST_BIT
+	* @param data Data to upload, copied into staging memory right away
+	* @param size Size of the data in bytes
+	* @param regions Copy regions with buffer offsets relative to data
+	* @param subresourceRange Subresources covered by the copy regions
+	* @param finalLayout Layout the image is transitioned to after the copy
+	*/
+	void UploadBatch::copyToImage(VkImage image, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkImageSubresourceRange subresourceRange, VkImageLayout finalLayout)
+	{
+		StagingRegion staging = allocateStaging(size);
+		memcpy(staging.data, data, size);
+		std::vector<VkBufferImageCopy> stagingRegions(regions);
+		for (auto& region : stagingRegions) {
+			region.bufferOffset += staging.offset;
+		}
+		VkCommandBuffer copyCmd = getCommandBuffer();
+		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+		vkCmdCopyBufferToImage(copyCmd, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(stagingRegions.size()), stagingRegions.data());
+		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, finalLayout, subresourceRange);
+	}
+
+	void UploadBatch::setTimelineSemaphore(VkSemaphore semaphore)
+	{
+		timelineSemaphore = semaphore;
+	}
+
+	/**
+	* Submit all copies recorded since the last submit with a single vkQueueSubmit
+	*
+	* @return Batch value to pass to isComplete or wait, returns the previous value if nothing has been recorded
+	*/
+	uint64_t UploadBatch::submit()
+	{
+		if (commandBuffer == VK_NULL_HANDLE) {
+			return submittedValue;
+		}
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+
+		Submission submission{};
+		submission.value = ++submittedValue;
+		submission.commandBuffer = commandBuffer;
+		VkFenceCreateInfo fenceInfo = vks::initializers::fenceCreateInfo(VK_FLAGS_NONE);
+		VK_CHECK_RESULT(vkCreateFence(device->logicalDevice, &fenceInfo, nullptr, &submission.fence));
+
+		VkSubmitInfo submitInfo = vks::initializers::submitInfo();
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+		VkTimelineSemaphoreSubmitInfo timelineInfo{};
+		if (timelineSemaphore != VK_NULL_HANDLE) {
+			timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+			timelineInfo.signalSemaphoreValueCount = 1;
+			timelineInfo.pSignalSemaphoreValues = &submission.value;
+			submitInfo.pNext = &timelineInfo;
+			submitInfo.signalSemaphoreCount = 1;
+			submitInfo.pSignalSemaphores = &timelineSemaphore;
+		}
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, submission.fence));
+
+		submission.stagingBlocks.swap(activeBlocks);
+		activeBlockOffset = 0;
+		commandBuffer = VK_NULL_HANDLE;
+		submissions.push_back(std::move(submission));
+		return submittedValue;
+	}
+
+	/**
+	* Check without blocking if a batch has finished on the GPU, recycles the staging memory of all finished batches
+	*
+	* @param value Batch value returned by submit
+	*/
+	bool UploadBatch::isComplete(uint64_t value)
+	{
+		while (!submissions.empty() && (vkGetFenceStatus(device->logicalDevice, submissions.front().fence) == VK_SUCCESS)) {
+			retire(submissions.front());
+			submissions.pop_front();
+		}
+		return completedValue >= value;
+	}
+
+	/**
+	* Block until a batch (and all batches submitted before it) has finished on the GPU
+	*
+	* @param value Batch value returned by submit
+	*/
+	void UploadBatch::wait(uint64_t value)
+	{
+		assert(value <= submittedValue);
+		while (!submissions.empty() && (submissions.front().value <= value)) {
+			VK_CHECK_RESULT(vkWaitForFences(device->logicalDevice, 1, &submissions.front().fence, VK_TRUE, DEFAULT_FENCE_TIMEOUT));
+			retire(submissions.front());
+			submissions.pop_front();
+		}
+	}
+
+	/** @brief Submit the recorded copies and wait for everything submitted so far */
+	void UploadBatch::flush()
+	{
+		wait(submit());
+	}
+
+	void UploadBatch::retire(Submission& submission)
+	{
+		vkDestroyFence(device->logicalDevice, submission.fence, nullptr);
+		vkFreeCommandBuffers(device->logicalDevice, device->commandPool, 1, &submission.commandBuffer);
+		for (auto& block : submission.stagingBlocks) {
+			releaseBlock(block);
+		}
+		completedValue = submission.value;
+	}
+
+	void UploadBatch::releaseBlock(vks::Buffer& block)
+	{
+		// Only blocks of the default size are kept around, dedicated blocks for large uploads are freed right away
+		if ((stagingBlockSize > 0) && (block.size == stagingBlockSize)) {
+			freeBlocks.push_back(block);
+			return;
+		}
+		block.unmap();
+		block.destroy();
+	}
+}
@@ -0,0 +1,86 @@
+/*
+* Vulkan upload batch class
+*
+* Records the staging copies of many buffers and images into a single command buffer that is submitted once
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+#include "vulkan/vulkan.h"
+#include "VulkanBuffer.h"
+#include "VulkanDevice.h"
+
+namespace vks
+{
+	/**
+	* @brief Batches staging uploads so that loading many resources costs a single queue submission and wait
+	* @note Staging memory is sub-allocated from persistently mapped host visible blocks that are recycled once the GPU is done with them
+	* @note Every submission gets a monotonically increasing value, a batch value is complete once all uploads recorded before its submit have finished
+	*/
+	class UploadBatch
+	{
+	public:
+		/** @brief Staging memory reserved for a single copy */
+		struct StagingRegion {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceSize offset = 0;
+			/** @brief Host pointer to the start of the region */
+			void* data = nullptr;
+		};
+
+		/** @brief Default size of a staging block, requests larger than this get a block of their own */
+		static const VkDeviceSize defaultStagingBlockSize = 16 * 1024 * 1024;
+
+		UploadBatch(vks::VulkanDevice* device, VkQueue queue, VkDeviceSize stagingBlockSize = defaultStagingBlockSize);
+		~UploadBatch();
+		UploadBatch(const UploadBatch&) = delete;
+		UploadBatch& operator=(const UploadBatch&) = delete;
+
+		/** @brief Command buffer the current batch is recorded into (started on first use), can be used for barriers and blits between the copies */
+		VkCommandBuffer getCommandBuffer();
+		StagingRegion allocateStaging(VkDeviceSize size, VkDeviceSize alignment = 16);
+		void copyToBuffer(VkBuffer dstBuffer, const void* data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+		void copyToImage(VkImage image, const void* data, VkDeviceSize size, const std::vector<VkBufferImageCopy>& regions, VkImageSubresourceRange subresourceRange, VkImageLayout finalLayout);
+		/** @brief Optional timeline semaphore (needs the timelineSemaphore feature) that is signaled with the batch value of every submit */
+		void setTimelineSemaphore(VkSemaphore semaphore);
+		uint64_t submit();
+		bool isComplete(uint64_t value);
+		void wait(uint64_t value);
+		void flush();
+		/** @brief Value of the last submitted batch (0 if nothing has been submitted yet) */
+		uint64_t getSubmittedValue() const { return submittedValue; }
+		/** @brief True if copies have been recorded that have not been submitted yet */
+		bool hasPendingWork() const { return commandBuffer != VK_NULL_HANDLE; }
+
+	private:
+		struct Submission {
+			uint64_t value;
+			VkCommandBuffer commandBuffer;
+			VkFence fence;
+			std::vector<vks::Buffer> stagingBlocks;
+		};
+
+		vks::VulkanDevice* device;
+		VkQueue queue;
+		VkDeviceSize stagingBlockSize;
+		VkSemaphore timelineSemaphore = VK_NULL_HANDLE;
+		VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+		/** @brief Staging blocks used by the batch currently being recorded, the last one is filled linearly */
+		std::vector<vks::Buffer> activeBlocks;
+		VkDeviceSize activeBlockOffset = 0;
+		/** @brief Blocks of stagingBlockSize whose copies have completed and that can be reused */
+		std::vector<vks::Buffer> freeBlocks;
+		std::deque<Submission> submissions;
+		uint64_t submittedValue = 0;
+		uint64_t completedValue = 0;
+
+		void retire(Submission& submission);
+		void releaseBlock(vks::Buffer& block);
+	};
+}
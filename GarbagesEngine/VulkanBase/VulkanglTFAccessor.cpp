@@ -0,0 +1,474 @@
+/*
+ * glTF accessor reading and conversion functions
+ *
+ * Converts (possibly interleaved) accessor data of any glTF component type into the float based vertex layout used by vkglTF::Model
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VulkanglTFAccessor.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKGLTF_ACCESSOR_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vkglTF
+{
+	namespace accessor
+	{
+		namespace
+		{
+			// Divisors used to map normalized integer components to [0..1] or [-1..1] as defined by the glTF spec
+			template<typename T> struct Normalization { static constexpr float divisor = 1.0f; };
+			template<> struct Normalization<int8_t> { static constexpr float divisor = 127.0f; };
+			template<> struct Normalization<uint8_t> { static constexpr float divisor = 255.0f; };
+			template<> struct Normalization<int16_t> { static constexpr float divisor = 32767.0f; };
+			template<> struct Normalization<uint16_t> { static constexpr float divisor = 65535.0f; };
+			template<> struct Normalization<uint32_t> { static constexpr float divisor = 4294967295.0f; };
+
+			// Storage of a half precision component, a distinct type so the conversion templates can select the half decode
+			struct Half {
+				uint16_t bits;
+			};
+
+			inline float* offsetPtr(float* ptr, size_t bytes)
+			{
+				return reinterpret_cast<float*>(reinterpret_cast<unsigned char*>(ptr) + bytes);
+			}
+
+			template<typename T>
+			inline float convertComponent(T value, bool normalized)
+			{
+				float result = static_cast<float>(value);
+				if (std::is_integral<T>::value && normalized) {
+					result = result / Normalization<T>::divisor;
+					if (std::is_signed<T>::value) {
+						result = std::max(result, -1.0f);
+					}
+				}
+				return result;
+			}
+
+			inline float convertComponent(Half value, bool /*normalized*/)
+			{
+				return halfToFloat(value.bits);
+			}
+
+			// Reference implementation, used for types without a vectorized path and on non SSE2 targets
+			template<typename T>
+			void readElementsScalar(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill)
+			{
+				for (size_t i = 0; i < view.count; i++) {
+					const T* src = reinterpret_cast<const T*>(view.data + i * view.stride);
+					float* out = offsetPtr(dst, i * dstStride);
+					for (uint32_t c = 0; c < dstComponents; c++) {
+						out[c] = (c < view.componentCount) ? convertComponent(src[c], view.normalized) : fill[c];
+					}
+				}
+			}
+
+#if defined(VKGLTF_ACCESSOR_SSE2)
+			inline void storeElement(float* dst, __m128 value, uint32_t dstComponents)
+			{
+				switch (dstComponents) {
+				case 4:
+					_mm_storeu_ps(dst, value);
+					break;
+				case 3:
+					_mm_storel_pi(reinterpret_cast<__m64*>(dst), value);
+					_mm_store_ss(dst + 2, _mm_movehl_ps(value, value));
+					break;
+				case 2:
+					_mm_storel_pi(reinterpret_cast<__m64*>(dst), value);
+					break;
+				case 1:
+					_mm_store_ss(dst, value);
+					break;
+				}
+			}
+
+			// Float elements are loaded without reading past the element's last component
+			inline __m128 loadElement(const float* src, uint32_t componentCount)
+			{
+				switch (componentCount) {
+				case 1:
+					return _mm_load_ss(src);
+				case 2:
+					return _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(src)));
+				case 3:
+					return _mm_movelh_ps(_mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double*>(src))), _mm_load_ss(src + 2));
+				default:
+					return _mm_loadu_ps(src);
+				}
+			}
+
+			inline uint32_t loadBytes(const unsigned char* src, size_t size)
+			{
+				uint32_t value = 0;
+				switch (size) {
+				case 1:
+					value = src[0];
+					break;
+				case 2: {
+					uint16_t low;
+					memcpy(&low, src, 2);
+					value = low;
+					break;
+				}
+				case 3: {
+					uint16_t low;
+					memcpy(&low, src, 2);
+					value = low | (static_cast<uint32_t>(src[2]) << 16);
+					break;
+				}
+				default:
+					memcpy(&value, src, 4);
+					break;
+				}
+				return value;
+			}
+
+			// Load the components of an integer or half element into the low bytes of a register, without reading past the element
+			// Loads go through general purpose registers, assembling the element in memory first would stall on store forwarding
+			template<typename T>
+			inline __m128i loadComponents(const unsigned char* src, uint32_t componentCount)
+			{
+				const size_t size = componentCount * sizeof(T);
+				if (size <= 4) {
+					return _mm_cvtsi32_si128(static_cast<int>(loadBytes(src, size)));
+				}
+				const __m128i low = _mm_cvtsi32_si128(static_cast<int>(loadBytes(src, 4)));
+				const __m128i high = _mm_cvtsi32_si128(static_cast<int>(loadBytes(src + 4, size - 4)));
+				return _mm_unpacklo_epi32(low, high);
+			}
+
+			// Widen packed 8 or 16 bit components to one 32 bit lane each, signed types are sign extended
+			template<typename T>
+			inline __m128i widenComponents(__m128i packed)
+			{
+				const __m128i zero = _mm_setzero_si128();
+				if (sizeof(T) == 1) {
+					if (std::is_signed<T>::value) {
+						const __m128i bytes = _mm_unpacklo_epi8(packed, packed);
+						return _mm_srai_epi32(_mm_unpacklo_epi16(bytes, bytes), 24);
+					}
+					return _mm_unpacklo_epi16(_mm_unpacklo_epi8(packed, zero), zero);
+				}
+				if (std::is_signed<T>::value) {
+					return _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+				}
+				return _mm_unpacklo_epi16(packed, zero);
+			}
+
+			// Decode four half precision values stored in the low 16 bits of each lane
+			// Exponent and mantissa are shifted into place and rebiased by a float multiply, which also turns half denormals into normal floats
+			// Infinity and NaN (half exponent 31) overflow that multiply's range, so their exponent is forced to all ones afterwards
+			inline __m128 halfToFloatSSE2(__m128i bits)
+			{
+				const __m128i exponentMantissaMask = _mm_set1_epi32(0x7fff);
+				const __m128i maxFiniteHalf = _mm_set1_epi32(0x7bff);
+				const __m128i infNanExponent = _mm_set1_epi32(0xff << 23);
+				// 2^112 rebiases the exponent from 15 to 127
+				const __m128 rebias = _mm_castsi128_ps(_mm_set1_epi32((127 + 112) << 23));
+
+				const __m128i exponentMantissa = _mm_and_si128(bits, exponentMantissaMask);
+				const __m128i sign = _mm_slli_epi32(_mm_xor_si128(bits, exponentMantissa), 16);
+				const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)), rebias);
+				const __m128i infNan = _mm_and_si128(_mm_cmpgt_epi32(exponentMantissa, maxFiniteHalf), infNanExponent);
+				return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan)));
+			}
+
+			template<typename T>
+			void readElementsSSE2(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill)
+			{
+				const uint32_t srcComponents = std::min(view.componentCount, 4u);
+				const __m128 fillValues = _mm_setr_ps(fill[0], dstComponents > 1 ? fill[1] : 0.0f, dstComponents > 2 ? fill[2] : 0.0f, dstComponents > 3 ? fill[3] : 0.0f);
+				// Lanes with a source component are taken from the accessor, all others from the fill values
+				const __m128 srcMask = _mm_castsi128_ps(_mm_cmplt_epi32(_mm_setr_epi32(0, 1, 2, 3), _mm_set1_epi32(static_cast<int>(srcComponents))));
+				const __m128 divisor = _mm_set1_ps(Normalization<T>::divisor);
+				const __m128 minusOne = _mm_set1_ps(-1.0f);
+				const bool normalize = view.normalized && std::is_integral<T>::value;
+
+				for (size_t i = 0; i < view.count; i++) {
+					const unsigned char* src = view.data + i * view.stride;
+					__m128 value;
+					if (std::is_floating_point<T>::value) {
+						value = loadElement(reinterpret_cast<const float*>(src), srcComponents);
+					} else {
+						const __m128i bits = widenComponents<T>(loadComponents<T>(src, srcComponents));
+						if (std::is_same<T, Half>::value) {
+							value = halfToFloatSSE2(bits);
+						} else {
+							value = _mm_cvtepi32_ps(bits);
+						}
+						if (normalize) {
+							value = _mm_div_ps(value, divisor);
+							if (std::is_signed<T>::value) {
+								value = _mm_max_ps(value, minusOne);
+							}
+						}
+					}
+					value = _mm_or_ps(_mm_and_ps(srcMask, value), _mm_andnot_ps(srcMask, fillValues));
+					storeElement(offsetPtr(dst, i * dstStride), value, dstComponents);
+				}
+			}
+#endif
+
+			template<typename T>
+			void readElements(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill)
+			{
+#if defined(VKGLTF_ACCESSOR_SSE2)
+				// 32 bit unsigned integers don't fit the signed conversion instruction
+				if (sizeof(T) != 4 || std::is_floating_point<T>::value) {
+					readElementsSSE2<T>(view, dst, dstStride, dstComponents, fill);
+					return;
+				}
+#endif
+				readElementsScalar<T>(view, dst, dstStride, dstComponents, fill);
+			}
+
+			template<typename T>
+			void readIndicesScalar(const T* src, size_t first, size_t count, uint32_t* dst, uint32_t baseVertex)
+			{
+				for (size_t i = first; i < count; i++) {
+					dst[i] = static_cast<uint32_t>(src[i]) + baseVertex;
+				}
+			}
+		}
+
+		size_t componentSize(ComponentType componentType)
+		{
+			switch (componentType) {
+			case Byte:
+			case UnsignedByte:
+				return 1;
+			case Short:
+			case UnsignedShort:
+			case HalfFloat:
+				return 2;
+			case UnsignedInt:
+			case Float:
+				return 4;
+			}
+			return 0;
+		}
+
+		/**
+		* Convert the elements of an accessor to floats
+		*
+		* @param view Accessor elements to read
+		* @param dst Pointer to the first component of the first output element
+		* @param dstStride Distance in bytes between two output elements (e.g. the size of an interleaved vertex)
+		* @param dstComponents Number of floats to write per element (max. 4)
+		* @param fill Values for output components the accessor doesn't provide (e.g. alpha for vec3 colors), zero if null
+		*/
+		void readFloats(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill)
+		{
+			assert(dstComponents >= 1 && dstComponents <= 4);
+			const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			if (!fill) {
+				fill = zero;
+			}
+			switch (view.componentType) {
+			case Byte:
+				readElements<int8_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case UnsignedByte:
+				readElements<uint8_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case Short:
+				readElements<int16_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case UnsignedShort:
+				readElements<uint16_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case UnsignedInt:
+				readElements<uint32_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case Float:
+				readElements<float>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case HalfFloat:
+				readElements<Half>(view, dst, dstStride, dstComponents, fill);
+				break;
+			}
+		}
+
+		/**
+		* Same conversion as readFloats without the vectorized paths
+		*
+		* @note Reference for verifying and benchmarking readFloats, loading code should call readFloats
+		*/
+		void readFloatsScalar(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill)
+		{
+			assert(dstComponents >= 1 && dstComponents <= 4);
+			const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			if (!fill) {
+				fill = zero;
+			}
+			switch (view.componentType) {
+			case Byte:
+				readElementsScalar<int8_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case UnsignedByte:
+				readElementsScalar<uint8_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case Short:
+				readElementsScalar<int16_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case UnsignedShort:
+				readElementsScalar<uint16_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case UnsignedInt:
+				readElementsScalar<uint32_t>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case Float:
+				readElementsScalar<float>(view, dst, dstStride, dstComponents, fill);
+				break;
+			case HalfFloat:
+				readElementsScalar<Half>(view, dst, dstStride, dstComponents, fill);
+				break;
+			}
+		}
+
+		/**
+		* Convert a half precision value to float
+		*
+		* @param value IEEE 754 binary16 bits
+		*
+		* @note Handles signed zeros, denormals, infinities and NaN (all NaNs become a quiet NaN with the same sign)
+		*/
+		float halfToFloat(uint16_t value)
+		{
+			const bool negative = (value & 0x8000) != 0;
+			const int32_t exponent = (value >> 10) & 0x1f;
+			const int32_t mantissa = value & 0x3ff;
+			float result;
+			if (exponent == 0) {
+				result = std::ldexp(static_cast<float>(mantissa), -24);
+			} else if (exponent == 31) {
+				result = (mantissa == 0) ? std::numeric_limits<float>::infinity() : std::numeric_limits<float>::quiet_NaN();
+			} else {
+				result = std::ldexp(static_cast<float>(mantissa | 0x400), exponent - 25);
+			}
+			return negative ? -result : result;
+		}
+
+		/**
+		* Write the same values to a number of elements, used for attributes missing in the source
+		*
+		* @param dst Pointer to the first component of the first output element
+		* @param dstStride Distance in bytes between two output elements
+		* @param dstComponents Number of floats to write per element
+		* @param values Values to write to each element
+		* @param count Number of elements to write
+		*/
+		void fillFloats(float* dst, size_t dstStride, uint32_t dstComponents, const float* values, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				memcpy(offsetPtr(dst, i * dstStride), values, dstComponents * sizeof(float));
+			}
+		}
+
+		/**
+		* Normalize interleaved three component vectors in place
+		*
+		* @param data Pointer to the first component of the first vector
+		* @param stride Distance in bytes between two vectors
+		* @param count Number of vectors
+		*
+		* @note Zero length vectors are left untouched instead of becoming NaN, results match glm::normalize otherwise
+		*/
+		void normalizeVec3(float* data, size_t stride, size_t count)
+		{
+			for (size_t i = 0; i < count; i++) {
+				float* v = offsetPtr(data, i * stride);
+#if defined(VKGLTF_ACCESSOR_SSE2)
+				__m128 value = loadElement(v, 3);
+				__m128 squared = _mm_mul_ps(value, value);
+				// Same summation order as glm::dot to get identical results
+				__m128 lengthSquared = _mm_add_ss(_mm_add_ss(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(squared, squared));
+				if (_mm_cvtss_f32(lengthSquared) == 0.0f) {
+					continue;
+				}
+				__m128 inverseLength = _mm_div_ss(_mm_set_ss(1.0f), _mm_sqrt_ss(lengthSquared));
+				storeElement(v, _mm_mul_ps(value, _mm_shuffle_ps(inverseLength, inverseLength, _MM_SHUFFLE(0, 0, 0, 0))), 3);
+#else
+				const float lengthSquared = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+				if (lengthSquared == 0.0f) {
+					continue;
+				}
+				const float inverseLength = 1.0f / std::sqrt(lengthSquared);
+				v[0] *= inverseLength;
+				v[1] *= inverseLength;
+				v[2] *= inverseLength;
+#endif
+			}
+		}
+
+		/**
+		* Read scalar index data and rebase it onto the first vertex of the primitive
+		*
+		* @param view Index accessor elements (tightly packed unsigned byte, short or int)
+		* @param dst Output indices
+		* @param baseVertex Value added to each index
+		*/
+		void readIndices(const View& view, uint32_t* dst, uint32_t baseVertex)
+		{
+			size_t i = 0;
+			switch (view.componentType) {
+			case UnsignedInt: {
+				const uint32_t* src = reinterpret_cast<const uint32_t*>(view.data);
+#if defined(VKGLTF_ACCESSOR_SSE2)
+				const __m128i base = _mm_set1_epi32(static_cast<int>(baseVertex));
+				for (; i + 4 <= view.count; i += 4) {
+					__m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(indices, base));
+				}
+#endif
+				readIndicesScalar(src, i, view.count, dst, baseVertex);
+				break;
+			}
+			case UnsignedShort: {
+				const uint16_t* src = reinterpret_cast<const uint16_t*>(view.data);
+#if defined(VKGLTF_ACCESSOR_SSE2)
+				const __m128i base = _mm_set1_epi32(static_cast<int>(baseVertex));
+				const __m128i zero = _mm_setzero_si128();
+				for (; i + 8 <= view.count; i += 8) {
+					__m128i indices = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(_mm_unpacklo_epi16(indices, zero), base));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_add_epi32(_mm_unpackhi_epi16(indices, zero), base));
+				}
+#endif
+				readIndicesScalar(src, i, view.count, dst, baseVertex);
+				break;
+			}
+			case UnsignedByte: {
+				const uint8_t* src = view.data;
+#if defined(VKGLTF_ACCESSOR_SSE2)
+				const __m128i base = _mm_set1_epi32(static_cast<int>(baseVertex));
+				const __m128i zero = _mm_setzero_si128();
+				for (; i + 8 <= view.count; i += 8) {
+					__m128i indices = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)), zero);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi32(_mm_unpacklo_epi16(indices, zero), base));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i + 4), _mm_add_epi32(_mm_unpackhi_epi16(indices, zero), base));
+				}
+#endif
+				readIndicesScalar(src, i, view.count, dst, baseVertex);
+				break;
+			}
+			default:
+				assert(false && "Unsupported index component type");
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,53 @@
+/*
+ * glTF accessor reading and conversion functions
+ *
+ * Converts (possibly interleaved) accessor data of any glTF component type into the float based vertex layout used by vkglTF::Model
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vkglTF
+{
+	namespace accessor
+	{
+		/** @brief glTF accessor component types (same values as the matching OpenGL enums) */
+		enum ComponentType : uint32_t {
+			Byte = 5120,
+			UnsignedByte = 5121,
+			Short = 5122,
+			UnsignedShort = 5123,
+			UnsignedInt = 5125,
+			Float = 5126,
+			/** @brief IEEE 754 half precision, not a core glTF type but used by views over quantized or decoded vertex data */
+			HalfFloat = 5131
+		};
+
+		/** @brief Description of the elements referenced by a glTF accessor */
+		struct View {
+			/** @brief Pointer to the first component of the first element */
+			const unsigned char* data = nullptr;
+			/** @brief Number of elements */
+			size_t count = 0;
+			/** @brief Distance in bytes between the starts of two consecutive elements */
+			size_t stride = 0;
+			ComponentType componentType = Float;
+			/** @brief Number of components per element (1 for scalars up to 4 for vec4) */
+			uint32_t componentCount = 0;
+			/** @brief Integer components are mapped to [0..1] (unsigned) or [-1..1] (signed) */
+			bool normalized = false;
+		};
+
+		size_t componentSize(ComponentType componentType);
+		void readFloats(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill);
+		void readFloatsScalar(const View& view, float* dst, size_t dstStride, uint32_t dstComponents, const float* fill);
+		float halfToFloat(uint16_t value);
+		void fillFloats(float* dst, size_t dstStride, uint32_t dstComponents, const float* values, size_t count);
+		void normalizeVec3(float* data, size_t stride, size_t count);
+		void readIndices(const View& view, uint32_t* dst, uint32_t baseVertex);
+	}
+}
@@ -0,0 +1,531 @@
+/*
+ * Bounding volume hierarchy over glTF triangles
+ *
+ * Binned SAH hierarchy with up to four triangles per leaf, stored in a layout that lets a single SIMD test check all triangles of a leaf,
+ * used for CPU side ray queries like picking, visibility and collision checks
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VulkanglTFBvh.h"
+#include "jobsystem.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKGLTF_BVH_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vkglTF
+{
+	namespace
+	{
+		const uint32_t binCount = 16;
+		// Subtrees with more triangles than this are split off as separate jobs
+		const uint32_t parallelBuildThreshold = 4096;
+		// Below this depth splits fall back to the object median, which bounds the depth of the remaining subtree to log2 of its triangle count
+		const uint32_t maxSahDepth = 48;
+		const uint32_t traversalStackSize = 96;
+
+		struct Bounds {
+			glm::vec3 min = glm::vec3(FLT_MAX);
+			glm::vec3 max = glm::vec3(-FLT_MAX);
+
+			void grow(const glm::vec3& p)
+			{
+				min = glm::min(min, p);
+				max = glm::max(max, p);
+			}
+			void grow(const Bounds& b)
+			{
+				min = glm::min(min, b.min);
+				max = glm::max(max, b.max);
+			}
+			// Half the surface area, only used for relative costs
+			float area() const
+			{
+				const glm::vec3 e = max - min;
+				return (e.x < 0.0f) ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+			}
+		};
+
+		template<typename F>
+		void forEach(vks::JobSystem* jobSystem, size_t count, F&& function)
+		{
+			const uint32_t grainSize = 1024;
+			if (jobSystem && (count > grainSize)) {
+				jobSystem->parallelFor(static_cast<uint32_t>(count), grainSize, function);
+			} else {
+				for (size_t i = 0; i < count; i++) {
+					function(static_cast<uint32_t>(i));
+				}
+			}
+		}
+
+		// Splits a node range into two child ranges, all state is shared by the build jobs and only written to disjoint ranges
+		struct Builder {
+			std::vector<Bvh::Node>& nodes;
+			std::vector<uint32_t>& ids;
+			const std::vector<Bounds>& triangleBounds;
+			const std::vector<glm::vec3>& centroids;
+			vks::JobSystem* jobSystem;
+			std::atomic<uint32_t> nodeCount{ 1 };
+
+			Builder(std::vector<Bvh::Node>& nodes, std::vector<uint32_t>& ids, const std::vector<Bounds>& triangleBounds, const std::vector<glm::vec3>& centroids, vks::JobSystem* jobSystem)
+				: nodes(nodes), ids(ids), triangleBounds(triangleBounds), centroids(centroids), jobSystem(jobSystem) {}
+
+			void makeLeaf(Bvh::Node& node, uint32_t first, uint32_t count)
+			{
+				node.first = first;
+				node.triangleCount = count;
+			}
+
+			void subdivide(uint32_t nodeIndex, uint32_t first, uint32_t count, uint32_t depth)
+			{
+				Bvh::Node& node = nodes[nodeIndex];
+				Bounds bounds, centroidBounds;
+				for (uint32_t i = first; i < first + count; i++) {
+					bounds.grow(triangleBounds[ids[i]]);
+					centroidBounds.grow(centroids[ids[i]]);
+				}
+				node.min = bounds.min;
+				node.max = bounds.max;
+				// All triangles of a leaf are tested at once, so splitting a range that fits into a single leaf never pays off
+				if (count <= Bvh::maxLeafSize) {
+					makeLeaf(node, first, count);
+					return;
+				}
+
+				// Evaluate the split planes between the bins of all three axes
+				int32_t bestAxis = -1;
+				uint32_t bestSplit = 0;
+				float bestCost = FLT_MAX;
+				const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+				if (depth < maxSahDepth) {
+					for (int32_t axis = 0; axis < 3; axis++) {
+						if (extent[axis] <= 0.0f) {
+							continue;
+						}
+						Bounds bins[binCount];
+						uint32_t binCounts[binCount] = {};
+						const float binScale = static_cast<float>(binCount) / extent[axis];
+						for (uint32_t i = first; i < first + count; i++) {
+							const uint32_t bin = std::min(static_cast<uint32_t>((centroids[ids[i]][axis] - centroidBounds.min[axis]) * binScale), binCount - 1);
+							binCounts[bin]++;
+							bins[bin].grow(triangleBounds[ids[i]]);
+						}
+						float leftAreas[binCount - 1];
+						uint32_t leftCounts[binCount - 1];
+						Bounds left;
+						uint32_t leftCount = 0;
+						for (uint32_t i = 0; i < binCount - 1; i++) {
+							left.grow(bins[i]);
+							leftCount += binCounts[i];
+							leftAreas[i] = left.area();
+							leftCounts[i] = leftCount;
+						}
+						Bounds right;
+						uint32_t rightCount = 0;
+						for (uint32_t i = binCount - 1; i > 0; i--) {
+							right.grow(bins[i]);
+							rightCount += binCounts[i];
+							if ((leftCounts[i - 1] == 0) || (rightCount == 0)) {
+								continue;
+							}
+							const float cost = leftCounts[i - 1] * leftAreas[i - 1] + rightCount * right.area();
+							if (cost < bestCost) {
+								bestCost = cost;
+								bestAxis = axis;
+								bestSplit = i;
+							}
+						}
+					}
+				}
+
+				uint32_t leftCount = 0;
+				if (bestAxis >= 0) {
+					const float binScale = static_cast<float>(binCount) / extent[bestAxis];
+					const float minCentroid = centroidBounds.min[bestAxis];
+					const glm::vec3* centroidData = centroids.data();
+					uint32_t* middle = std::partition(ids.data() + first, ids.data() + first + count, [=](uint32_t id) {
+						return std::min(static_cast<uint32_t>((centroidData[id][bestAxis] - minCentroid) * binScale), binCount - 1) < bestSplit;
+					});
+					leftCount = static_cast<uint32_t>(middle - (ids.data() + first));
+				}
+				if ((leftCount == 0) || (leftCount == count)) {
+					// No usable split plane, e.g. all centroids coincide, so split at the median along the widest centroid axis
+					const int32_t axis = (extent.x >= extent.y) ? ((extent.x >= extent.z) ? 0 : 2) : ((extent.y >= extent.z) ? 1 : 2);
+					leftCount = count / 2;
+					const glm::vec3* centroidData = centroids.data();
+					std::nth_element(ids.data() + first, ids.data() + first + leftCount, ids.data() + first + count, [=](uint32_t a, uint32_t b) {
+						return centroidData[a][axis] < centroidData[b][axis];
+					});
+				}
+
+				const uint32_t children = nodeCount.fetch_add(2);
+				node.first = children;
+				node.triangleCount = 0;
+				if (jobSystem && (count > parallelBuildThreshold)) {
+					vks::JobCounter counter;
+					jobSystem->run([this, children, first, leftCount, depth]() {
+						subdivide(children, first, leftCount, depth + 1);
+					}, &counter);
+					subdivide(children + 1, first + leftCount, count - leftCount, depth + 1);
+					jobSystem->wait(counter);
+				} else {
+					subdivide(children, first, leftCount, depth + 1);
+					subdivide(children + 1, first + leftCount, count - leftCount, depth + 1);
+				}
+			}
+		};
+
+		// Ray with precomputed reciprocal direction, zero direction components are nudged so the slab tests never compute 0 * inf
+		struct RaySetup {
+			glm::vec3 origin;
+			glm::vec3 direction;
+			glm::vec3 invDirection;
+#if defined(VKGLTF_BVH_SSE2)
+			__m128 origin4;
+			__m128 invDirection4;
+			__m128 ox, oy, oz, dx, dy, dz;
+#endif
+
+			explicit RaySetup(const Bvh::Ray& ray) : origin(ray.origin), direction(ray.direction)
+			{
+				for (int32_t i = 0; i < 3; i++) {
+					const float d = (fabsf(direction[i]) < 1e-30f) ? copysignf(1e-30f, direction[i]) : direction[i];
+					invDirection[i] = 1.0f / d;
+				}
+#if defined(VKGLTF_BVH_SSE2)
+				origin4 = _mm_set_ps(0.0f, origin.z, origin.y, origin.x);
+				invDirection4 = _mm_set_ps(0.0f, invDirection.z, invDirection.y, invDirection.x);
+				ox = _mm_set1_ps(origin.x);
+				oy = _mm_set1_ps(origin.y);
+				oz = _mm_set1_ps(origin.z);
+				dx = _mm_set1_ps(direction.x);
+				dy = _mm_set1_ps(direction.y);
+				dz = _mm_set1_ps(direction.z);
+#endif
+			}
+		};
+
+		// Slab test, returns the entry distance of the ray into the box if it overlaps [tMin, tMax]
+		inline bool intersectBox(const Bvh::Node& node, const RaySetup& ray, float tMin, float tMax, float& tNear)
+		{
+#if defined(VKGLTF_BVH_SSE2)
+			// The fourth lane of the node's bounds holds integer data and is masked out
+			const __m128 mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+			const __m128 boxMin = _mm_and_ps(_mm_loadu_ps(&node.min.x), mask);
+			const __m128 boxMax = _mm_and_ps(_mm_loadu_ps(&node.max.x), mask);
+			const __m128 t1 = _mm_mul_ps(_mm_sub_ps(boxMin, ray.origin4), ray.invDirection4);
+			const __m128 t2 = _mm_mul_ps(_mm_sub_ps(boxMax, ray.origin4), ray.invDirection4);
+			__m128 entry = _mm_or_ps(_mm_and_ps(_mm_min_ps(t1, t2), mask), _mm_andnot_ps(mask, _mm_set1_ps(tMin)));
+			__m128 exit = _mm_or_ps(_mm_and_ps(_mm_max_ps(t1, t2), mask), _mm_andnot_ps(mask, _mm_set1_ps(tMax)));
+			entry = _mm_max_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+			entry = _mm_max_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+			exit = _mm_min_ps(exit, _mm_shuffle_ps(exit, exit, _MM_SHUFFLE(1, 0, 3, 2)));
+			exit = _mm_min_ps(exit, _mm_shuffle_ps(exit, exit, _MM_SHUFFLE(2, 3, 0, 1)));
+			tNear = _mm_cvtss_f32(entry);
+			return tNear <= _mm_cvtss_f32(exit);
+#else
+			float entry = tMin, exit = tMax;
+			for (int32_t i = 0; i < 3; i++) {
+				const float t1 = (node.min[i] - ray.origin[i]) * ray.invDirection[i];
+				const float t2 = (node.max[i] - ray.origin[i]) * ray.invDirection[i];
+				entry = std::max(entry, std::min(t1, t2));
+				exit = std::min(exit, std::max(t1, t2));
+			}
+			tNear = entry;
+			return entry <= exit;
+#endif
+		}
+	}
+
+	/**
+	* Copy the triangles of a leaf into its block and update the leaf's bounds
+	*
+	* @param block Block with the leaf's triangle indices
+	* @param leaf Leaf node the block belongs to
+	* @param vertices Triangle soup the hierarchy was built from
+	*/
+	void Bvh::fillBlock(TriangleBlock& block, Node& leaf, const glm::vec3* vertices) const
+	{
+		Bounds bounds;
+		for (uint32_t lane = 0; lane < maxLeafSize; lane++) {
+			glm::vec3 v0(0.0f), edge1(0.0f), edge2(0.0f);
+			if (lane < leaf.triangleCount) {
+				const glm::vec3* triangle = vertices + block.triangles[lane] * 3;
+				v0 = triangle[0];
+				edge1 = triangle[1] - triangle[0];
+				edge2 = triangle[2] - triangle[0];
+				bounds.grow(triangle[0]);
+				bounds.grow(triangle[1]);
+				bounds.grow(triangle[2]);
+			}
+			for (int32_t c = 0; c < 3; c++) {
+				block.v0[c][lane] = v0[c];
+				block.edge1[c][lane] = edge1[c];
+				block.edge2[c][lane] = edge2[c];
+			}
+		}
+		leaf.min = bounds.min;
+		leaf.max = bounds.max;
+	}
+
+	/**
+	* Build the hierarchy for a triangle soup
+	*
+	* @param vertices Three vertices per triangle
+	* @param triangleCount Number of triangles
+	* @param jobSystem (Optional) Job system used to build large subtrees in parallel
+	*/
+	void Bvh::build(const glm::vec3* vertices, size_t triangleCount, vks::JobSystem* jobSystem)
+	{
+		clear();
+		triangles = triangleCount;
+		if (triangleCount == 0) {
+			return;
+		}
+
+		std::vector<Bounds> triangleBounds(triangleCount);
+		std::vector<glm::vec3> centroids(triangleCount);
+		forEach(jobSystem, triangleCount, [&](uint32_t i) {
+			Bounds& bounds = triangleBounds[i];
+			bounds.grow(vertices[i * 3]);
+			bounds.grow(vertices[i * 3 + 1]);
+			bounds.grow(vertices[i * 3 + 2]);
+			centroids[i] = (bounds.min + bounds.max) * 0.5f;
+		});
+		std::vector<uint32_t> ids(triangleCount);
+		std::iota(ids.begin(), ids.end(), 0);
+
+		// A binary tree with at least one triangle per leaf never needs more nodes than this
+		nodes.resize(triangleCount * 2 - 1);
+		Builder builder(nodes, ids, triangleBounds, centroids, jobSystem);
+		builder.subdivide(0, 0, static_cast<uint32_t>(triangleCount), 0);
+		nodes.resize(builder.nodeCount.load());
+		nodes.shrink_to_fit();
+
+		// Leaves still reference their range of ids, replace that with their triangle block
+		uint32_t leafCount = 0;
+		for (const Node& node : nodes) {
+			leafCount += (node.triangleCount > 0);
+		}
+		blocks.resize(leafCount);
+		std::vector<uint32_t> leaves;
+		leaves.reserve(leafCount);
+		for (uint32_t i = 0; i < nodes.size(); i++) {
+			Node& node = nodes[i];
+			if (node.triangleCount > 0) {
+				TriangleBlock& block = blocks[leaves.size()];
+				for (uint32_t lane = 0; lane < maxLeafSize; lane++) {
+					block.triangles[lane] = (lane < node.triangleCount) ? ids[node.first + lane] : ~0u;
+				}
+				node.first = static_cast<uint32_t>(leaves.size());
+				leaves.push_back(i);
+			}
+		}
+		forEach(jobSystem, leaves.size(), [&](uint32_t i) {
+			fillBlock(blocks[i], nodes[leaves[i]], vertices);
+		});
+	}
+
+	/**
+	* Update the bounds of all nodes after the vertices have moved, e.g. for animated nodes
+	*
+	* @param vertices Triangle soup with the same triangles in the same order as the one the hierarchy was built from
+	* @param jobSystem (Optional) Job system used to update the leaves in parallel
+	*
+	* @note Refitting keeps the topology, so the hierarchy gets less efficient the further the triangles move from where they were at build time
+	*/
+	void Bvh::refit(const glm::vec3* vertices, vks::JobSystem* jobSystem)
+	{
+		forEach(jobSystem, nodes.size(), [&](uint32_t i) {
+			Node& node = nodes[i];
+			if (node.triangleCount > 0) {
+				fillBlock(blocks[node.first], node, vertices);
+			}
+		});
+		// Children are always stored after their parent, so a reverse pass sees both children of a node before the node itself
+		for (size_t i = nodes.size(); i-- > 0;) {
+			Node& node = nodes[i];
+			if (node.triangleCount == 0) {
+				const Node& left = nodes[node.first];
+				const Node& right = nodes[node.first + 1];
+				node.min = glm::min(left.min, right.min);
+				node.max = glm::max(left.max, right.max);
+			}
+		}
+	}
+
+	template<bool AnyHit>
+	bool Bvh::traverse(const Ray& ray, Hit& hit) const
+	{
+		if (nodes.empty()) {
+			return false;
+		}
+		const RaySetup setup(ray);
+		float tBest = ray.tMax;
+		bool found = false;
+		float tNear;
+		if (!intersectBox(nodes[0], setup, ray.tMin, tBest, tNear)) {
+			return false;
+		}
+
+		uint32_t stack[traversalStackSize];
+		float stackDistances[traversalStackSize];
+		uint32_t stackSize = 0;
+		uint32_t index = 0;
+		while (true) {
+			const Node& node = nodes[index];
+			if (node.triangleCount > 0) {
+				// Moeller-Trumbore for all triangles of the leaf at once
+				const TriangleBlock& block = blocks[node.first];
+#if defined(VKGLTF_BVH_SSE2)
+				const __m128 e1x = _mm_loadu_ps(block.edge1[0]), e1y = _mm_loadu_ps(block.edge1[1]), e1z = _mm_loadu_ps(block.edge1[2]);
+				const __m128 e2x = _mm_loadu_ps(block.edge2[0]), e2y = _mm_loadu_ps(block.edge2[1]), e2z = _mm_loadu_ps(block.edge2[2]);
+				const __m128 px = _mm_sub_ps(_mm_mul_ps(setup.dy, e2z), _mm_mul_ps(setup.dz, e2y));
+				const __m128 py = _mm_sub_ps(_mm_mul_ps(setup.dz, e2x), _mm_mul_ps(setup.dx, e2z));
+				const __m128 pz = _mm_sub_ps(_mm_mul_ps(setup.dx, e2y), _mm_mul_ps(setup.dy, e2x));
+				const __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)), _mm_mul_ps(e1z, pz));
+				const __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+				const __m128 tx = _mm_sub_ps(setup.ox, _mm_loadu_ps(block.v0[0]));
+				const __m128 ty = _mm_sub_ps(setup.oy, _mm_loadu_ps(block.v0[1]));
+				const __m128 tz = _mm_sub_ps(setup.oz, _mm_loadu_ps(block.v0[2]));
+				const __m128 u = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)), _mm_mul_ps(tz, pz)), invDet);
+				const __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+				const __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+				const __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+				const __m128 v = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(setup.dx, qx), _mm_mul_ps(setup.dy, qy)), _mm_mul_ps(setup.dz, qz)), invDet);
+				const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)), _mm_mul_ps(e2z, qz)), invDet);
+				const __m128 zero = _mm_setzero_ps();
+				__m128 valid = _mm_cmpneq_ps(det, zero);
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(u, zero));
+				valid = _mm_and_ps(valid, _mm_cmpge_ps(v, zero));
+				valid = _mm_and_ps(valid, _mm_cmple_ps(_mm_add_ps(u, v), _mm_set1_ps(1.0f)));
+				valid = _mm_and_ps(valid, _mm_cmpgt_ps(t, _mm_set1_ps(ray.tMin)));
+				valid = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(tBest)));
+				int32_t hitMask = _mm_movemask_ps(valid);
+				if (hitMask != 0) {
+					if (AnyHit) {
+						return true;
+					}
+					alignas(16) float ts[4], us[4], vs[4];
+					_mm_store_ps(ts, t);
+					_mm_store_ps(us, u);
+					_mm_store_ps(vs, v);
+					for (uint32_t lane = 0; lane < maxLeafSize; lane++) {
+						if ((hitMask & (1 << lane)) && (ts[lane] < tBest)) {
+							tBest = ts[lane];
+							hit.t = ts[lane];
+							hit.u = us[lane];
+							hit.v = vs[lane];
+							hit.triangle = block.triangles[lane];
+							found = true;
+						}
+					}
+				}
+#else
+				for (uint32_t lane = 0; lane < node.triangleCount; lane++) {
+					const glm::vec3 edge1(block.edge1[0][lane], block.edge1[1][lane], block.edge1[2][lane]);
+					const glm::vec3 edge2(block.edge2[0][lane], block.edge2[1][lane], block.edge2[2][lane]);
+					const glm::vec3 p = glm::cross(setup.direction, edge2);
+					const float det = glm::dot(edge1, p);
+					if (det == 0.0f) {
+						continue;
+					}
+					const float invDet = 1.0f / det;
+					const glm::vec3 s = setup.origin - glm::vec3(block.v0[0][lane], block.v0[1][lane], block.v0[2][lane]);
+					const float u = glm::dot(s, p) * invDet;
+					const glm::vec3 q = glm::cross(s, edge1);
+					const float v = glm::dot(setup.direction, q) * invDet;
+					const float t = glm::dot(edge2, q) * invDet;
+					if ((u >= 0.0f) && (v >= 0.0f) && (u + v <= 1.0f) && (t > ray.tMin) && (t < tBest)) {
+						if (AnyHit) {
+							return true;
+						}
+						tBest = t;
+						hit.t = t;
+						hit.u = u;
+						hit.v = v;
+						hit.triangle = block.triangles[lane];
+						found = true;
+					}
+				}
+#endif
+			} else {
+				// Continue with the closer child, the other one is visited later unless a closer hit has been found by then
+				uint32_t nearChild = node.first, farChild = node.first + 1;
+				float tNearChild, tFarChild;
+				const bool hitNear = intersectBox(nodes[nearChild], setup, ray.tMin, tBest, tNearChild);
+				const bool hitFar = intersectBox(nodes[farChild], setup, ray.tMin, tBest, tFarChild);
+				if (hitNear && hitFar) {
+					if (tFarChild < tNearChild) {
+						std::swap(nearChild, farChild);
+						std::swap(tNearChild, tFarChild);
+					}
+					stack[stackSize] = farChild;
+					stackDistances[stackSize] = tFarChild;
+					stackSize++;
+					index = nearChild;
+					continue;
+				}
+				if (hitNear || hitFar) {
+					index = hitNear ? nearChild : farChild;
+					continue;
+				}
+			}
+			// Pop the next node that may still contain a closer hit
+			bool next = false;
+			while (stackSize > 0) {
+				stackSize--;
+				if (stackDistances[stackSize] <= tBest) {
+					index = stack[stackSize];
+					next = true;
+					break;
+				}
+			}
+			if (!next) {
+				break;
+			}
+		}
+		return found;
+	}
+
+	/**
+	* Find the closest intersection of a ray with the triangles
+	*
+	* @param ray Ray to trace, only hits within (tMin, tMax) are reported
+	* @param hit Receives the closest hit
+	*
+	* @return True if the ray hit a triangle
+	*/
+	bool Bvh::intersect(const Ray& ray, Hit& hit) const
+	{
+		return traverse<false>(ray, hit);
+	}
+
+	/**
+	* Check if a ray hits any triangle, stops at the first intersection found, e.g. for shadow or line of sight rays
+	*
+	* @param ray Ray to trace, only hits within (tMin, tMax) are considered
+	*
+	* @return True if the ray hit a triangle
+	*/
+	bool Bvh::occluded(const Ray& ray) const
+	{
+		Hit hit;
+		return traverse<true>(ray, hit);
+	}
+
+	void Bvh::clear()
+	{
+		nodes.clear();
+		blocks.clear();
+		triangles = 0;
+	}
+}
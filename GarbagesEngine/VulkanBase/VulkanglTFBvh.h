@@ -0,0 +1,83 @@
+/*
+ * Bounding volume hierarchy over glTF triangles
+ *
+ * Binned SAH hierarchy with up to four triangles per leaf, stored in a layout that lets a single SIMD test check all triangles of a leaf,
+ * used for CPU side ray queries like picking, visibility and collision checks
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cfloat>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vks
+{
+	class JobSystem;
+}
+
+namespace vkglTF
+{
+	/**
+	* @brief Bounding volume hierarchy over a triangle soup
+	* @note Triangles are given as three consecutive vertices each, the hierarchy only stores triangle indices and a copy of the positions of each leaf
+	*/
+	class Bvh
+	{
+	public:
+		struct Ray {
+			glm::vec3 origin;
+			/** @brief Doesn't need to be normalized, hit distances are given in multiples of the direction */
+			glm::vec3 direction;
+			float tMin = 0.0f;
+			float tMax = FLT_MAX;
+		};
+		struct Hit {
+			float t = FLT_MAX;
+			/** @brief Barycentric coordinates of the hit, weights of the triangle's second and third vertex */
+			float u = 0.0f;
+			float v = 0.0f;
+			uint32_t triangle = ~0u;
+		};
+		/** @brief Node bounds, leaves reference their triangle block and inner nodes their first child, the second child is stored right after the first */
+		struct Node {
+			glm::vec3 min;
+			uint32_t first;
+			glm::vec3 max;
+			/** @brief Number of triangles of a leaf, zero for inner nodes */
+			uint32_t triangleCount;
+		};
+		std::vector<Node> nodes;
+
+		/** @brief Maximum number of triangles per leaf, matches the width of the triangle test */
+		static const uint32_t maxLeafSize = 4;
+
+		void build(const glm::vec3* vertices, size_t triangleCount, vks::JobSystem* jobSystem = nullptr);
+		void refit(const glm::vec3* vertices, vks::JobSystem* jobSystem = nullptr);
+		bool intersect(const Ray& ray, Hit& hit) const;
+		bool occluded(const Ray& ray) const;
+		void clear();
+		size_t triangleCount() const { return triangles; }
+
+	private:
+		/** @brief Triangles of a leaf in structure of arrays layout, unused lanes hold degenerate triangles */
+		struct TriangleBlock {
+			float v0[3][maxLeafSize];
+			float edge1[3][maxLeafSize];
+			float edge2[3][maxLeafSize];
+			uint32_t triangles[maxLeafSize];
+		};
+		std::vector<TriangleBlock> blocks;
+		size_t triangles = 0;
+
+		void fillBlock(TriangleBlock& block, Node& leaf, const glm::vec3* vertices) const;
+		template<bool AnyHit> bool traverse(const Ray& ray, Hit& hit) const;
+	};
+}
@@ -0,0 +1,155 @@
+/*
+ * glTF meshlet building
+ *
+ * Partitions indexed triangle lists into clusters with a bounded number of vertices and triangles as consumed by mesh shaders,
+ * along with bounding spheres and normal cones for frustum and backface culling of whole clusters
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VulkanglTFMeshlets.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+namespace vkglTF
+{
+	namespace meshlets
+	{
+		namespace
+		{
+			// Marks vertices that aren't part of the meshlet being built
+			const uint8_t notInMeshlet = 0xff;
+
+			inline glm::vec3 loadPosition(const float* positions, size_t positionStride, uint32_t vertex)
+			{
+				const float* p = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(positions) + vertex * positionStride);
+				return glm::vec3(p[0], p[1], p[2]);
+			}
+		}
+
+		/**
+		* Split an indexed triangle list into meshlets, triangles are assigned in index order
+		*
+		* @param meshlets Meshlets are appended to this list
+		* @param meshletVertices Vertex indices of the meshlets are appended to this list
+		* @param meshletTriangles Packed triangles of the meshlets are appended to this list
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices, must be a multiple of three
+		* @param vertexCount Number of vertices referenced by the indices
+		* @param maxVertices Maximum number of vertices per meshlet, at most 255
+		* @param maxTriangles Maximum number of triangles per meshlet
+		*
+		* @note Meshlets are only as compact as the triangle order allows, so indices should be optimized for the vertex cache first
+		*/
+		void buildMeshlets(std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t maxVertices, uint32_t maxTriangles)
+		{
+			assert(indexCount % 3 == 0);
+			assert((maxVertices >= 3) && (maxVertices < notInMeshlet) && (maxTriangles >= 1));
+
+			// Position of each vertex within the current meshlet
+			std::vector<uint8_t> slots(vertexCount, notInMeshlet);
+			Meshlet meshlet{ static_cast<uint32_t>(meshletVertices.size()), static_cast<uint32_t>(meshletTriangles.size()), 0, 0 };
+
+			auto finish = [&]() {
+				for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+					slots[meshletVertices[meshlet.vertexOffset + i]] = notInMeshlet;
+				}
+				// Keep the triangle data of the next meshlet word aligned
+				meshletTriangles.resize((meshletTriangles.size() + 3) & ~static_cast<size_t>(3), 0);
+				meshlets.push_back(meshlet);
+				meshlet = { static_cast<uint32_t>(meshletVertices.size()), static_cast<uint32_t>(meshletTriangles.size()), 0, 0 };
+			};
+
+			for (size_t i = 0; i < indexCount; i += 3) {
+				const uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+				const uint32_t newVertices = (slots[a] == notInMeshlet) + (slots[b] == notInMeshlet) + (slots[c] == notInMeshlet);
+				if ((meshlet.vertexCount + newVertices > maxVertices) || (meshlet.triangleCount + 1 > maxTriangles)) {
+					finish();
+				}
+				for (uint32_t vertex : { a, b, c }) {
+					if (slots[vertex] == notInMeshlet) {
+						slots[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+						meshletVertices.push_back(vertex);
+					}
+					meshletTriangles.push_back(slots[vertex]);
+				}
+				meshlet.triangleCount++;
+			}
+			if (meshlet.triangleCount > 0) {
+				finish();
+			}
+		}
+
+		/**
+		* Compute the bounding sphere and normal cone of a meshlet
+		*
+		* @param meshlet Meshlet returned by buildMeshlets
+		* @param meshletVertices Meshlet vertex array the meshlet's vertexOffset refers to
+		* @param meshletTriangles Meshlet triangle array the meshlet's triangleOffset refers to
+		* @param positions First vertex position, indexed by the entries of meshletVertices
+		* @param positionStride Distance between two positions in bytes
+		* @param clockwise Front faces are wound clockwise, e.g. after the positions have been mirrored
+		*
+		* @return Bounds in the space of the positions
+		*/
+		MeshletBounds computeBounds(const Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles, const float* positions, size_t positionStride, bool clockwise)
+		{
+			MeshletBounds bounds{};
+
+			// Sphere around the center of the bounding box, which is tight enough for the small and compact vertex sets of meshlets
+			glm::vec3 minPosition(FLT_MAX), maxPosition(-FLT_MAX);
+			for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+				const glm::vec3 p = loadPosition(positions, positionStride, meshletVertices[meshlet.vertexOffset + i]);
+				minPosition = glm::min(minPosition, p);
+				maxPosition = glm::max(maxPosition, p);
+			}
+			const glm::vec3 center = (minPosition + maxPosition) * 0.5f;
+			float radius = 0.0f;
+			for (uint32_t i = 0; i < meshlet.vertexCount; i++) {
+				radius = std::max(radius, glm::distance(center, loadPosition(positions, positionStride, meshletVertices[meshlet.vertexOffset + i])));
+			}
+			bounds.sphere = glm::vec4(center, radius);
+
+			// The cone axis is the average of the unit face normals, its spread is given by the normal deviating the most from it
+			std::vector<glm::vec3> normals;
+			normals.reserve(meshlet.triangleCount);
+			glm::vec3 axis(0.0f);
+			const uint8_t* triangles = meshletTriangles + meshlet.triangleOffset;
+			for (uint32_t t = 0; t < meshlet.triangleCount; t++) {
+				const glm::vec3 p0 = loadPosition(positions, positionStride, meshletVertices[meshlet.vertexOffset + triangles[t * 3]]);
+				const glm::vec3 p1 = loadPosition(positions, positionStride, meshletVertices[meshlet.vertexOffset + triangles[t * 3 + 1]]);
+				const glm::vec3 p2 = loadPosition(positions, positionStride, meshletVertices[meshlet.vertexOffset + triangles[t * 3 + 2]]);
+				glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+				const float length = glm::length(normal);
+				// Degenerate triangles are never visible and don't constrain the cone
+				if (length <= 0.0f) {
+					continue;
+				}
+				normal /= clockwise ? -length : length;
+				normals.push_back(normal);
+				axis += normal;
+			}
+			const float axisLength = glm::length(axis);
+			if (normals.empty() || (axisLength <= 1e-6f)) {
+				bounds.cone = glm::vec4(0.0f, 0.0f, 1.0f, 1.0f);
+				return bounds;
+			}
+			axis /= axisLength;
+			float minDot = 1.0f;
+			for (const glm::vec3& normal : normals) {
+				minDot = std::min(minDot, glm::dot(normal, axis));
+			}
+			// Cones wider than a hemisphere can never be culled as a whole
+			if (minDot <= 0.0f) {
+				bounds.cone = glm::vec4(axis, 1.0f);
+				return bounds;
+			}
+			// All faces point away from a viewer whose view direction is closer than 90 degrees minus the cone angle to the axis
+			bounds.cone = glm::vec4(axis, sqrtf(1.0f - minDot * minDot));
+			return bounds;
+		}
+	}
+}
@@ -0,0 +1,58 @@
+/*
+ * glTF meshlet building
+ *
+ * Partitions indexed triangle lists into clusters with a bounded number of vertices and triangles as consumed by mesh shaders,
+ * along with bounding spheres and normal cones for frustum and backface culling of whole clusters
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vkglTF
+{
+	/**
+	* @brief Cluster of triangles, laid out for use in a storage buffer (std430)
+	* @note Triangles are stored as three byte sized indices into the meshlet's vertices, each meshlet's triangle data starts at a four byte boundary
+	*/
+	struct Meshlet {
+		/** @brief First entry in the meshlet vertex array, which holds indices into the vertex buffer */
+		uint32_t vertexOffset;
+		/** @brief First byte in the meshlet triangle array */
+		uint32_t triangleOffset;
+		uint32_t vertexCount;
+		uint32_t triangleCount;
+	};
+
+	/** @brief Culling bounds of a meshlet, laid out for use in a storage buffer (std430) */
+	struct MeshletBounds {
+		/** @brief Bounding sphere center (xyz) and radius (w) */
+		glm::vec4 sphere;
+		/** @brief Normal cone axis (xyz) and cutoff (w), the sine of the cone's half angle, a cutoff of 1 disables backface culling */
+		glm::vec4 cone;
+	};
+
+	namespace meshlets
+	{
+		/** @brief Limits that fit common mesh shader output sizes, the triangle count is a multiple of four so the packed indices of a full meshlet fill whole words */
+		const uint32_t defaultMaxVertices = 64;
+		const uint32_t defaultMaxTriangles = 124;
+
+		void buildMeshlets(std::vector<Meshlet>& meshlets, std::vector<uint32_t>& meshletVertices, std::vector<uint8_t>& meshletTriangles, const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t maxVertices = defaultMaxVertices, uint32_t maxTriangles = defaultMaxTriangles);
+		MeshletBounds computeBounds(const Meshlet& meshlet, const uint32_t* meshletVertices, const uint8_t* meshletTriangles, const float* positions, size_t positionStride, bool clockwise = false);
+		/** @brief True if the camera only sees back faces of the meshlet, all values are in the same space as the bounds */
+		inline bool isBackfacing(const MeshletBounds& bounds, const glm::vec3& cameraPosition)
+		{
+			const glm::vec3 direction = glm::vec3(bounds.sphere) - cameraPosition;
+			return glm::dot(direction, glm::vec3(bounds.cone)) >= bounds.cone.w * glm::length(direction) + bounds.sphere.w;
+		}
+	}
+}
@@ -0,0 +1,386 @@
+/*
+ * CPU mip chain generation for glTF textures
+ *
+ * Downsamples RGBA8 images with a box or Kaiser windowed sinc filter, averaging color in linear space for sRGB encoded images,
+ * used for formats the device can't blit and for baking the mip chains of decoded images on worker threads
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VulkanglTFMipmaps.h"
+#include "jobsystem.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKGLTF_MIPMAPS_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__) || defined(__AVX2__)
+#define VKGLTF_MIPMAPS_SSSE3
+#include <tmmintrin.h>
+#endif
+
+namespace vkglTF
+{
+	namespace mipmaps
+	{
+		namespace
+		{
+			const uint32_t kaiserTaps = 8;
+			// Destination rows are filtered in bands, so consecutive rows of a band can reuse horizontally filtered source rows
+			const uint32_t rowsPerBand = 16;
+
+			struct ConversionTables {
+				float unormToFloat[256];
+				float srgbToLinear[256];
+				// Indexed by the linear value scaled to 16 bits, which is fine enough to hit the closest sRGB value
+				uint8_t linearToSrgb[65536];
+
+				ConversionTables()
+				{
+					for (uint32_t i = 0; i < 256; i++) {
+						const float c = i / 255.0f;
+						unormToFloat[i] = c;
+						srgbToLinear[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+					}
+					for (uint32_t i = 0; i < 65536; i++) {
+						const float l = i / 65535.0f;
+						const float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+						linearToSrgb[i] = static_cast<uint8_t>(std::min(c, 1.0f) * 255.0f + 0.5f);
+					}
+				}
+			};
+
+			const ConversionTables& getConversionTables()
+			{
+				static const ConversionTables tables;
+				return tables;
+			}
+
+			// Modified Bessel function of the first kind, order zero
+			float besselI0(float x)
+			{
+				float sum = 1.0f, term = 1.0f;
+				for (uint32_t k = 1; k < 16; k++) {
+					const float f = x / (2.0f * k);
+					term *= f * f;
+					sum += term;
+				}
+				return sum;
+			}
+
+			// Weights of the source texels around a destination texel, a sinc with the destination's cutoff windowed over four destination texels
+			struct KaiserKernel {
+				float weights[kaiserTaps];
+
+				KaiserKernel()
+				{
+					const float pi = 3.14159265358979f;
+					const float beta = 4.0f;
+					float sum = 0.0f;
+					for (uint32_t t = 0; t < kaiserTaps; t++) {
+						// Distance between the source and destination texel centers in source texels
+						const float d = t - (kaiserTaps * 0.5f - 0.5f);
+						const float x = d * 0.5f;
+						const float sinc = sinf(pi * x) / (pi * x);
+						const float r = d / (kaiserTaps * 0.5f);
+						weights[t] = sinc * besselI0(beta * sqrtf(std::max(1.0f - r * r, 0.0f))) / besselI0(beta);
+						sum += weights[t];
+					}
+					for (uint32_t t = 0; t < kaiserTaps; t++) {
+						weights[t] /= sum;
+					}
+				}
+			};
+
+			const KaiserKernel& getKaiserKernel()
+			{
+				static const KaiserKernel kernel;
+				return kernel;
+			}
+
+			// Filtering works on one RGBA texel of floats per register
+#if defined(VKGLTF_MIPMAPS_SSE2)
+			typedef __m128 Texel;
+			inline Texel zeroTexel() { return _mm_setzero_ps(); }
+			inline Texel loadTexel(const float* p) { return _mm_loadu_ps(p); }
+			inline void storeTexel(float* p, Texel t) { _mm_storeu_ps(p, t); }
+			inline Texel multiplyAdd(Texel sum, Texel t, float weight) { return _mm_add_ps(sum, _mm_mul_ps(t, _mm_set1_ps(weight))); }
+#else
+			struct Texel {
+				float v[4];
+			};
+			inline Texel zeroTexel() { return Texel{ { 0.0f, 0.0f, 0.0f, 0.0f } }; }
+			inline Texel loadTexel(const float* p) { return Texel{ { p[0], p[1], p[2], p[3] } }; }
+			inline void storeTexel(float* p, Texel t) { memcpy(p, t.v, sizeof(t.v)); }
+			inline Texel multiplyAdd(Texel sum, Texel t, float weight)
+			{
+				for (uint32_t c = 0; c < 4; c++) {
+					sum.v[c] += t.v[c] * weight;
+				}
+				return sum;
+			}
+#endif
+
+			// Alpha is never sRGB encoded
+			void decodeRow(const uint8_t* src, uint32_t width, bool srgb, float* dst)
+			{
+				const ConversionTables& tables = getConversionTables();
+				const float* color = srgb ? tables.srgbToLinear : tables.unormToFloat;
+				for (size_t i = 0; i < size_t(width) * 4; i += 4) {
+					dst[i] = color[src[i]];
+					dst[i + 1] = color[src[i + 1]];
+					dst[i + 2] = color[src[i + 2]];
+					dst[i + 3] = tables.unormToFloat[src[i + 3]];
+				}
+			}
+
+			void encodeRow(const float* src, uint32_t width, bool srgb, uint8_t* dst)
+			{
+				if (srgb) {
+					const ConversionTables& tables = getConversionTables();
+					for (size_t i = 0; i < size_t(width) * 4; i += 4) {
+						for (uint32_t c = 0; c < 3; c++) {
+							dst[i + c] = tables.linearToSrgb[static_cast<uint32_t>(std::min(std::max(src[i + c], 0.0f), 1.0f) * 65535.0f + 0.5f)];
+						}
+						dst[i + 3] = static_cast<uint8_t>(std::min(std::max(src[i + 3], 0.0f), 1.0f) * 255.0f + 0.5f);
+					}
+					return;
+				}
+				uint32_t x = 0;
+#if defined(VKGLTF_MIPMAPS_SSE2)
+				// Negative lobes of the Kaiser filter can leave the unit range, the saturating packs clamp them
+				const __m128 scale = _mm_set1_ps(255.0f);
+				for (; x + 2 <= width; x += 2) {
+					const __m128i a = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + x * 4), scale));
+					const __m128i b = _mm_cvtps_epi32(_mm_mul_ps(_mm_loadu_ps(src + x * 4 + 4), scale));
+					const __m128i words = _mm_packs_epi32(a, b);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(words, words));
+				}
+#endif
+				for (size_t i = size_t(x) * 4; i < size_t(width) * 4; i++) {
+					dst[i] = static_cast<uint8_t>(std::min(std::max(src[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+				}
+			}
+
+			// Exactly rounded average of 2x2 texels for linear data
+			void boxFilterRow(const uint8_t* row0, const uint8_t* row1, uint32_t srcWidth, uint8_t* dst, uint32_t dstWidth)
+			{
+				uint32_t x = 0;
+#if defined(VKGLTF_MIPMAPS_SSE2)
+				// Two destination texels per iteration, using 16 bit sums
+				const __m128i zero = _mm_setzero_si128();
+				const __m128i rounding = _mm_set1_epi16(2);
+				for (; (x + 2 <= dstWidth) && (2 * x + 4 <= srcWidth); x += 2) {
+					const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row0 + x * 8));
+					const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1 + x * 8));
+					const __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+					const __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+					const __m128i sums = _mm_unpacklo_epi64(_mm_add_epi16(low, _mm_srli_si128(low, 8)), _mm_add_epi16(high, _mm_srli_si128(high, 8)));
+					const __m128i average = _mm_srli_epi16(_mm_add_epi16(sums, rounding), 2);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(dst + x * 4), _mm_packus_epi16(average, average));
+				}
+#endif
+				for (; x < dstWidth; x++) {
+					const uint32_t x0 = std::min(2 * x, srcWidth - 1) * 4;
+					const uint32_t x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+					for (uint32_t c = 0; c < 4; c++) {
+						dst[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+					}
+				}
+			}
+
+			void boxFilterRow(const float* row0, const float* row1, uint32_t srcWidth, float* dst, uint32_t dstWidth)
+			{
+				for (uint32_t x = 0; x < dstWidth; x++) {
+					const uint32_t x0 = std::min(2 * x, srcWidth - 1) * 4;
+					const uint32_t x1 = std::min(2 * x + 1, srcWidth - 1) * 4;
+					Texel sum = zeroTexel();
+					sum = multiplyAdd(sum, loadTexel(row0 + x0), 0.25f);
+					sum = multiplyAdd(sum, loadTexel(row0 + x1), 0.25f);
+					sum = multiplyAdd(sum, loadTexel(row1 + x0), 0.25f);
+					sum = multiplyAdd(sum, loadTexel(row1 + x1), 0.25f);
+					storeTexel(dst + x * 4, sum);
+				}
+			}
+
+			void kaiserFilterRow(const float* src, uint32_t srcWidth, const KaiserKernel& kernel, float* dst, uint32_t dstWidth)
+			{
+				for (uint32_t x = 0; x < dstWidth; x++) {
+					const int32_t first = static_cast<int32_t>(2 * x) - static_cast<int32_t>(kaiserTaps / 2 - 1);
+					Texel sum = zeroTexel();
+					for (uint32_t t = 0; t < kaiserTaps; t++) {
+						const int32_t sx = std::min(std::max(first + static_cast<int32_t>(t), 0), static_cast<int32_t>(srcWidth) - 1);
+						sum = multiplyAdd(sum, loadTexel(src + size_t(sx) * 4), kernel.weights[t]);
+					}
+					storeTexel(dst + size_t(x) * 4, sum);
+				}
+			}
+
+			void generateLevel(const uint8_t* src, uint32_t srcWidth, uint32_t srcHeight, uint8_t* dst, uint32_t dstWidth, uint32_t dstHeight, Filter filter, bool srgb, vks::JobSystem* jobSystem)
+			{
+				const size_t srcPitch = size_t(srcWidth) * 4;
+				const size_t dstPitch = size_t(dstWidth) * 4;
+				auto sourceRow = [&](int64_t y) {
+					return src + size_t(std::min(std::max(y, int64_t(0)), int64_t(srcHeight) - 1)) * srcPitch;
+				};
+
+				auto filterBand = [&](uint32_t band) {
+					const uint32_t firstRow = band * rowsPerBand;
+					const uint32_t endRow = std::min(firstRow + rowsPerBand, dstHeight);
+					if ((filter == Filter::Box) && !srgb) {
+						for (uint32_t y = firstRow; y < endRow; y++) {
+							boxFilterRow(sourceRow(2 * y), sourceRow(2 * y + 1), srcWidth, dst + y * dstPitch, dstWidth);
+						}
+						return;
+					}
+
+					std::vector<float> decoded(srcPitch * 2);
+					std::vector<float> filtered(dstPitch);
+					if (filter == Filter::Box) {
+						for (uint32_t y = firstRow; y < endRow; y++) {
+							decodeRow(sourceRow(2 * y), srcWidth, srgb, decoded.data());
+							decodeRow(sourceRow(2 * y + 1), srcWidth, srgb, decoded.data() + srcPitch);
+							boxFilterRow(decoded.data(), decoded.data() + srcPitch, srcWidth, filtered.data(), dstWidth);
+							encodeRow(filtered.data(), dstWidth, srgb, dst + y * dstPitch);
+						}
+						return;
+					}
+
+					// Horizontally filtered source rows, stored at their (unclamped) row number modulo the number of taps
+					const KaiserKernel& kernel = getKaiserKernel();
+					std::vector<float> rows(dstPitch * kaiserTaps);
+					int64_t storedRows[kaiserTaps];
+					std::fill(storedRows, storedRows + kaiserTaps, INT64_MIN);
+					for (uint32_t y = firstRow; y < endRow; y++) {
+						const int64_t first = int64_t(2 * y) - (kaiserTaps / 2 - 1);
+						const float* taps[kaiserTaps];
+						for (uint32_t t = 0; t < kaiserTaps; t++) {
+							const int64_t row = first + t;
+							const uint32_t slot = static_cast<uint32_t>(((row % kaiserTaps) + kaiserTaps) % kaiserTaps);
+							if (storedRows[slot] != row) {
+								decodeRow(sourceRow(row), srcWidth, srgb, decoded.data());
+								kaiserFilterRow(decoded.data(), srcWidth, kernel, rows.data() + slot * dstPitch, dstWidth);
+								storedRows[slot] = row;
+							}
+							taps[t] = rows.data() + slot * dstPitch;
+						}
+						for (size_t x = 0; x < dstPitch; x += 4) {
+							Texel sum = zeroTexel();
+							for (uint32_t t = 0; t < kaiserTaps; t++) {
+								sum = multiplyAdd(sum, loadTexel(taps[t] + x), kernel.weights[t]);
+							}
+							storeTexel(filtered.data() + x, sum);
+						}
+						encodeRow(filtered.data(), dstWidth, srgb, dst + y * dstPitch);
+					}
+				};
+
+				const uint32_t bandCount = (dstHeight + rowsPerBand - 1) / rowsPerBand;
+				if (jobSystem && (bandCount > 1)) {
+					jobSystem->parallelFor(bandCount, 1, filterBand);
+				} else {
+					for (uint32_t band = 0; band < bandCount; band++) {
+						filterBand(band);
+					}
+				}
+			}
+		}
+
+		uint32_t getLevelCount(uint32_t width, uint32_t height)
+		{
+			uint32_t levelCount = 1;
+			while ((std::max(width, height) >> levelCount) > 0) {
+				levelCount++;
+			}
+			return levelCount;
+		}
+
+		size_t getChainSize(uint32_t width, uint32_t height)
+		{
+			size_t size = 0;
+			for (uint32_t level = 0; level < getLevelCount(width, height); level++) {
+				size += size_t(std::max(width >> level, 1u)) * std::max(height >> level, 1u) * 4;
+			}
+			return size;
+		}
+
+		/**
+		* Expand tightly packed RGB texels to RGBA with an opaque alpha channel
+		*
+		* @param rgb Source texels, three bytes each
+		* @param rgba Destination for four bytes per texel, must not overlap the source
+		* @param pixelCount Number of texels
+		*/
+		void expandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t pixelCount)
+		{
+			size_t i = 0;
+#if defined(VKGLTF_MIPMAPS_SSSE3)
+			// Sixteen texels per iteration, each 16 byte block holds four source texels after realigning
+			const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+			const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+			for (; i + 16 <= pixelCount; i += 16) {
+				const __m128i* src = reinterpret_cast<const __m128i*>(rgb + i * 3);
+				const __m128i a = _mm_loadu_si128(src);
+				const __m128i b = _mm_loadu_si128(src + 1);
+				const __m128i c = _mm_loadu_si128(src + 2);
+				__m128i* dst = reinterpret_cast<__m128i*>(rgba + i * 4);
+				_mm_storeu_si128(dst, _mm_or_si128(_mm_shuffle_epi8(a, shuffle), alpha));
+				_mm_storeu_si128(dst + 1, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle), alpha));
+				_mm_storeu_si128(dst + 2, _mm_or_si128(_mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle), alpha));
+				_mm_storeu_si128(dst + 3, _mm_or_si128(_mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle), alpha));
+			}
+#else
+			// Four texels per iteration, shifting three little endian words into four
+			for (; i + 4 <= pixelCount; i += 4) {
+				uint32_t in[3];
+				memcpy(in, rgb + i * 3, sizeof(in));
+				const uint32_t out[4] = {
+					in[0] | 0xff000000,
+					(in[0] >> 24) | (in[1] << 8) | 0xff000000,
+					(in[1] >> 16) | (in[2] << 16) | 0xff000000,
+					(in[2] >> 8) | 0xff000000
+				};
+				memcpy(rgba + i * 4, out, sizeof(out));
+			}
+#endif
+			for (; i < pixelCount; i++) {
+				rgba[i * 4] = rgb[i * 3];
+				rgba[i * 4 + 1] = rgb[i * 3 + 1];
+				rgba[i * 4 + 2] = rgb[i * 3 + 2];
+				rgba[i * 4 + 3] = 0xff;
+			}
+		}
+
+		/**
+		* Generate all smaller levels of an RGBA8 mip chain from its first level
+		*
+		* @param chain Storage for the whole chain (see getChainSize) with the first level already filled in
+		* @param width Width of the first level
+		* @param height Height of the first level
+		* @param filter Downsampling filter
+		* @param srgb Color channels are sRGB encoded and averaged in linear space, alpha is always treated as linear
+		* @param jobSystem (Optional) Job system the rows of each level are distributed over
+		*
+		* @note Every level is filtered from the previous one, odd dimensions drop the last row or column like a blit does
+		*/
+		void generateMipChain(uint8_t* chain, uint32_t width, uint32_t height, Filter filter, bool srgb, vks::JobSystem* jobSystem)
+		{
+			const uint32_t levelCount = getLevelCount(width, height);
+			uint8_t* src = chain;
+			for (uint32_t level = 1; level < levelCount; level++) {
+				const uint32_t srcWidth = std::max(width >> (level - 1), 1u);
+				const uint32_t srcHeight = std::max(height >> (level - 1), 1u);
+				const uint32_t dstWidth = std::max(width >> level, 1u);
+				const uint32_t dstHeight = std::max(height >> level, 1u);
+				uint8_t* dst = src + size_t(srcWidth) * srcHeight * 4;
+				generateLevel(src, srcWidth, srcHeight, dst, dstWidth, dstHeight, filter, srgb, jobSystem);
+				src = dst;
+			}
+		}
+	}
+}
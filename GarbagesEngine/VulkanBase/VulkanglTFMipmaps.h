@@ -0,0 +1,38 @@
+/*
+ * CPU mip chain generation for glTF textures
+ *
+ * Downsamples RGBA8 images with a box or Kaiser windowed sinc filter, averaging color in linear space for sRGB encoded images,
+ * used for formats the device can't blit and for baking the mip chains of decoded images on worker threads
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vks
+{
+	class JobSystem;
+}
+
+namespace vkglTF
+{
+	namespace mipmaps
+	{
+		enum class Filter {
+			/** @brief Average of 2x2 texels, fast but smaller levels may alias */
+			Box,
+			/** @brief Kaiser windowed sinc over 8x8 texels, keeps smaller levels sharper at about four times the cost */
+			Kaiser
+		};
+
+		/** @brief Number of levels of a full mip chain down to 1x1 */
+		uint32_t getLevelCount(uint32_t width, uint32_t height);
+		/** @brief Size in bytes of a full RGBA8 mip chain, levels are tightly packed from the largest to the smallest */
+		size_t getChainSize(uint32_t width, uint32_t height);
+		void expandRgbToRgba(const uint8_t* rgb, uint8_t* rgba, size_t pixelCount);
+		void generateMipChain(uint8_t* chain, uint32_t width, uint32_t height, Filter filter = Filter::Box, bool srgb = false, vks::JobSystem* jobSystem = nullptr);
+	}
+}
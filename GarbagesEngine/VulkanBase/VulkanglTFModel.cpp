@@ -18,6 +18,35 @@
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 
 #include "VulkanglTFModel.h"
+#include "jobsystem.hpp"
+#include "frustum.hpp"
+#include "VulkanglTFOptimizer.h"
+#include "VulkanglTFMipmaps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <unordered_map>
+#include <glm/gtc/packing.hpp>
+
+/*
+	Data decoded by loadData that still has to be uploaded to the GPU by uploadData
+*/
+struct vkglTF::Model::PendingUpload {
+	bool loadImages = true;
+	std::vector<tinygltf::Image> images;
+	/** @brief Encoded file data of images whose decoding was deferred by loadImageDataFunc, empty for images that don't need decoding */
+	std::vector<std::vector<unsigned char>> encodedImages;
+	// Vertex and index data either points into the vectors below or into the memory mapped mesh cache
+	std::vector<Vertex> vertexBuffer;
+	std::vector<PackedVertex> packedVertexBuffer;
+	std::vector<uint32_t> indexBuffer;
+	vks::tools::MappedFile cacheFile;
+	const void* vertexData = nullptr;
+	size_t vertexBufferSize = 0;
+	uint32_t vertexCount = 0;
+	const uint32_t* indexData = nullptr;
+	uint32_t indexCount = 0;
+};
 
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutImage = VK_NULL_HANDLE;
 VkDescriptorSetLayout vkglTF::descriptorSetLayoutUbo = VK_NULL_HANDLE;
@@ -26,6 +55,7 @@ uint32_t vkglTF::descriptorBindingFlags = vkglTF::DescriptorBindingFlags::ImageB
 
 /*
 	We use a custom image loading function with tinyglTF, so we can do custom stuff loading ktx textures
+	If userData points to a list of encoded images, decoding is deferred so all images of a model can be decoded in parallel later on
 */
 bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string* error, std::string* warning, int req_width, int req_height, const unsigned char* bytes, int size, void* userData)
 {
@@ -36,6 +66,16 @@ bool loadImageDataFunc(tinygltf::Image* image, const int imageIndex, std::string
 		}
 	}
 
+	if (userData) {
+		// The encoded data is only valid during this call
+		std::vector<std::vector<unsigned char>>& encodedImages = *static_cast<std::vector<std::vector<unsigned char>>*>(userData);
+		if (encodedImages.size() <= static_cast<size_t>(imageIndex)) {
+			encodedImages.resize(imageIndex + 1);
+		}
+		encodedImages[imageIndex].assign(bytes, bytes + size);
+		return true;
+	}
+
 	return tinygltf::LoadImageData(image, imageIndex, error, warning, req_width, req_height, bytes, size, userData);
 }
 
@@ -63,12 +103,29 @@ void vkglTF::Texture::destroy()
 	{
 		vkDestroyImageView(device->logicalDevice, view, nullptr);
 		vkDestroyImage(device->logicalDevice, image, nullptr);
-		vkFreeMemory(device->logicalDevice, deviceMemory, nullptr);
+		device->freeMemory(deviceMemory, allocation);
+		allocation = VK_NULL_HANDLE;
 		vkDestroySampler(device->logicalDevice, sampler, nullptr);
 	}
 }
 
 void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, VkQueue copyQueue)
+{
+	vks::UploadBatch uploadBatch(device, copyQueue, 0);
+	fromglTfImage(gltfimage, path, device, uploadBatch);
+	uploadBatch.flush();
+}
+
+/**
+* Create the texture for a glTF image and record its upload (and mip chain generation) into an upload batch
+*
+* @param gltfimage Decoded glTF image or reference to an external ktx file
+* @param path Directory of the glTF file, used to resolve external files
+* @param device Vulkan device to create the texture on
+* @param uploadBatch Batch the copies are recorded to, the texture can be used once the batch has completed
+* @param (Optional) jobSystem Job system a mip chain generated on the CPU is distributed over, must have been created by the calling thread
+*/
+void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path, vks::VulkanDevice *device, vks::UploadBatch &uploadBatch, vks::JobSystem* jobSystem)
 {
 	this->device = device;
 
@@ -84,66 +141,41 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 
 	if (!isKtx) {
 		// Texture was loaded using STB_Image
-
-		unsigned char* buffer = nullptr;
-		VkDeviceSize bufferSize = 0;
-		bool deleteBuffer = false;
-		if (gltfimage.component == 3) {
-			// Most devices don't support RGB only on Vulkan so convert if necessary
-			// TODO: Check actual format support and transform only if required
-			bufferSize = gltfimage.width * gltfimage.height * 4;
-			buffer = new unsigned char[bufferSize];
-			unsigned char* rgba = buffer;
-			unsigned char* rgb = &gltfimage.image[0];
-			for (size_t i = 0; i < gltfimage.width * gltfimage.height; ++i) {
-				for (int32_t j = 0; j < 3; ++j) {
-					rgba[j] = rgb[j];
-				}
-				rgba += 4;
-				rgb += 3;
-			}
-			deleteBuffer = true;
-		}
-		else {
-			buffer = &gltfimage.image[0];
-			bufferSize = gltfimage.image.size();
-		}
-
 		format = VK_FORMAT_R8G8B8A8_UNORM;
 
-		VkFormatProperties formatProperties;
-
 		width = gltfimage.width;
 		height = gltfimage.height;
 		mipLevels = static_cast<uint32_t>(floor(log2(std::max(width, height))) + 1.0);
 
+		// The mip chain is generated on the CPU if it has been baked while decoding or if the device can't blit the format
+		VkFormatProperties formatProperties;
 		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
-		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT);
-		assert(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
-
-		VkMemoryAllocateInfo memAllocInfo{};
-		memAllocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-		VkMemoryRequirements memReqs{};
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo{};
-		bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferCreateInfo.size = bufferSize;
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, buffer, bufferSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
+		const VkFormatFeatureFlags blitFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+		const bool hasMipChain = (mipLevels > 1) && (gltfimage.component == 4) && (gltfimage.image.size() == vkglTF::mipmaps::getChainSize(width, height));
+		const bool cpuMipChain = hasMipChain || ((formatProperties.optimalTilingFeatures & blitFeatures) != blitFeatures);
+		const VkDeviceSize levelSize = VkDeviceSize(width) * height * 4;
+
+		// Most devices don't support RGB only on Vulkan so RGB images are expanded while being written to staging memory
+		// TODO: Check actual format support and transform only if required
+		VkDeviceSize bufferSize = cpuMipChain ? vkglTF::mipmaps::getChainSize(width, height) : levelSize;
+		vks::UploadBatch::StagingRegion staging = uploadBatch.allocateStaging(bufferSize);
+		if (hasMipChain) {
+			memcpy(staging.data, gltfimage.image.data(), bufferSize);
+		} else {
+			// Staging memory may be write combined, so the chain is generated in regular memory
+			std::vector<unsigned char> chain(cpuMipChain ? bufferSize : 0);
+			unsigned char* level0 = cpuMipChain ? chain.data() : static_cast<unsigned char*>(staging.data);
+			if (gltfimage.component == 3) {
+				vkglTF::mipmaps::expandRgbToRgba(gltfimage.image.data(), level0, size_t(width) * height);
+			} else {
+				memcpy(level0, gltfimage.image.data(), levelSize);
+			}
+			if (cpuMipChain) {
+				// The format is unknown to the texture, so it is filtered as linear data
+				vkglTF::mipmaps::generateMipChain(chain.data(), width, height, vkglTF::mipmaps::Filter::Box, false, jobSystem);
+				memcpy(staging.data, chain.data(), bufferSize);
+			}
+		}
 
 		VkImageCreateInfo imageCreateInfo{};
 		imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -159,17 +191,14 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.extent = { width, height, 1 };
 		imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory, &allocation));
 
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+		// Copy and mip chain generation are recorded into the same command buffer, the barriers order them on the GPU
+		VkCommandBuffer copyCmd = uploadBatch.getCommandBuffer();
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		subresourceRange.levelCount = 1;
+		subresourceRange.levelCount = cpuMipChain ? mipLevels : 1;
 		subresourceRange.layerCount = 1;
 
 		VkImageMemoryBarrier imageMemoryBarrier{};
@@ -183,100 +212,109 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageMemoryBarrier.subresourceRange = subresourceRange;
 		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
 
-		VkBufferImageCopy bufferCopyRegion = {};
-		bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-		bufferCopyRegion.imageSubresource.mipLevel = 0;
-		bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
-		bufferCopyRegion.imageSubresource.layerCount = 1;
-		bufferCopyRegion.imageExtent.width = width;
-		bufferCopyRegion.imageExtent.height = height;
-		bufferCopyRegion.imageExtent.depth = 1;
-
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.image = image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-  		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-
-		device->flushCommandBuffer(copyCmd, copyQueue, true);
-
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-
-		// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
-		VkCommandBuffer blitCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		for (uint32_t i = 1; i < mipLevels; i++) {
-			VkImageBlit imageBlit{};
-
-			imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.srcSubresource.layerCount = 1;
-			imageBlit.srcSubresource.mipLevel = i - 1;
-			imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
-			imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
-			imageBlit.srcOffsets[1].z = 1;
-
-			imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			imageBlit.dstSubresource.layerCount = 1;
-			imageBlit.dstSubresource.mipLevel = i;
-			imageBlit.dstOffsets[1].x = int32_t(width >> i);
-			imageBlit.dstOffsets[1].y = int32_t(height >> i);
-			imageBlit.dstOffsets[1].z = 1;
-
-			VkImageSubresourceRange mipSubRange = {};
-			mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-			mipSubRange.baseMipLevel = i;
-			mipSubRange.levelCount = 1;
-			mipSubRange.layerCount = 1;
+		// A CPU generated chain is uploaded with a single copy of all levels
+		std::vector<VkBufferImageCopy> bufferCopyRegions;
+		VkDeviceSize levelOffset = staging.offset;
+		for (uint32_t i = 0; i < subresourceRange.levelCount; i++) {
+			VkBufferImageCopy bufferCopyRegion = {};
+			bufferCopyRegion.bufferOffset = levelOffset;
+			bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			bufferCopyRegion.imageSubresource.mipLevel = i;
+			bufferCopyRegion.imageSubresource.baseArrayLayer = 0;
+			bufferCopyRegion.imageSubresource.layerCount = 1;
+			bufferCopyRegion.imageExtent.width = std::max(width >> i, 1u);
+			bufferCopyRegion.imageExtent.height = std::max(height >> i, 1u);
+			bufferCopyRegion.imageExtent.depth = 1;
+			bufferCopyRegions.push_back(bufferCopyRegion);
+			levelOffset += VkDeviceSize(bufferCopyRegion.imageExtent.width) * bufferCopyRegion.imageExtent.height * 4;
+		}
 
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = 0;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
+		vkCmdCopyBufferToImage(copyCmd, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
 
-			vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
+		if (cpuMipChain) {
+			subresourceRange.levelCount = mipLevels;
+			imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-			{
-				VkImageMemoryBarrier imageMemoryBarrier{};
-				imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-				imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-				imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-				imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-				imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-				imageMemoryBarrier.image = image;
-				imageMemoryBarrier.subresourceRange = mipSubRange;
-				vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
-			}
-		}
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		} else {
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+	  		vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+
+			// Generate the mip chain (glTF uses jpg and png, so we need to create this manually)
+			VkCommandBuffer blitCmd = copyCmd;
+			for (uint32_t i = 1; i < mipLevels; i++) {
+				VkImageBlit imageBlit{};
+
+				imageBlit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageBlit.srcSubresource.layerCount = 1;
+				imageBlit.srcSubresource.mipLevel = i - 1;
+				imageBlit.srcOffsets[1].x = int32_t(width >> (i - 1));
+				imageBlit.srcOffsets[1].y = int32_t(height >> (i - 1));
+				imageBlit.srcOffsets[1].z = 1;
+
+				imageBlit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				imageBlit.dstSubresource.layerCount = 1;
+				imageBlit.dstSubresource.mipLevel = i;
+				imageBlit.dstOffsets[1].x = int32_t(width >> i);
+				imageBlit.dstOffsets[1].y = int32_t(height >> i);
+				imageBlit.dstOffsets[1].z = 1;
+
+				VkImageSubresourceRange mipSubRange = {};
+				mipSubRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+				mipSubRange.baseMipLevel = i;
+				mipSubRange.levelCount = 1;
+				mipSubRange.layerCount = 1;
 
-		subresourceRange.levelCount = mipLevels;
-		imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+				{
+					VkImageMemoryBarrier imageMemoryBarrier{};
+					imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+					imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+					imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+					imageMemoryBarrier.srcAccessMask = 0;
+					imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					imageMemoryBarrier.image = image;
+					imageMemoryBarrier.subresourceRange = mipSubRange;
+					vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+				}
 
-		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-		imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-		imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-		imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-		imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-		imageMemoryBarrier.image = image;
-		imageMemoryBarrier.subresourceRange = subresourceRange;
-		vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+				vkCmdBlitImage(blitCmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageBlit, VK_FILTER_LINEAR);
 
-        if (deleteBuffer) {
-            delete[] buffer;
-        }
+				{
+					VkImageMemoryBarrier imageMemoryBarrier{};
+					imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+					imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+					imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+					imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+					imageMemoryBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+					imageMemoryBarrier.image = image;
+					imageMemoryBarrier.subresourceRange = mipSubRange;
+					vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+				}
+			}
 
-		device->flushCommandBuffer(blitCmd, copyQueue, true);
+			subresourceRange.levelCount = mipLevels;
+			imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+			imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+			imageMemoryBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+			imageMemoryBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			imageMemoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+			imageMemoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			imageMemoryBarrier.image = image;
+			imageMemoryBarrier.subresourceRange = subresourceRange;
+			vkCmdPipelineBarrier(blitCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+		}
 	}
 	else {
 		// Texture is stored in an external ktx file
@@ -319,30 +357,6 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		VkFormatProperties formatProperties;
 		vkGetPhysicalDeviceFormatProperties(device->physicalDevice, format, &formatProperties);
 
-		VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingMemory;
-
-		VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-		bufferCreateInfo.size = ktxTextureSize;
-		// This buffer is used as a transfer source for the buffer copy
-		bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-		bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-		VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-		VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-		VkMemoryRequirements memReqs;
-		vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-		VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-		uint8_t* data;
-		VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-		memcpy(data, ktxTextureData, ktxTextureSize);
-		vkUnmapMemory(device->logicalDevice, stagingMemory);
-
 		std::vector<VkBufferImageCopy> bufferCopyRegions;
 		for (uint32_t i = 0; i < mipLevels; i++)
 		{
@@ -375,11 +389,7 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 		VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &image));
 
-		vkGetImageMemoryRequirements(device->logicalDevice, image, &memReqs);
-		memAllocInfo.allocationSize = memReqs.size;
-		memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-		VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &deviceMemory));
-		VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, image, deviceMemory, 0));
+		VK_CHECK_RESULT(device->allocateImageMemory(image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceMemory, &allocation));
 
 		VkImageSubresourceRange subresourceRange = {};
 		subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -387,15 +397,9 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 		subresourceRange.levelCount = mipLevels;
 		subresourceRange.layerCount = 1;
 
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-		vkCmdCopyBufferToImage(copyCmd, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(bufferCopyRegions.size()), bufferCopyRegions.data());
-		vks::tools::setImageLayout(copyCmd, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-		device->flushCommandBuffer(copyCmd, copyQueue);
+		uploadBatch.copyToImage(image, ktxTextureData, ktxTextureSize, bufferCopyRegions, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 		this->imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-		vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-		vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-
 		ktxTexture_Destroy(ktxTexture);
 	}
 
@@ -431,6 +435,87 @@ void vkglTF::Texture::fromglTfImage(tinygltf::Image &gltfimage, std::string path
 	descriptor.imageLayout = imageLayout;
 }
 
+/*
+	glTF texture cache
+*/
+vkglTF::TextureCache::~TextureCache()
+{
+	if (statistics.referenceCount > 0) {
+		std::cerr << "Texture cache destroyed with " << statistics.referenceCount << " unreleased texture references" << std::endl;
+	}
+	for (auto& entry : entries) {
+		entry.second.texture.destroy();
+	}
+}
+
+/**
+* Get the texture for a key, creating it on the first request
+*
+* @param key Identifies the texture's source, e.g. a resolved file name or a hash of the image data
+* @param create Called to create the texture if the cache doesn't contain the key yet
+*
+* @return Copy of the cached texture, which needs to be handed back to release instead of being destroyed
+* @note Creation may only record uploads, the texture can be handed out to other models before these have been submitted
+*/
+vkglTF::Texture vkglTF::TextureCache::acquire(const std::string& key, const std::function<void(Texture&)>& create)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	statistics.referenceCount++;
+	auto it = entries.find(key);
+	if (it != entries.end()) {
+		statistics.hits++;
+		it->second.references++;
+		return it->second.texture;
+	}
+	statistics.misses++;
+	statistics.textureCount++;
+	Entry& entry = entries[key];
+	entry.references = 1;
+	create(entry.texture);
+	assert(entry.texture.device == device);
+	keys[entry.texture.image] = key;
+	return entry.texture;
+}
+
+/** @brief Takes a reference to an already cached texture, so its source doesn't need to be decoded if it is cached */
+bool vkglTF::TextureCache::tryAcquire(const std::string& key, Texture& texture)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto it = entries.find(key);
+	if (it == entries.end()) {
+		return false;
+	}
+	statistics.hits++;
+	statistics.referenceCount++;
+	it->second.references++;
+	texture = it->second.texture;
+	return true;
+}
+
+/** @brief Drops a reference returned by acquire or tryAcquire, the texture is destroyed with its last reference */
+void vkglTF::TextureCache::release(const Texture& texture)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	auto key = keys.find(texture.image);
+	if (key == keys.end()) {
+		return;
+	}
+	auto it = entries.find(key->second);
+	statistics.referenceCount--;
+	if (--it->second.references == 0) {
+		it->second.texture.destroy();
+		entries.erase(it);
+		keys.erase(key);
+		statistics.textureCount--;
+	}
+}
+
+vkglTF::TextureCache::Statistics vkglTF::TextureCache::getStatistics()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return statistics;
+}
+
 /*
 	glTF material
 */
@@ -481,32 +566,33 @@ void vkglTF::Primitive::setDimensions(glm::vec3 min, glm::vec3 max) {
 	dimensions.radius = glm::distance(min, max) / 2.0f;
 }
 
+/**
+* Select the coarsest level of detail whose error stays below a screen space threshold
+*
+* @param pixelsPerUnit Size of one local unit of the primitive on screen in pixels
+* @param maxPixelError Largest acceptable deviation from the full detail surface in pixels
+*
+* @return 0 for the full detail primitive, otherwise the level stored at lods[level - 1]
+*/
+uint32_t vkglTF::Primitive::selectLod(float pixelsPerUnit, float maxPixelError) const
+{
+	uint32_t level = 0;
+	// Errors grow with each level, so the first one that is too coarse ends the search
+	while ((level < lods.size()) && (lods[level].error * pixelsPerUnit <= maxPixelError)) {
+		level++;
+	}
+	return level;
+}
+
 /*
 	glTF mesh
 */
+// The uniform buffer range is assigned by the model once all meshes are known (see Model::createNodeBuffer)
 vkglTF::Mesh::Mesh(vks::VulkanDevice *device, glm::mat4 matrix) {
 	this->device = device;
 	this->uniformBlock.matrix = matrix;
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		sizeof(uniformBlock),
-		&uniformBuffer.buffer,
-		&uniformBuffer.memory,
-		&uniformBlock));
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, uniformBuffer.memory, 0, sizeof(uniformBlock), 0, &uniformBuffer.mapped));
-	uniformBuffer.descriptor = { uniformBuffer.buffer, 0, sizeof(uniformBlock) };
 };
 
-vkglTF::Mesh::~Mesh() {
-	vkDestroyBuffer(device->logicalDevice, uniformBuffer.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, uniformBuffer.memory, nullptr);
-    for(auto primitive : primitives)
-    {
-        delete primitive;
-    }
-}
-
 /*
 	glTF node
 */
@@ -515,6 +601,9 @@ glm::mat4 vkglTF::Node::localMatrix() {
 }
 
 glm::mat4 vkglTF::Node::getMatrix() {
+	if (transforms) {
+		return transforms->getWorldMatrix(transformIndex);
+	}
 	glm::mat4 m = localMatrix();
 	vkglTF::Node *p = parent;
 	while (p) {
@@ -524,26 +613,31 @@ glm::mat4 vkglTF::Node::getMatrix() {
 	return m;
 }
 
-void vkglTF::Node::update() {
-	if (mesh) {
-		glm::mat4 m = getMatrix();
-		if (skin) {
-			mesh->uniformBlock.matrix = m;
-			// Update join matrices
-			glm::mat4 inverseTransform = glm::inverse(m);
-			for (size_t i = 0; i < skin->joints.size(); i++) {
-				vkglTF::Node *jointNode = skin->joints[i];
-				glm::mat4 jointMat = jointNode->getMatrix() * skin->inverseBindMatrices[i];
-				jointMat = inverseTransform * jointMat;
-				mesh->uniformBlock.jointMatrix[i] = jointMat;
-			}
-			mesh->uniformBlock.jointcount = (float)skin->joints.size();
-			memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
-		} else {
-			memcpy(mesh->uniformBuffer.mapped, &m, sizeof(glm::mat4));
-		}
+void vkglTF::Node::markDirty() {
+	if (transforms) {
+		transforms->setLocal(transformIndex, translation, rotation, scale, matrix);
+	}
+}
+
+/**
+* Write the node's world matrix to the mesh's uniform buffer and the joint matrices of its skin to the model's joint buffer
+*/
+void vkglTF::Node::updateUniformBuffer() {
+	if (!mesh) {
+		return;
+	}
+	mesh->uniformBlock.matrix = getMatrix();
+	if (skin && mesh->jointMatrices && transforms) {
+		const glm::mat4 inverseTransform = glm::inverse(mesh->uniformBlock.matrix);
+		transforms->computeJointMatrices(inverseTransform, skin->jointTransformIndices.data(), skin->inverseBindMatrices.data(), skin->jointTransformIndices.size(), mesh->jointMatrices);
+	}
+	if (mesh->uniformBuffer.mapped) {
+		memcpy(mesh->uniformBuffer.mapped, &mesh->uniformBlock, sizeof(mesh->uniformBlock));
 	}
+}
 
+void vkglTF::Node::update() {
+	updateUniformBuffer();
 	for (auto& child : children) {
 		child->update();
 	}
@@ -558,6 +652,258 @@ vkglTF::Node::~Node() {
 	}
 }
 
+/*
+	glTF animation sampler
+*/
+namespace
+{
+	// Range of the three smallest components of a unit quaternion
+	const float smallestThreeRange = 0.70710678f;
+
+	glm::vec4 interpolateLinear(const glm::vec4& v0, const glm::vec4& v1, float u, bool rotation)
+	{
+		if (rotation) {
+			const glm::quat q = glm::normalize(glm::slerp(glm::quat(v0.w, v0.x, v0.y, v0.z), glm::quat(v1.w, v1.x, v1.y, v1.z), u));
+			return glm::vec4(q.x, q.y, q.z, q.w);
+		}
+		return glm::mix(v0, v1, u);
+	}
+
+	// Largest component difference, quaternions q and -q describe the same rotation
+	float outputError(const glm::vec4& a, const glm::vec4& b, bool rotation)
+	{
+		const glm::vec4 d = (rotation && (glm::dot(a, b) < 0.0f)) ? a + b : a - b;
+		return std::max(std::max(std::abs(d.x), std::abs(d.y)), std::max(std::abs(d.z), std::abs(d.w)));
+	}
+
+	uint16_t quantize(float value, float min, float scale)
+	{
+		return (scale > 0.0f) ? static_cast<uint16_t>(std::min(std::max((value - min) / scale + 0.5f, 0.0f), 65535.0f)) : 0;
+	}
+}
+
+bool vkglTF::AnimationSampler::isValid() const {
+	const size_t valuesPerKey = (interpolation == CUBICSPLINE) ? 3 : 1;
+	return !inputs.empty() && (outputCount() >= inputs.size() * valuesPerKey);
+}
+
+size_t vkglTF::AnimationSampler::outputCount() const {
+	return compressed ? quantizedOutputs.size() / 3 : outputsVec4.size();
+}
+
+/** @brief Output value, decodes the quantized representation of compressed samplers */
+glm::vec4 vkglTF::AnimationSampler::getOutput(size_t index) const {
+	if (!compressed) {
+		return outputsVec4[index];
+	}
+	const uint16_t* packed = &quantizedOutputs[index * 3];
+	if (!quantizedRotation) {
+		return glm::vec4(quantizationMin + glm::vec3(packed[0], packed[1], packed[2]) * quantizationScale, 0.0f);
+	}
+	// Smallest three: 15 bits per component, the index of the omitted largest component is stored in the top bits of the first two values
+	static const uint8_t componentOrder[4][3] = { { 1, 2, 3 }, { 0, 2, 3 }, { 0, 1, 3 }, { 0, 1, 2 } };
+	const uint32_t largest = (packed[0] >> 15) | ((packed[1] >> 15) << 1);
+	const float scale = 2.0f * smallestThreeRange / 32767.0f;
+	const float a = static_cast<float>(packed[0] & 0x7FFF) * scale - smallestThreeRange;
+	const float b = static_cast<float>(packed[1] & 0x7FFF) * scale - smallestThreeRange;
+	const float c = static_cast<float>(packed[2] & 0x7FFF) * scale - smallestThreeRange;
+	glm::vec4 q;
+	q[componentOrder[largest][0]] = a;
+	q[componentOrder[largest][1]] = b;
+	q[componentOrder[largest][2]] = c;
+	q[largest] = std::sqrt(std::max(0.0f, 1.0f - (a * a + b * b + c * c)));
+	return q;
+}
+
+/**
+* Find the key interval containing a point in time
+*
+* @param time Time inside [inputs.front(), inputs.back()), requires at least two keys
+* @param cursor Interval found by the previous call, checked (along with the next one) before falling back to a binary search
+*
+* @return Index of the key starting the interval, also stored in cursor
+*/
+uint32_t vkglTF::AnimationSampler::findKey(float time, uint32_t& cursor) const {
+	const uint32_t lastInterval = static_cast<uint32_t>(inputs.size()) - 2;
+	uint32_t key = std::min(cursor, lastInterval);
+	if (time >= inputs[key]) {
+		if (time < inputs[key + 1]) {
+			cursor = key;
+			return key;
+		}
+		if ((key < lastInterval) && (time < inputs[key + 2])) {
+			cursor = key + 1;
+			return key + 1;
+		}
+	}
+	// Seek or large time step
+	const auto upper = std::upper_bound(inputs.begin(), inputs.end(), time);
+	key = static_cast<uint32_t>(std::max<std::ptrdiff_t>(upper - inputs.begin() - 1, 0));
+	cursor = std::min(key, lastInterval);
+	return cursor;
+}
+
+/**
+* Sample the animation curve at a point in time, times outside of the keys are clamped to the first or last key
+*
+* @param time Time to sample at
+* @param cursor Cached key interval of the channel, see findKey
+* @param rotation Values are quaternions (xyzw) that are interpolated spherically and normalized
+* @param value Sampled value
+*
+* @return False if the sampler doesn't have enough outputs for its keys
+*/
+bool vkglTF::AnimationSampler::sample(float time, uint32_t& cursor, bool rotation, glm::vec4& value) const {
+	if (!isValid()) {
+		return false;
+	}
+	const bool cubic = (interpolation == CUBICSPLINE);
+	// Cubic spline samplers store in-tangent, value and out-tangent per key
+	const size_t stride = cubic ? 3 : 1;
+	const size_t offset = cubic ? 1 : 0;
+	const size_t keyCount = inputs.size();
+	if ((keyCount == 1) || (time <= inputs.front())) {
+		cursor = 0;
+		value = getOutput(offset);
+		return true;
+	}
+	if (time >= inputs.back()) {
+		cursor = static_cast<uint32_t>(keyCount) - 2;
+		value = getOutput((keyCount - 1) * stride + offset);
+		return true;
+	}
+
+	const uint32_t key = findKey(time, cursor);
+	const glm::vec4 v0 = getOutput(key * stride + offset);
+	const glm::vec4 v1 = getOutput((key + 1) * stride + offset);
+	const float delta = inputs[key + 1] - inputs[key];
+	const float u = (time - inputs[key]) / delta;
+
+	switch (interpolation) {
+	case STEP:
+		value = v0;
+		break;
+	case CUBICSPLINE: {
+		// Hermite spline, tangents are scaled by the length of the key interval (see glTF spec appendix C)
+		const glm::vec4 outTangent = getOutput(key * stride + 2) * delta;
+		const glm::vec4 inTangent = getOutput((key + 1) * stride) * delta;
+		const float u2 = u * u;
+		const float u3 = u2 * u;
+		value = (2.0f * u3 - 3.0f * u2 + 1.0f) * v0 + (u3 - 2.0f * u2 + u) * outTangent + (-2.0f * u3 + 3.0f * u2) * v1 + (u3 - u2) * inTangent;
+		if (rotation) {
+			value = glm::normalize(value);
+		}
+		break;
+	}
+	default:
+		value = interpolateLinear(v0, v1, u, rotation);
+		break;
+	}
+	return true;
+}
+
+/**
+* Compress the sampler's keys, cubic spline samplers are left untouched
+* Keys that can be reconstructed from their neighbours within the tolerance are removed, the remaining outputs are quantized to 16 bits per component
+* (smallest three for rotations, range quantization for translations and scales)
+*
+* @param rotation Outputs are quaternions
+* @param tolerance Maximum error of any output component introduced by removing keys
+*/
+void vkglTF::AnimationSampler::compress(bool rotation, float tolerance) {
+	if (compressed || (interpolation == CUBICSPLINE) || !isValid()) {
+		return;
+	}
+	const size_t keyCount = inputs.size();
+	// Keys are dropped greedily, a key is kept once skipping it would move one of the keys since the last kept key out of tolerance
+	// The span between two kept keys is limited to keep the cost linear for long constant sections
+	const size_t maxSpan = 256;
+	std::vector<size_t> keptKeys = { 0 };
+	for (size_t key = 1; key + 1 < keyCount; key++) {
+		const size_t anchor = keptKeys.back();
+		const size_t next = key + 1;
+		bool removable = (next - anchor) <= maxSpan;
+		for (size_t i = anchor + 1; removable && (i <= key); i++) {
+			glm::vec4 reconstructed = outputsVec4[anchor];
+			if (interpolation == LINEAR) {
+				const float u = (inputs[i] - inputs[anchor]) / (inputs[next] - inputs[anchor]);
+				reconstructed = interpolateLinear(outputsVec4[anchor], outputsVec4[next], u, rotation);
+			}
+			removable = outputError(reconstructed, outputsVec4[i], rotation) <= tolerance;
+		}
+		if (!removable) {
+			keptKeys.push_back(key);
+		}
+	}
+	if (keyCount > 1) {
+		keptKeys.push_back(keyCount - 1);
+	}
+
+	std::vector<float> keptInputs;
+	std::vector<glm::vec4> keptOutputs;
+	for (size_t key : keptKeys) {
+		keptInputs.push_back(inputs[key]);
+		keptOutputs.push_back(outputsVec4[key]);
+	}
+
+	quantizedOutputs.resize(keptOutputs.size() * 3);
+	quantizedRotation = rotation;
+	if (rotation) {
+		const float scale = 32767.0f / (2.0f * smallestThreeRange);
+		for (size_t i = 0; i < keptOutputs.size(); i++) {
+			glm::vec4 q = glm::normalize(keptOutputs[i]);
+			uint32_t largest = 0;
+			for (uint32_t c = 1; c < 4; c++) {
+				if (std::abs(q[c]) > std::abs(q[largest])) {
+					largest = c;
+				}
+			}
+			// The largest component is reconstructed as a positive value, so flip the quaternion if needed
+			if (q[largest] < 0.0f) {
+				q = -q;
+			}
+			uint16_t* packed = &quantizedOutputs[i * 3];
+			for (uint32_t c = 0, j = 0; c < 4; c++) {
+				if (c != largest) {
+					packed[j++] = static_cast<uint16_t>(std::min(std::max((q[c] + smallestThreeRange) * scale + 0.5f, 0.0f), 32767.0f));
+				}
+			}
+			packed[0] |= static_cast<uint16_t>((largest & 1) << 15);
+			packed[1] |= static_cast<uint16_t>((largest >> 1) << 15);
+		}
+	} else {
+		glm::vec3 min(std::numeric_limits<float>::max());
+		glm::vec3 max(-std::numeric_limits<float>::max());
+		for (const glm::vec4& output : keptOutputs) {
+			min = glm::min(min, glm::vec3(output));
+			max = glm::max(max, glm::vec3(output));
+		}
+		quantizationMin = min;
+		quantizationScale = (max - min) / 65535.0f;
+		for (size_t i = 0; i < keptOutputs.size(); i++) {
+			for (uint32_t c = 0; c < 3; c++) {
+				quantizedOutputs[i * 3 + c] = quantize(keptOutputs[i][c], quantizationMin[c], quantizationScale[c]);
+			}
+		}
+	}
+
+	inputs.swap(keptInputs);
+	std::vector<glm::vec4>().swap(outputsVec4);
+	compressed = true;
+}
+
+size_t vkglTF::AnimationSampler::memorySize() const {
+	return inputs.size() * sizeof(float) + outputsVec4.size() * sizeof(glm::vec4) + quantizedOutputs.size() * sizeof(uint16_t);
+}
+
+size_t vkglTF::Animation::memorySize() const {
+	size_t size = 0;
+	for (const AnimationSampler& sampler : samplers) {
+		size += sampler.memorySize();
+	}
+	return size;
+}
+
 /*
 	glTF default vertex layout with easy Vulkan mapping functions
 */
@@ -613,6 +959,81 @@ VkPipelineVertexInputStateCreateInfo* vkglTF::Vertex::getPipelineVertexInputStat
 	return &pipelineVertexInputStateCreateInfo;
 }
 
+VkVertexInputBindingDescription vkglTF::PackedVertex::vertexInputBindingDescription;
+std::vector<VkVertexInputAttributeDescription> vkglTF::PackedVertex::vertexInputAttributeDescriptions;
+VkPipelineVertexInputStateCreateInfo vkglTF::PackedVertex::pipelineVertexInputStateCreateInfo;
+
+vkglTF::PackedVertex vkglTF::PackedVertex::pack(const Vertex& vertex) {
+	PackedVertex packed{};
+	packed.pos = vertex.pos;
+	packed.normal = glm::packSnorm<int16_t>(glm::vec4(vertex.normal, 0.0f));
+	packed.uv = glm::packHalf(vertex.uv);
+	packed.color = glm::packUnorm<uint8_t>(vertex.color);
+	packed.joint0 = glm::u16vec4(vertex.joint0);
+	packed.weight0 = glm::packUnorm<uint16_t>(vertex.weight0);
+	packed.tangent = glm::packSnorm<int16_t>(vertex.tangent);
+	return packed;
+}
+
+VkVertexInputBindingDescription vkglTF::PackedVertex::inputBindingDescription(uint32_t binding) {
+	return VkVertexInputBindingDescription({ binding, sizeof(PackedVertex), VK_VERTEX_INPUT_RATE_VERTEX });
+}
+
+VkVertexInputAttributeDescription vkglTF::PackedVertex::inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component) {
+	switch (component) {
+		case VertexComponent::Position:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R32G32B32_SFLOAT, offsetof(PackedVertex, pos) });
+		case VertexComponent::Normal:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, normal) });
+		case VertexComponent::UV:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R16G16_SFLOAT, offsetof(PackedVertex, uv) });
+		case VertexComponent::Color:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R8G8B8A8_UNORM, offsetof(PackedVertex, color) });
+		case VertexComponent::Tangent:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R16G16B16A16_SNORM, offsetof(PackedVertex, tangent) });
+		case VertexComponent::Joint0:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R16G16B16A16_UINT, offsetof(PackedVertex, joint0) });
+		case VertexComponent::Weight0:
+			return VkVertexInputAttributeDescription({ location, binding, VK_FORMAT_R16G16B16A16_UNORM, offsetof(PackedVertex, weight0) });
+		default:
+			return VkVertexInputAttributeDescription({});
+	}
+}
+
+std::vector<VkVertexInputAttributeDescription> vkglTF::PackedVertex::inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components) {
+	std::vector<VkVertexInputAttributeDescription> result;
+	uint32_t location = 0;
+	for (VertexComponent component : components) {
+		result.push_back(PackedVertex::inputAttributeDescription(binding, location, component));
+		location++;
+	}
+	return result;
+}
+
+/** @brief Returns the pipeline vertex input state create info structure for the requested vertex components of a packed model */
+VkPipelineVertexInputStateCreateInfo* vkglTF::PackedVertex::getPipelineVertexInputState(const std::vector<VertexComponent> components) {
+	vertexInputBindingDescription = PackedVertex::inputBindingDescription(0);
+	PackedVertex::vertexInputAttributeDescriptions = PackedVertex::inputAttributeDescriptions(0, components);
+	pipelineVertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+	pipelineVertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+	pipelineVertexInputStateCreateInfo.pVertexBindingDescriptions = &PackedVertex::vertexInputBindingDescription;
+	pipelineVertexInputStateCreateInfo.vertexAttributeDescriptionCount = static_cast<uint32_t>(PackedVertex::vertexInputAttributeDescriptions.size());
+	pipelineVertexInputStateCreateInfo.pVertexAttributeDescriptions = PackedVertex::vertexInputAttributeDescriptions.data();
+	return &pipelineVertexInputStateCreateInfo;
+}
+
+VkVertexInputBindingDescription vkglTF::InstanceData::inputBindingDescription(uint32_t binding) {
+	return VkVertexInputBindingDescription({ binding, sizeof(InstanceData), VK_VERTEX_INPUT_RATE_INSTANCE });
+}
+
+std::vector<VkVertexInputAttributeDescription> vkglTF::InstanceData::inputAttributeDescriptions(uint32_t binding, uint32_t location) {
+	std::vector<VkVertexInputAttributeDescription> result;
+	for (uint32_t i = 0; i < 4; i++) {
+		result.push_back({ location + i, binding, VK_FORMAT_R32G32B32A32_SFLOAT, static_cast<uint32_t>(i * sizeof(glm::vec4)) });
+	}
+	return result;
+}
+
 vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
 {
 
@@ -622,7 +1043,7 @@ vkglTF::Texture* vkglTF::Model::getTexture(uint32_t index)
 	return nullptr;
 }
 
-void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
+void vkglTF::Model::createEmptyTexture(vks::UploadBatch& uploadBatch)
 {
 	emptyTexture.device = device;
 	emptyTexture.width = 1;
@@ -631,31 +1052,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	emptyTexture.mipLevels = 1;
 
 	size_t bufferSize = emptyTexture.width * emptyTexture.height * 4;
-	unsigned char* buffer = new unsigned char[bufferSize];
-	memset(buffer, 0, bufferSize);
-
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingMemory;
-	VkBufferCreateInfo bufferCreateInfo = vks::initializers::bufferCreateInfo();
-	bufferCreateInfo.size = bufferSize;
-	// This buffer is used as a transfer source for the buffer copy
-	bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-	bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-	VK_CHECK_RESULT(vkCreateBuffer(device->logicalDevice, &bufferCreateInfo, nullptr, &stagingBuffer));
-
-	VkMemoryAllocateInfo memAllocInfo = vks::initializers::memoryAllocateInfo();
-	VkMemoryRequirements memReqs;
-	vkGetBufferMemoryRequirements(device->logicalDevice, stagingBuffer, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &stagingMemory));
-	VK_CHECK_RESULT(vkBindBufferMemory(device->logicalDevice, stagingBuffer, stagingMemory, 0));
-
-	// Copy texture data into staging buffer
-	uint8_t* data;
-	VK_CHECK_RESULT(vkMapMemory(device->logicalDevice, stagingMemory, 0, memReqs.size, 0, (void**)&data));
-	memcpy(data, buffer, bufferSize);
-	vkUnmapMemory(device->logicalDevice, stagingMemory);
+	std::vector<unsigned char> buffer(bufferSize, 0);
 
 	VkBufferImageCopy bufferCopyRegion = {};
 	bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -678,11 +1075,7 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	imageCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
 	VK_CHECK_RESULT(vkCreateImage(device->logicalDevice, &imageCreateInfo, nullptr, &emptyTexture.image));
 
-	vkGetImageMemoryRequirements(device->logicalDevice, emptyTexture.image, &memReqs);
-	memAllocInfo.allocationSize = memReqs.size;
-	memAllocInfo.memoryTypeIndex = device->getMemoryType(memReqs.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-	VK_CHECK_RESULT(vkAllocateMemory(device->logicalDevice, &memAllocInfo, nullptr, &emptyTexture.deviceMemory));
-	VK_CHECK_RESULT(vkBindImageMemory(device->logicalDevice, emptyTexture.image, emptyTexture.deviceMemory, 0));
+	VK_CHECK_RESULT(device->allocateImageMemory(emptyTexture.image, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &emptyTexture.deviceMemory, &emptyTexture.allocation));
 
 	VkImageSubresourceRange subresourceRange{};
 	subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -690,17 +1083,9 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 	subresourceRange.levelCount = 1;
 	subresourceRange.layerCount = 1;
 
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
-	vkCmdCopyBufferToImage(copyCmd, stagingBuffer, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &bufferCopyRegion);
-	vks::tools::setImageLayout(copyCmd, emptyTexture.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, subresourceRange);
-	device->flushCommandBuffer(copyCmd, transferQueue);
+	uploadBatch.copyToImage(emptyTexture.image, buffer.data(), bufferSize, { bufferCopyRegion }, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
 	emptyTexture.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-	// Clean up staging resources
-	vkDestroyBuffer(device->logicalDevice, stagingBuffer, nullptr);
-	vkFreeMemory(device->logicalDevice, stagingMemory, nullptr);
-
 	VkSamplerCreateInfo samplerCreateInfo = vks::initializers::samplerCreateInfo();
 	samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
 	samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
@@ -730,12 +1115,25 @@ void vkglTF::Model::createEmptyTexture(VkQueue transferQueue)
 */
 vkglTF::Model::~Model()
 {
+	if (pendingLoad.valid()) {
+		pendingLoad.wait();
+	}
 	vkDestroyBuffer(device->logicalDevice, vertices.buffer, nullptr);
 	vkFreeMemory(device->logicalDevice, vertices.memory, nullptr);
 	vkDestroyBuffer(device->logicalDevice, indices.buffer, nullptr);
 	vkFreeMemory(device->logicalDevice, indices.memory, nullptr);
+	vkDestroyBuffer(device->logicalDevice, instances.buffer, nullptr);
+	vkFreeMemory(device->logicalDevice, instances.memory, nullptr);
+	vkDestroyBuffer(device->logicalDevice, indirectDraws.buffer, nullptr);
+	vkFreeMemory(device->logicalDevice, indirectDraws.memory, nullptr);
+	vkDestroyBuffer(device->logicalDevice, meshletBuffer.buffer, nullptr);
+	vkFreeMemory(device->logicalDevice, meshletBuffer.memory, nullptr);
 	for (auto texture : textures) {
-		texture.destroy();
+		if (textureCache) {
+			textureCache->release(texture);
+		} else {
+			texture.destroy();
+		}
 	}
 	for (auto node : nodes) {
 		delete node;
@@ -743,6 +1141,13 @@ vkglTF::Model::~Model()
     for (auto skin : skins) {
         delete skin;
     }
+	for (auto& primitives : meshTable) {
+		for (auto primitive : primitives) {
+			delete primitive;
+		}
+	}
+	nodeBuffer.unmap();
+	nodeBuffer.destroy();
 	if (descriptorSetLayoutUbo != VK_NULL_HANDLE) {
 		vkDestroyDescriptorSetLayout(device->logicalDevice, descriptorSetLayoutUbo, nullptr);
 		descriptorSetLayoutUbo = VK_NULL_HANDLE;
@@ -755,7 +1160,7 @@ vkglTF::Model::~Model()
 	emptyTexture.destroy();
 }
 
-void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale)
+void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, uint32_t nodeIndex, const tinygltf::Model &model, float globalscale)
 {
 	vkglTF::Node *newNode = new Node{};
 	newNode->index = nodeIndex;
@@ -790,170 +1195,401 @@ void vkglTF::Model::loadNode(vkglTF::Node *parent, const tinygltf::Node &node, u
 	// Node with children
 	if (node.children.size() > 0) {
 		for (auto i = 0; i < node.children.size(); i++) {
-			loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, indexBuffer, vertexBuffer, globalscale);
+			loadNode(newNode, model.nodes[node.children[i]], node.children[i], model, globalscale);
 		}
 	}
 
 	// Node contains mesh data
 	if (node.mesh > -1) {
-		const tinygltf::Mesh mesh = model.meshes[node.mesh];
+		const tinygltf::Mesh &mesh = model.meshes[node.mesh];
 		Mesh *newMesh = new Mesh(device, newNode->matrix);
 		newMesh->name = mesh.name;
-		for (size_t j = 0; j < mesh.primitives.size(); j++) {
-			const tinygltf::Primitive &primitive = mesh.primitives[j];
-			if (primitive.indices < 0) {
-				continue;
+		// Nodes instancing a mesh that has already been loaded reference its primitives instead of decoding them again
+		if (!gltfMeshTableIndices.empty() && (gltfMeshTableIndices[node.mesh] > -1)) {
+			newMesh->meshIndex = static_cast<uint32_t>(gltfMeshTableIndices[node.mesh]);
+		} else {
+			newMesh->meshIndex = static_cast<uint32_t>(meshTable.size());
+			meshTable.push_back(loadMeshPrimitives(mesh, model));
+			if (!gltfMeshTableIndices.empty()) {
+				gltfMeshTableIndices[node.mesh] = static_cast<int32_t>(newMesh->meshIndex);
 			}
-			uint32_t indexStart = static_cast<uint32_t>(indexBuffer.size());
-			uint32_t vertexStart = static_cast<uint32_t>(vertexBuffer.size());
-			uint32_t indexCount = 0;
-			uint32_t vertexCount = 0;
-			glm::vec3 posMin{};
-			glm::vec3 posMax{};
-			bool hasSkin = false;
-			// Vertices
-			{
-				const float *bufferPos = nullptr;
-				const float *bufferNormals = nullptr;
-				const float *bufferTexCoords = nullptr;
-				const float* bufferColors = nullptr;
-				const float *bufferTangents = nullptr;
-				uint32_t numColorComponents;
-				const uint16_t *bufferJoints = nullptr;
-				const float *bufferWeights = nullptr;
-
-				// Position attribute is required
-				assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
-
-				const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
-				const tinygltf::BufferView &posView = model.bufferViews[posAccessor.bufferView];
-				bufferPos = reinterpret_cast<const float *>(&(model.buffers[posView.buffer].data[posAccessor.byteOffset + posView.byteOffset]));
-				posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
-				posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
-
-				if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-					const tinygltf::Accessor &normAccessor = model.accessors[primitive.attributes.find("NORMAL")->second];
-					const tinygltf::BufferView &normView = model.bufferViews[normAccessor.bufferView];
-					bufferNormals = reinterpret_cast<const float *>(&(model.buffers[normView.buffer].data[normAccessor.byteOffset + normView.byteOffset]));
-				}
+		}
+		newMesh->primitives = meshTable[newMesh->meshIndex];
+		newNode->mesh = newMesh;
 
-				if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("TEXCOORD_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferTexCoords = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
+		auto instancing = node.extensions.find("EXT_mesh_gpu_instancing");
+		if ((instancing != node.extensions.end()) && instancing->second.Has("attributes")) {
+			loadInstances(newNode, instancing->second.Get("attributes"), model);
+		}
+	}
+	if (parent) {
+		parent->children.push_back(newNode);
+	} else {
+		nodes.push_back(newNode);
+	}
+	linearNodes.push_back(newNode);
+}
 
-				if (primitive.attributes.find("COLOR_0") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor& colorAccessor = model.accessors[primitive.attributes.find("COLOR_0")->second];
-					const tinygltf::BufferView& colorView = model.bufferViews[colorAccessor.bufferView];
-					// Color buffer are either of type vec3 or vec4
-					numColorComponents = colorAccessor.type == TINYGLTF_PARAMETER_TYPE_FLOAT_VEC3 ? 3 : 4;
-					bufferColors = reinterpret_cast<const float*>(&(model.buffers[colorView.buffer].data[colorAccessor.byteOffset + colorView.byteOffset]));
-				}
+/**
+* Read the per-instance transforms of a node using EXT_mesh_gpu_instancing into instanceData
+*
+* @param node Node the instances belong to
+* @param attributes Attributes object of the node's extension, maps TRANSLATION, ROTATION and SCALE to accessors
+* @param model tinyglTF model the node belongs to
+*/
+void vkglTF::Model::loadInstances(Node* node, const tinygltf::Value& attributes, const tinygltf::Model& model)
+{
+	if (!attributes.IsObject()) {
+		return;
+	}
+	auto findAccessor = [&attributes, &model](const char* name) -> const tinygltf::Accessor* {
+		if (!attributes.Has(name)) {
+			return nullptr;
+		}
+		const int index = attributes.Get(name).GetNumberAsInt();
+		return ((index >= 0) && (index < static_cast<int>(model.accessors.size()))) ? &model.accessors[index] : nullptr;
+	};
+	const tinygltf::Accessor* accessors[3] = { findAccessor("TRANSLATION"), findAccessor("ROTATION"), findAccessor("SCALE") };
 
-				if (primitive.attributes.find("TANGENT") != primitive.attributes.end())
-				{
-					const tinygltf::Accessor &tangentAccessor = model.accessors[primitive.attributes.find("TANGENT")->second];
-					const tinygltf::BufferView &tangentView = model.bufferViews[tangentAccessor.bufferView];
-					bufferTangents = reinterpret_cast<const float *>(&(model.buffers[tangentView.buffer].data[tangentAccessor.byteOffset + tangentView.byteOffset]));
-				}
+	// All attributes share the same instance count, missing attributes default to the identity transform
+	size_t count = 0;
+	for (auto accessor : accessors) {
+		if (accessor) {
+			count = (count == 0) ? accessor->count : std::min(count, accessor->count);
+		}
+	}
+	if (count == 0) {
+		return;
+	}
+	std::vector<glm::vec3> translations(count, glm::vec3(0.0f));
+	std::vector<glm::quat> rotations(count, glm::quat(1.0f, 0.0f, 0.0f, 0.0f));
+	std::vector<glm::vec3> scales(count, glm::vec3(1.0f));
+	float* destinations[3] = { &translations[0].x, &rotations[0].x, &scales[0].x };
+	const size_t strides[3] = { sizeof(glm::vec3), sizeof(glm::quat), sizeof(glm::vec3) };
+	const uint32_t components[3] = { 3, 4, 3 };
+	for (uint32_t i = 0; i < 3; i++) {
+		if (accessors[i]) {
+			accessor::View view = getAccessorView(model, *accessors[i]);
+			view.count = count;
+			accessor::readFloats(view, destinations[i], strides[i], components[i], nullptr);
+		}
+	}
 
-				// Skinning
-				// Joints
-				if (primitive.attributes.find("JOINTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &jointAccessor = model.accessors[primitive.attributes.find("JOINTS_0")->second];
-					const tinygltf::BufferView &jointView = model.bufferViews[jointAccessor.bufferView];
-					bufferJoints = reinterpret_cast<const uint16_t *>(&(model.buffers[jointView.buffer].data[jointAccessor.byteOffset + jointView.byteOffset]));
-				}
+	// Index 0 is reserved for the identity instance drawn by all nodes that don't use the extension
+	if (instanceData.empty()) {
+		instanceData.push_back({ glm::mat4(1.0f) });
+	}
+	node->firstInstance = static_cast<uint32_t>(instanceData.size());
+	node->instanceCount = static_cast<uint32_t>(count);
+	for (size_t i = 0; i < count; i++) {
+		const glm::mat4 matrix = glm::translate(glm::mat4(1.0f), translations[i]) * glm::mat4(glm::normalize(rotations[i])) * glm::scale(glm::mat4(1.0f), scales[i]);
+		instanceData.push_back({ matrix });
+	}
+}
 
-				if (primitive.attributes.find("WEIGHTS_0") != primitive.attributes.end()) {
-					const tinygltf::Accessor &uvAccessor = model.accessors[primitive.attributes.find("WEIGHTS_0")->second];
-					const tinygltf::BufferView &uvView = model.bufferViews[uvAccessor.bufferView];
-					bufferWeights = reinterpret_cast<const float *>(&(model.buffers[uvView.buffer].data[uvAccessor.byteOffset + uvView.byteOffset]));
-				}
+/**
+* Optimize the index and vertex order of all primitives for the GPU and generate simplified levels of detail
+*
+* @param vertexBuffer Vertices of all primitives, replaced with the optimized vertices
+* @param indexBuffer Indices of all primitives, replaced with the optimized indices followed by the indices of each primitive's levels of detail
+* @param optimize Weld identical vertices and reorder triangles for the post-transform vertex cache and overdraw, then reorder vertices for fetch locality
+* @param lodLevels Maximum number of levels of detail to generate per primitive, each one targets half the triangles of the previous level
+*
+* @note Indices are expected to form triangle lists, primitives with other index counts are copied unchanged
+* @note All steps are deterministic, so the results can be stored in the mesh cache
+*/
+void vkglTF::Model::optimizeMeshes(std::vector<Vertex>& vertexBuffer, std::vector<uint32_t>& indexBuffer, bool optimize, uint32_t lodLevels)
+{
+	// Relative error accepted per generated level, the error of a level is accumulated from all coarser steps leading to it
+	const float lodTargetError = 0.05f;
+	// Stop generating levels once a simplification step removes less than this share of the indices
+	const float lodMinReduction = 0.1f;
+
+	std::vector<Vertex> optimizedVertices;
+	std::vector<uint32_t> optimizedIndices;
+	optimizedVertices.reserve(vertexBuffer.size());
+	optimizedIndices.reserve(indexBuffer.size());
+	optimizer::VertexCacheStatistics before, after;
+	auto accumulate = [](optimizer::VertexCacheStatistics& total, const optimizer::VertexCacheStatistics& statistics) {
+		total.vertexCount += statistics.vertexCount;
+		total.triangleCount += statistics.triangleCount;
+		total.transformedVertices += statistics.transformedVertices;
+	};
 
-				hasSkin = (bufferJoints && bufferWeights);
-
-				vertexCount = static_cast<uint32_t>(posAccessor.count);
-
-				for (size_t v = 0; v < posAccessor.count; v++) {
-					Vertex vert{};
-					vert.pos = glm::vec4(glm::make_vec3(&bufferPos[v * 3]), 1.0f);
-					vert.normal = glm::normalize(glm::vec3(bufferNormals ? glm::make_vec3(&bufferNormals[v * 3]) : glm::vec3(0.0f)));
-					vert.uv = bufferTexCoords ? glm::make_vec2(&bufferTexCoords[v * 2]) : glm::vec3(0.0f);
-					if (bufferColors) {
-						switch (numColorComponents) {
-							case 3: 
-								vert.color = glm::vec4(glm::make_vec3(&bufferColors[v * 3]), 1.0f);
-							case 4:
-								vert.color = glm::make_vec4(&bufferColors[v * 4]);
-						}
-					}
-					else {
-						vert.color = glm::vec4(1.0f);
-					}
-					vert.tangent = bufferTangents ? glm::vec4(glm::make_vec4(&bufferTangents[v * 4])) : glm::vec4(0.0f);
-					vert.joint0 = hasSkin ? glm::vec4(glm::make_vec4(&bufferJoints[v * 4])) : glm::vec4(0.0f);
-					vert.weight0 = hasSkin ? glm::make_vec4(&bufferWeights[v * 4]) : glm::vec4(0.0f);
-					vertexBuffer.push_back(vert);
-				}
+	std::vector<uint32_t> indices, remap, lodIndices;
+	std::vector<Vertex> vertices;
+	for (auto& primitives : meshTable) {
+		for (Primitive* primitive : primitives) {
+			// Work on indices relative to the primitive's first vertex
+			indices.assign(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
+			for (uint32_t& index : indices) {
+				index -= primitive->firstVertex;
+			}
+			vertices.assign(vertexBuffer.begin() + primitive->firstVertex, vertexBuffer.begin() + primitive->firstVertex + primitive->vertexCount);
+			const bool triangles = (indices.size() % 3 == 0) && !indices.empty();
+
+			if (optimize && triangles) {
+				accumulate(before, optimizer::analyzeVertexCache(indices.data(), indices.size(), vertices.size()));
+				// Weld vertices with identical attributes, glTF exporters often duplicate them per face
+				remap.resize(vertices.size());
+				size_t vertexCount = optimizer::generateVertexRemap(remap.data(), indices.data(), indices.size(), vertices.data(), vertices.size(), sizeof(Vertex));
+				std::vector<Vertex> welded(vertexCount);
+				optimizer::remapIndices(indices.data(), indices.data(), indices.size(), remap.data());
+				optimizer::remapVertices(welded.data(), vertices.data(), vertices.size(), sizeof(Vertex), remap.data());
+				vertices.swap(welded);
+				optimizer::optimizeVertexCache(indices.data(), indices.data(), indices.size(), vertices.size());
+				optimizer::optimizeOverdraw(indices.data(), indices.data(), indices.size(), &vertices[0].pos.x, vertices.size(), sizeof(Vertex));
+				// Vertices are stored in the order the optimized indices first reference them
+				remap.resize(vertices.size());
+				vertexCount = optimizer::optimizeVertexFetchRemap(remap.data(), indices.data(), indices.size(), vertices.size());
+				std::vector<Vertex> fetchOrdered(vertexCount);
+				optimizer::remapIndices(indices.data(), indices.data(), indices.size(), remap.data());
+				optimizer::remapVertices(fetchOrdered.data(), vertices.data(), vertices.size(), sizeof(Vertex), remap.data());
+				vertices.swap(fetchOrdered);
+				accumulate(after, optimizer::analyzeVertexCache(indices.data(), indices.size(), vertices.size()));
 			}
-			// Indices
-			{
-				const tinygltf::Accessor &accessor = model.accessors[primitive.indices];
-				const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
 
-				indexCount = static_cast<uint32_t>(accessor.count);
+			const uint32_t firstVertex = static_cast<uint32_t>(optimizedVertices.size());
+			primitive->firstVertex = firstVertex;
+			primitive->vertexCount = static_cast<uint32_t>(vertices.size());
+			primitive->firstIndex = static_cast<uint32_t>(optimizedIndices.size());
+			primitive->indexCount = static_cast<uint32_t>(indices.size());
+			primitive->lods.clear();
+			optimizedVertices.insert(optimizedVertices.end(), vertices.begin(), vertices.end());
+			for (uint32_t index : indices) {
+				optimizedIndices.push_back(index + firstVertex);
+			}
 
-				switch (accessor.componentType) {
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT: {
-					uint32_t *buf = new uint32_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint32_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-                    delete[] buf;
+			if (!triangles || (lodLevels == 0)) {
+				continue;
+			}
+			// Simplifier errors are relative to the mesh extent, the level errors are stored in local units for screen space selection
+			const float extent = std::max(primitive->dimensions.size.x, std::max(primitive->dimensions.size.y, primitive->dimensions.size.z));
+			float error = 0.0f;
+			// Each level is simplified from the previous one, so all levels share the primitive's vertices
+			for (uint32_t level = 0; level < lodLevels; level++) {
+				const size_t targetIndexCount = (indices.size() / 6) * 3;
+				float levelError = 0.0f;
+				lodIndices.resize(indices.size());
+				const size_t indexCount = optimizer::simplify(lodIndices.data(), indices.data(), indices.size(), &vertices[0].pos.x, vertices.size(), sizeof(Vertex), targetIndexCount, lodTargetError, &levelError);
+				if ((indexCount == 0) || (static_cast<float>(indexCount) > static_cast<float>(indices.size()) * (1.0f - lodMinReduction))) {
 					break;
 				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT: {
-					uint16_t *buf = new uint16_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint16_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-                    delete[] buf;
-                    break;
-				}
-				case TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE: {
-					uint8_t *buf = new uint8_t[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(uint8_t));
-					for (size_t index = 0; index < accessor.count; index++) {
-						indexBuffer.push_back(buf[index] + vertexStart);
-					}
-                    delete[] buf;
-                    break;
-				}
-				default:
-					std::cerr << "Index component type " << accessor.componentType << " not supported!" << std::endl;
-					return;
+				lodIndices.resize(indexCount);
+				optimizer::optimizeVertexCache(lodIndices.data(), lodIndices.data(), lodIndices.size(), vertices.size());
+				error += levelError;
+				Primitive::LOD lod{};
+				lod.firstIndex = static_cast<uint32_t>(optimizedIndices.size());
+				lod.indexCount = static_cast<uint32_t>(lodIndices.size());
+				lod.error = error * extent;
+				primitive->lods.push_back(lod);
+				for (uint32_t index : lodIndices) {
+					optimizedIndices.push_back(index + firstVertex);
 				}
+				indices.swap(lodIndices);
 			}
-			Primitive *newPrimitive = new Primitive(indexStart, indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
-			newPrimitive->firstVertex = vertexStart;
-			newPrimitive->vertexCount = vertexCount;
-			newPrimitive->setDimensions(posMin, posMax);
-			newMesh->primitives.push_back(newPrimitive);
 		}
-		newNode->mesh = newMesh;
 	}
-	if (parent) {
-		parent->children.push_back(newNode);
+	vertexBuffer.swap(optimizedVertices);
+	indexBuffer.swap(optimizedIndices);
+
+	if (optimize && (before.triangleCount > 0)) {
+		auto print = [](const char* name, const optimizer::VertexCacheStatistics& statistics) {
+			std::cout << name << ": ACMR " << static_cast<float>(statistics.transformedVertices) / static_cast<float>(statistics.triangleCount) << ", ATVR " << static_cast<float>(statistics.transformedVertices) / static_cast<float>(std::max(statistics.vertexCount, 1u)) << std::endl;
+		};
+		print("Vertex cache before optimization", before);
+		print("Vertex cache after optimization", after);
+	}
+}
+
+/**
+* Split all primitives into meshlets and compute their culling bounds
+*
+* @param vertexBuffer Final vertices of all primitives
+* @param indexBuffer Final indices of all primitives
+* @param clockwise Front faces are wound clockwise, which is the case for models loaded with FileLoadingFlags::FlipY
+*
+* @note Only the full detail indices of a primitive are split, generated levels of detail have no meshlets
+*/
+void vkglTF::Model::buildMeshlets(const std::vector<Vertex>& vertexBuffer, const std::vector<uint32_t>& indexBuffer, bool clockwise)
+{
+	meshlets.clear();
+	meshletBounds.clear();
+	meshletVertices.clear();
+	meshletTriangles.clear();
+	std::vector<uint32_t> indices;
+	for (auto& primitives : meshTable) {
+		for (Primitive* primitive : primitives) {
+			primitive->firstMeshlet = static_cast<uint32_t>(meshlets.size());
+			primitive->meshletCount = 0;
+			if ((primitive->indexCount == 0) || (primitive->indexCount % 3 != 0)) {
+				continue;
+			}
+			// Build on primitive local indices, so the per vertex bookkeeping only spans the primitive's vertices
+			indices.assign(indexBuffer.begin() + primitive->firstIndex, indexBuffer.begin() + primitive->firstIndex + primitive->indexCount);
+			for (uint32_t& index : indices) {
+				index -= primitive->firstVertex;
+			}
+			const size_t firstMeshletVertex = meshletVertices.size();
+			meshlets::buildMeshlets(meshlets, meshletVertices, meshletTriangles, indices.data(), indices.size(), primitive->vertexCount);
+			primitive->meshletCount = static_cast<uint32_t>(meshlets.size()) - primitive->firstMeshlet;
+			const Vertex* vertices = &vertexBuffer[primitive->firstVertex];
+			for (uint32_t i = primitive->firstMeshlet; i < meshlets.size(); i++) {
+				meshletBounds.push_back(meshlets::computeBounds(meshlets[i], meshletVertices.data(), meshletTriangles.data(), &vertices->pos.x, sizeof(Vertex), clockwise));
+			}
+			// Shaders index the model's vertex buffer directly
+			for (size_t i = firstMeshletVertex; i < meshletVertices.size(); i++) {
+				meshletVertices[i] += primitive->firstVertex;
+			}
+		}
+	}
+}
+
+/**
+* Create the primitives of a glTF mesh and reserve their ranges in the vertex and index buffers, the data is decoded later on by loadPrimitives
+*
+* @param mesh glTF mesh to load
+* @param model tinyglTF model the mesh belongs to
+*
+* @return Primitives of the mesh, owned by the caller
+*/
+std::vector<vkglTF::Primitive*> vkglTF::Model::loadMeshPrimitives(const tinygltf::Mesh& mesh, const tinygltf::Model& model)
+{
+	std::vector<Primitive*> primitives;
+	for (size_t j = 0; j < mesh.primitives.size(); j++) {
+		const tinygltf::Primitive &primitive = mesh.primitives[j];
+		if (primitive.indices < 0) {
+			continue;
+		}
+		// Position attribute is required
+		assert(primitive.attributes.find("POSITION") != primitive.attributes.end());
+
+		const tinygltf::Accessor &posAccessor = model.accessors[primitive.attributes.find("POSITION")->second];
+		const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
+		if ((indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_INT) && (indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_SHORT) && (indexAccessor.componentType != TINYGLTF_PARAMETER_TYPE_UNSIGNED_BYTE)) {
+			std::cerr << "Index component type " << indexAccessor.componentType << " not supported!" << std::endl;
+			continue;
+		}
+
+		PrimitiveLoadJob job{};
+		job.primitive = &primitive;
+		job.firstVertex = loadedVertexCount;
+		job.vertexCount = static_cast<uint32_t>(posAccessor.count);
+		job.firstIndex = loadedIndexCount;
+		job.indexCount = static_cast<uint32_t>(indexAccessor.count);
+		primitiveLoadJobs.push_back(job);
+		loadedVertexCount += job.vertexCount;
+		loadedIndexCount += job.indexCount;
+
+		glm::vec3 posMin = glm::vec3(posAccessor.minValues[0], posAccessor.minValues[1], posAccessor.minValues[2]);
+		glm::vec3 posMax = glm::vec3(posAccessor.maxValues[0], posAccessor.maxValues[1], posAccessor.maxValues[2]);
+
+		Primitive *newPrimitive = new Primitive(job.firstIndex, job.indexCount, primitive.material > -1 ? materials[primitive.material] : materials.back());
+		newPrimitive->firstVertex = job.firstVertex;
+		newPrimitive->vertexCount = job.vertexCount;
+		newPrimitive->setDimensions(posMin, posMax);
+		primitives.push_back(newPrimitive);
+	}
+	return primitives;
+}
+
+/**
+* Decode the vertex attributes and indices of a single glTF primitive into its reserved range of the model's vertex and index buffers
+*
+* @param model tinyglTF model the primitive belongs to
+* @param job Primitive to decode along with its first vertex and first index in the target buffers
+* @param vertexBuffer Start of the model's vertex buffer
+* @param indexBuffer Start of the model's index buffer
+*
+* @note Only reads from the model and writes to the primitive's own range, so multiple primitives can be decoded concurrently
+*/
+void vkglTF::Model::decodePrimitive(const tinygltf::Model &model, const PrimitiveLoadJob &job, Vertex *vertexBuffer, uint32_t *indexBuffer) const
+{
+	const tinygltf::Primitive &primitive = *job.primitive;
+	// Vertices
+	{
+		Vertex *vertices = vertexBuffer + job.firstVertex;
+		const size_t stride = sizeof(Vertex);
+		const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		const float one[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+
+		auto findAttribute = [&primitive, &model](const char *name) -> const tinygltf::Accessor* {
+			auto attribute = primitive.attributes.find(name);
+			return (attribute != primitive.attributes.end()) ? &model.accessors[attribute->second] : nullptr;
+		};
+		// Missing attributes are set to the given default values
+		auto readAttribute = [&](const tinygltf::Accessor *attributeAccessor, float *dst, uint32_t components, const float *defaults) {
+			if (attributeAccessor) {
+				accessor::View view = getAccessorView(model, *attributeAccessor);
+				view.count = std::min(view.count, static_cast<size_t>(job.vertexCount));
+				accessor::readFloats(view, dst, stride, components, defaults);
+			} else {
+				accessor::fillFloats(dst, stride, components, defaults, job.vertexCount);
+			}
+		};
+
+		readAttribute(findAttribute("POSITION"), &vertices->pos.x, 3, zero);
+		const tinygltf::Accessor *normalAccessor = findAttribute("NORMAL");
+		readAttribute(normalAccessor, &vertices->normal.x, 3, zero);
+		if (normalAccessor) {
+			accessor::normalizeVec3(&vertices->normal.x, stride, job.vertexCount);
+		}
+		readAttribute(findAttribute("TEXCOORD_0"), &vertices->uv.x, 2, zero);
+		// Color buffers are either of type vec3 or vec4, vec3 colors get an alpha of one
+		readAttribute(findAttribute("COLOR_0"), &vertices->color.x, 4, one);
+		readAttribute(findAttribute("TANGENT"), &vertices->tangent.x, 4, zero);
+
+		// Skinning
+		const tinygltf::Accessor *jointAccessor = findAttribute("JOINTS_0");
+		const tinygltf::Accessor *weightAccessor = findAttribute("WEIGHTS_0");
+		const bool hasSkin = (jointAccessor && weightAccessor);
+		readAttribute(hasSkin ? jointAccessor : nullptr, &vertices->joint0.x, 4, zero);
+		readAttribute(hasSkin ? weightAccessor : nullptr, &vertices->weight0.x, 4, zero);
+	}
+	// Indices are rebased onto the primitive's first vertex while being written to their final location
+	{
+		const tinygltf::Accessor &indexAccessor = model.accessors[primitive.indices];
+		accessor::View view = getAccessorView(model, indexAccessor);
+		view.count = job.indexCount;
+		accessor::readIndices(view, indexBuffer + job.firstIndex, job.firstVertex);
+	}
+}
+
+/**
+* Decode all primitives reserved by loadNode into the vertex and index buffers
+*
+* @param model tinyglTF model the nodes were loaded from
+* @param indexBuffer Index buffer that is resized to hold the indices of all primitives
+* @param vertexBuffer Vertex buffer that is resized to hold the vertices of all primitives
+*
+* @note Larger models are decoded by a job system, one job per primitive so idle workers can steal the remaining ones
+*/
+void vkglTF::Model::loadPrimitives(const tinygltf::Model &model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer)
+{
+	vertexBuffer.resize(loadedVertexCount);
+	indexBuffer.resize(loadedIndexCount);
+
+	// Spinning up threads doesn't pay off for small models
+	const uint32_t minVerticesPerThread = 16384;
+	uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), static_cast<uint32_t>(primitiveLoadJobs.size()));
+	threadCount = std::min(threadCount, std::max(loadedVertexCount / minVerticesPerThread, 1u));
+
+	if (threadCount <= 1) {
+		for (const PrimitiveLoadJob &job : primitiveLoadJobs) {
+			decodePrimitive(model, job, vertexBuffer.data(), indexBuffer.data());
+		}
 	} else {
-		nodes.push_back(newNode);
+		// The calling thread takes part in decoding, so it only needs threadCount - 1 additional workers
+		vks::JobSystem jobSystem(threadCount - 1);
+		jobSystem.parallelFor(static_cast<uint32_t>(primitiveLoadJobs.size()), 1, [&](uint32_t i) {
+			decodePrimitive(model, primitiveLoadJobs[i], vertexBuffer.data(), indexBuffer.data());
+		});
 	}
-	linearNodes.push_back(newNode);
+
+	primitiveLoadJobs.clear();
+	gltfMeshTableIndices.clear();
+	loadedVertexCount = 0;
+	loadedIndexCount = 0;
 }
 
 void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
@@ -978,11 +1614,11 @@ void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 		// Get inverse bind matrices from buffer
 		if (source.inverseBindMatrices > -1) {
 			const tinygltf::Accessor &accessor = gltfModel.accessors[source.inverseBindMatrices];
-			const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-			const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 			newSkin->inverseBindMatrices.resize(accessor.count);
-			memcpy(newSkin->inverseBindMatrices.data(), &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::mat4));
+			memcpy(newSkin->inverseBindMatrices.data(), getAccessorData(gltfModel, accessor), accessor.count * sizeof(glm::mat4));
 		}
+		// Inverse bind matrices are optional and default to identity
+		newSkin->inverseBindMatrices.resize(newSkin->joints.size(), glm::mat4(1.0f));
 
 		skins.push_back(newSkin);
 	}
@@ -990,14 +1626,179 @@ void vkglTF::Model::loadSkins(tinygltf::Model &gltfModel)
 
 void vkglTF::Model::loadImages(tinygltf::Model &gltfModel, vks::VulkanDevice *device, VkQueue transferQueue)
 {
-	for (tinygltf::Image &image : gltfModel.images) {
-		vkglTF::Texture texture;
-		texture.fromglTfImage(image, path, device, transferQueue);
-		texture.index = static_cast<uint32_t>(textures.size());
-		textures.push_back(texture);
+	textures.resize(gltfModel.images.size());
+	vks::UploadBatch uploadBatch(device, transferQueue);
+	uploadImages(gltfModel.images, device, uploadBatch);
+	uploadBatch.flush();
+}
+
+namespace
+{
+	uint64_t hashData(const unsigned char* data, size_t size);
+
+	bool isExternalImage(const tinygltf::Image& image)
+	{
+		return !image.uri.empty() && (image.uri.rfind("data:", 0) != 0);
+	}
+
+	// Images in external files are identified by their resolved file name, all others by their decoded content
+	std::string getTextureCacheKey(const tinygltf::Image& image, const std::string& path)
+	{
+		if (isExternalImage(image)) {
+			return "file:" + path + "/" + tinygltf::dlib::urldecode(image.uri);
+		}
+		return "image:" + std::to_string(image.width) + "x" + std::to_string(image.height) + "x" + std::to_string(image.component) + "x" + std::to_string(image.bits) + ":" + std::to_string(hashData(image.image.data(), image.image.size()));
+	}
+
+	// Color textures are sRGB encoded in glTF, all other textures hold linear data
+	std::vector<bool> getSrgbImages(const std::vector<vkglTF::Material>& materials, const std::vector<vkglTF::Texture>& textures)
+	{
+		std::vector<bool> srgbImages(textures.size(), false);
+		for (const vkglTF::Material& material : materials) {
+			for (const vkglTF::Texture* texture : { material.baseColorTexture, material.emissiveTexture }) {
+				if ((texture >= textures.data()) && (texture < textures.data() + textures.size())) {
+					srgbImages[texture - textures.data()] = true;
+				}
+			}
+		}
+		return srgbImages;
+	}
+
+	/**
+	* Decode the images whose decoding was deferred by loadImageDataFunc on all cores
+	*
+	* @param images Images the decoded pixels are stored in
+	* @param encodedImages Encoded data of the images, released once an image has been decoded
+	* @param srgbImages (Optional) Also generate the full mip chain of every decoded RGBA8 image, averaging the color of images flagged here in linear space
+	* @param decoded (Optional) Called on the calling thread for every image as soon as it has been decoded, in the order they complete
+	* Also gets the job system decoding the images (null if decoding on the calling thread), so work done by the callback can be distributed over the same workers
+	*
+	* @note stb_image is thread safe except for its failure reason, so error messages of images failing at the same time might get mixed up
+	*/
+	void decodeImages(std::vector<tinygltf::Image>& images, std::vector<std::vector<unsigned char>>& encodedImages, const std::vector<bool>* srgbImages, const std::function<void(uint32_t, vks::JobSystem*)>& decoded)
+	{
+		std::vector<uint32_t> pending;
+		for (uint32_t i = 0; i < encodedImages.size(); i++) {
+			if (!encodedImages[i].empty()) {
+				pending.push_back(i);
+			}
+		}
+		if (pending.empty()) {
+			return;
+		}
+
+		std::vector<std::string> errors(encodedImages.size());
+		std::vector<uint8_t> failed(encodedImages.size(), 0);
+		auto decode = [&](uint32_t i) {
+			std::string warning;
+			failed[i] = !tinygltf::LoadImageData(&images[i], static_cast<int>(i), &errors[i], &warning, 0, 0, encodedImages[i].data(), static_cast<int>(encodedImages[i].size()), nullptr);
+			std::vector<unsigned char>().swap(encodedImages[i]);
+			// The texture recognizes a baked mip chain by the size of the image data
+			tinygltf::Image& image = images[i];
+			if (!failed[i] && srgbImages && (image.component == 4) && (image.bits == 8) && (std::max(image.width, image.height) > 1)) {
+				image.image.resize(vkglTF::mipmaps::getChainSize(image.width, image.height));
+				const bool srgb = (i < srgbImages->size()) && (*srgbImages)[i];
+				vkglTF::mipmaps::generateMipChain(image.image.data(), image.width, image.height, vkglTF::mipmaps::Filter::Kaiser, srgb);
+			}
+		};
+		auto finish = [&](uint32_t i, vks::JobSystem* jobSystem) {
+			if (failed[i]) {
+				vks::tools::exitFatal("Could not decode image \"" + images[i].uri + "\": " + errors[i], -1);
+			}
+			if (decoded) {
+				decoded(i, jobSystem);
+			}
+		};
+
+		const uint32_t threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), static_cast<uint32_t>(pending.size()));
+		if (threadCount <= 1) {
+			for (uint32_t i : pending) {
+				decode(i);
+				finish(i, nullptr);
+			}
+			return;
+		}
+
+		// The calling thread only waits for decoded images and passes them on, so all workers can decode
+		// The job system is declared last, so its threads have been joined before the objects they signal are destroyed
+		std::mutex mutex;
+		std::condition_variable condition;
+		std::vector<uint32_t> completed;
+		vks::JobSystem jobSystem(threadCount);
+		for (uint32_t i : pending) {
+			jobSystem.run([&, i]() {
+				decode(i);
+				std::lock_guard<std::mutex> lock(mutex);
+				completed.push_back(i);
+				condition.notify_one();
+			});
+		}
+		std::vector<uint32_t> ready;
+		for (size_t finished = 0; finished < pending.size(); finished += ready.size()) {
+			ready.clear();
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				condition.wait(lock, [&completed]() { return !completed.empty(); });
+				ready.swap(completed);
+			}
+			for (uint32_t i : ready) {
+				finish(i, &jobSystem);
+			}
+		}
+	}
+}
+
+/**
+* Create the textures for images in place, so materials can already point at them before they're uploaded
+*
+* @param images Images of the model, decoded unless their data is given by encodedImages
+* @param device Device used for resource creation
+* @param uploadBatch Batch the texture uploads are recorded to
+* @param encodedImages (Optional) Encoded data of images whose decoding was deferred, these are decoded in parallel and recorded as soon as they are done
+*/
+void vkglTF::Model::uploadImages(std::vector<tinygltf::Image>& images, vks::VulkanDevice *device, vks::UploadBatch& uploadBatch, std::vector<std::vector<unsigned char>>* encodedImages)
+{
+	auto createTexture = [&](uint32_t i, vks::JobSystem* jobSystem) {
+		if (textureCache) {
+			tinygltf::Image& image = images[i];
+			textures[i] = textureCache->acquire(getTextureCacheKey(image, path), [&](Texture& texture) {
+				texture.fromglTfImage(image, path, device, uploadBatch, jobSystem);
+			});
+		} else {
+			textures[i].fromglTfImage(images[i], path, device, uploadBatch, jobSystem);
+		}
+		textures[i].index = i;
+	};
+
+	bool decodeDeferred = false;
+	for (uint32_t i = 0; i < images.size(); i++) {
+		if (!encodedImages || (i >= encodedImages->size()) || (*encodedImages)[i].empty()) {
+			createTexture(i, nullptr);
+			continue;
+		}
+		// Cached images from files don't need to be decoded at all
+		if (textureCache && isExternalImage(images[i]) && textureCache->tryAcquire(getTextureCacheKey(images[i], path), textures[i])) {
+			textures[i].index = i;
+			std::vector<unsigned char>().swap((*encodedImages)[i]);
+			continue;
+		}
+		decodeDeferred = true;
+	}
+	if (decodeDeferred) {
+		const std::vector<bool> srgbImages = bakeMipmaps ? getSrgbImages(materials, textures) : std::vector<bool>();
+		// Textures are created while the remaining images are still being decoded, CPU mip chains share the decoding workers
+		decodeImages(images, *encodedImages, bakeMipmaps ? &srgbImages : nullptr, [&](uint32_t i, vks::JobSystem* jobSystem) {
+			createTexture(i, jobSystem);
+			// The pixels have been copied to staging memory
+			std::vector<unsigned char>().swap(images[i].image);
+		});
+	}
+	if (textureCache && !images.empty()) {
+		const TextureCache::Statistics statistics = textureCache->getStatistics();
+		std::cout << "Texture cache: " << statistics.hits << " hits, " << statistics.misses << " misses, " << statistics.textureCount << " textures for " << statistics.referenceCount << " references" << std::endl;
 	}
 	// Create an empty texture to be used for empty material images
-	createEmptyTexture(transferQueue);
+	createEmptyTexture(uploadBatch);
 }
 
 void vkglTF::Model::loadMaterials(tinygltf::Model &gltfModel)
@@ -1076,13 +1877,11 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 			// Read sampler input time values
 			{
 				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.input];
-				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
 				float *buf = new float[accessor.count];
-				memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(float));
+				memcpy(buf, getAccessorData(gltfModel, accessor), accessor.count * sizeof(float));
 				for (size_t index = 0; index < accessor.count; index++) {
 					sampler.inputs.push_back(buf[index]);
 				}
@@ -1100,15 +1899,13 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 			// Read sampler output T/R/S values 
 			{
 				const tinygltf::Accessor &accessor = gltfModel.accessors[samp.output];
-				const tinygltf::BufferView &bufferView = gltfModel.bufferViews[accessor.bufferView];
-				const tinygltf::Buffer &buffer = gltfModel.buffers[bufferView.buffer];
 
 				assert(accessor.componentType == TINYGLTF_COMPONENT_TYPE_FLOAT);
 
 				switch (accessor.type) {
 				case TINYGLTF_TYPE_VEC3: {
 					glm::vec3 *buf = new glm::vec3[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec3));
+					memcpy(buf, getAccessorData(gltfModel, accessor), accessor.count * sizeof(glm::vec3));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(glm::vec4(buf[index], 0.0f));
 					}
@@ -1117,7 +1914,7 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 				}
 				case TINYGLTF_TYPE_VEC4: {
 					glm::vec4 *buf = new glm::vec4[accessor.count];
-					memcpy(buf, &buffer.data[accessor.byteOffset + bufferView.byteOffset], accessor.count * sizeof(glm::vec4));
+					memcpy(buf, getAccessorData(gltfModel, accessor), accessor.count * sizeof(glm::vec4));
 					for (size_t index = 0; index < accessor.count; index++) {
 						sampler.outputsVec4.push_back(buf[index]);
 					}
@@ -1164,135 +1961,926 @@ void vkglTF::Model::loadAnimations(tinygltf::Model &gltfModel)
 	}
 }
 
-void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+/*
+	Returns a pointer to the first element of an accessor inside a buffer loaded by tinyglTF
+*/
+const unsigned char* vkglTF::Model::getAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor) const
 {
-	tinygltf::Model gltfModel;
-	tinygltf::TinyGLTF gltfContext;
-	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
-		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
-	} else {
-		gltfContext.SetImageLoader(loadImageDataFunc, nullptr);
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+	const size_t offset = accessor.byteOffset + bufferView.byteOffset;
+	return &model.buffers[bufferView.buffer].data[offset];
+}
+
+vkglTF::accessor::View vkglTF::Model::getAccessorView(const tinygltf::Model& model, const tinygltf::Accessor& accessor) const
+{
+	const tinygltf::BufferView& bufferView = model.bufferViews[accessor.bufferView];
+	accessor::View view{};
+	view.data = getAccessorData(model, accessor);
+	view.count = accessor.count;
+	view.componentType = static_cast<accessor::ComponentType>(accessor.componentType);
+	view.componentCount = static_cast<uint32_t>(tinygltf::GetNumComponentsInType(static_cast<uint32_t>(accessor.type)));
+	view.normalized = accessor.normalized;
+	// Attributes may be interleaved, a byte stride of zero means the elements are tightly packed
+	view.stride = bufferView.byteStride > 0 ? bufferView.byteStride : accessor::componentSize(view.componentType) * view.componentCount;
+	return view;
+}
+
+/*
+	Loads a .gltf or .glb file from a memory mapping
+
+	The file is passed to tinyglTF straight from the mapping instead of being read into a std::vector first: Binary glTF goes through LoadBinaryFromMemory,
+	the JSON of a .gltf through LoadASCIIFromString. External buffers and images are served by a ReadWholeFile callback that maps the requested file.
+	tinyglTF still copies buffer contents into its own vectors, but every file is only read once and images stored in buffer views are handled by tinyglTF itself.
+*/
+bool vkglTF::Model::loadFromMappedFile(const std::string& filename, tinygltf::TinyGLTF& gltfContext, tinygltf::Model& gltfModel, std::string& error, std::string& warning)
+{
+	vks::tools::MappedFile file;
+	if (!file.open(filename)) {
+		error = "Could not open file";
+		return false;
+	}
+	if (file.size() > std::numeric_limits<unsigned int>::max()) {
+		error = "File is too large";
+		return false;
 	}
-#if defined(__ANDROID__)
-	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
-	// We let tinygltf handle this, by passing the asset manager of our app
-	tinygltf::asset_manager = androidApp->activity->assetManager;
-#endif
-	size_t pos = filename.find_last_of('/');
-	path = filename.substr(0, pos);
 
-	std::string error, warning;
+	tinygltf::FsCallbacks fsCallbacks{};
+	fsCallbacks.FileExists = &tinygltf::FileExists;
+	fsCallbacks.ExpandFilePath = &tinygltf::ExpandFilePath;
+	fsCallbacks.WriteWholeFile = &tinygltf::WriteWholeFile;
+	fsCallbacks.ReadWholeFile = [](std::vector<unsigned char>* out, std::string* err, const std::string& filepath, void*) {
+		vks::tools::MappedFile externalFile;
+		if (!externalFile.open(filepath)) {
+			if (err) {
+				(*err) += "Could not map file " + filepath + "\n";
+			}
+			return false;
+		}
+		out->assign(externalFile.data(), externalFile.data() + externalFile.size());
+		return true;
+	};
+	gltfContext.SetFsCallbacks(fsCallbacks);
 
-	this->device = device;
+	const bool binary = (file.size() >= 4) && (memcmp(file.data(), "glTF", 4) == 0);
+	if (binary) {
+		return gltfContext.LoadBinaryFromMemory(&gltfModel, &error, &warning, file.data(), static_cast<unsigned int>(file.size()), path);
+	}
+	return gltfContext.LoadASCIIFromString(&gltfModel, &error, &warning, reinterpret_cast<const char*>(file.data()), static_cast<unsigned int>(file.size()), path);
+}
 
-#if defined(__ANDROID__)
-	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
-	// We let tinygltf handle this, by passing the asset manager of our app
-	tinygltf::asset_manager = androidApp->activity->assetManager;
-#endif
-	bool fileLoaded = gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+namespace
+{
+	// Needs to be increased whenever the cache layout or the data produced by the loader changes
+	const uint32_t meshCacheMagic = 0x48434D56; // "VMCH"
+	const uint32_t meshCacheVersion = 7;
 
-	std::vector<uint32_t> indexBuffer;
-	std::vector<Vertex> vertexBuffer;
+	// 64 bit FNV-1a, consuming eight bytes per step
+	uint64_t hashData(const unsigned char* data, size_t size)
+	{
+		const uint64_t prime = 1099511628211ull;
+		uint64_t hash = 14695981039346656037ull;
+		size_t i = 0;
+		for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+			uint64_t word;
+			memcpy(&word, data + i, sizeof(uint64_t));
+			hash = (hash ^ word) * prime;
+		}
+		for (; i < size; i++) {
+			hash = (hash ^ data[i]) * prime;
+		}
+		return hash;
+	}
 
-	if (fileLoaded) {
-		if (!(fileLoadingFlags & FileLoadingFlags::DontLoadImages)) {
-			loadImages(gltfModel, device, transferQueue);
+	// Returns the offset of the BIN chunk's data inside a binary glTF file, or zero if there is none
+	size_t getBinaryChunkOffset(const vks::tools::MappedFile& file)
+	{
+		if ((file.size() < 20) || (memcmp(file.data(), "glTF", 4) != 0)) {
+			return 0;
 		}
-		loadMaterials(gltfModel);
-		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
-		for (size_t i = 0; i < scene.nodes.size(); i++) {
-			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
-			loadNode(nullptr, node, scene.nodes[i], gltfModel, indexBuffer, vertexBuffer, scale);
+		uint32_t jsonChunkLength;
+		memcpy(&jsonChunkLength, file.data() + 12, sizeof(uint32_t));
+		const size_t binaryChunkOffset = 20 + static_cast<size_t>(jsonChunkLength);
+		return (binaryChunkOffset + 8 <= file.size()) ? binaryChunkOffset + 8 : 0;
+	}
+
+	class CacheWriter
+	{
+	public:
+		std::vector<unsigned char> data;
+		void writeData(const void* src, size_t size)
+		{
+			const unsigned char* bytes = static_cast<const unsigned char*>(src);
+			data.insert(data.end(), bytes, bytes + size);
 		}
-		if (gltfModel.animations.size() > 0) {
-			loadAnimations(gltfModel);
+		template<typename T> void write(const T& value)
+		{
+			writeData(&value, sizeof(T));
 		}
-		loadSkins(gltfModel);
+		void writeString(const std::string& value)
+		{
+			write(static_cast<uint32_t>(value.size()));
+			writeData(value.data(), value.size());
+		}
+		template<typename T> void writeVector(const std::vector<T>& values)
+		{
+			write(static_cast<uint64_t>(values.size()));
+			writeData(values.data(), values.size() * sizeof(T));
+		}
+	};
 
-		for (auto node : linearNodes) {
-			// Assign skins
-			if (node->skinIndex > -1) {
-				node->skin = skins[node->skinIndex];
+	// Reads from a memory mapped cache file, all reads are bounds checked and invalidate the reader on failure
+	class CacheReader
+	{
+	public:
+		bool valid = true;
+		CacheReader(const unsigned char* data, size_t size) : data(data), size(size) {};
+		const unsigned char* skip(size_t count)
+		{
+			if (!valid || (count > size - offset)) {
+				valid = false;
+				return nullptr;
 			}
-			// Initial pose
-			if (node->mesh) {
-				node->update();
+			const unsigned char* current = data + offset;
+			offset += count;
+			return current;
+		}
+		template<typename T> T read()
+		{
+			T value{};
+			const unsigned char* src = skip(sizeof(T));
+			if (src) {
+				memcpy(&value, src, sizeof(T));
 			}
+			return value;
 		}
-	}
-	else {
-		vks::tools::exitFatal("Could not load glTF file \"" + filename + "\": " + error, -1);
-		return;
-	}
-
-	// Pre-Calculations for requested features
-	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
-		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
-		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
-		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
-		for (Node* node : linearNodes) {
-			if (node->mesh) {
-				const glm::mat4 localMatrix = node->getMatrix();
-				for (Primitive* primitive : node->mesh->primitives) {
-					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
-						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
-						// Pre-transform vertex positions by node-hierarchy
-						if (preTransform) {
-							vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
-							vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
-						}
-						// Flip Y-Axis of vertex positions
-						if (flipY) {
-							vertex.pos.y *= -1.0f;
-							vertex.normal.y *= -1.0f;
-						}
-						// Pre-Multiply vertex colors with material base color
-						if (preMultiplyColor) {
-							vertex.color = primitive->material.baseColorFactor * vertex.color;
-						}
-					}
-				}
+		std::string readString()
+		{
+			const uint32_t length = read<uint32_t>();
+			const unsigned char* src = skip(length);
+			return src ? std::string(reinterpret_cast<const char*>(src), length) : std::string();
+		}
+		template<typename T> std::vector<T> readVector()
+		{
+			const uint64_t count = read<uint64_t>();
+			std::vector<T> values;
+			if (valid && (count <= (size - offset) / sizeof(T))) {
+				values.resize(static_cast<size_t>(count));
+				memcpy(values.data(), skip(values.size() * sizeof(T)), values.size() * sizeof(T));
+			} else {
+				valid = false;
 			}
+			return values;
 		}
-	}
+	private:
+		const unsigned char* data;
+		size_t size;
+		size_t offset = 0;
+	};
+}
 
-	for (auto extension : gltfModel.extensionsUsed) {
+/*
+	Mesh cache
+
+	Models loaded with FileLoadingFlags::UseMeshCache store the result of loading a glTF file in a binary cache file next to it. This contains the final
+	(pre-transformed and optionally packed) vertex and index data, the node hierarchy, materials, skins and animations. Images are referenced by uri or
+	by their location inside the glTF files, so they're decoded from the source files without having to parse the glTF JSON.
+	A cache is only used if it was written for the same loading flags and scale, and if size and hash of all glTF files it was built from still match.
+*/
+
+/**
+* Write the current state of the model to a mesh cache file, called right after a glTF file has been loaded
+*
+* @param cacheFilename Name of the cache file to write
+* @param filename Name of the glTF file the model was loaded from
+* @param gltfModel tinyglTF model the model was loaded from
+* @param fileLoadingFlags Flags used for loading the model
+* @param scale Scale used for loading the model
+* @param vertexData Final vertex data as uploaded to the vertex buffer
+* @param vertexBufferSize Size of the vertex data in bytes
+* @param indexBuffer Final index data
+*
+* @note Models using data uris for external buffers or images are not cached
+*/
+void vkglTF::Model::writeCache(const std::string& cacheFilename, const std::string& filename, const tinygltf::Model& gltfModel, uint32_t fileLoadingFlags, float scale, const void* vertexData, size_t vertexBufferSize, const std::vector<uint32_t>& indexBuffer)
+{
+	// Map all files the model was built from, these are used to validate the cache on later loads
+	std::vector<std::string> dependencies = { filename };
+	std::vector<int32_t> bufferDependencies(gltfModel.buffers.size(), -1);
+	for (size_t i = 0; i < gltfModel.buffers.size(); i++) {
+		const std::string& uri = gltfModel.buffers[i].uri;
+		if (uri.empty()) {
+			bufferDependencies[i] = 0;
+		} else if (uri.rfind("data:", 0) != 0) {
+			bufferDependencies[i] = static_cast<int32_t>(dependencies.size());
+			dependencies.push_back(path + "/" + tinygltf::dlib::urldecode(uri));
+		}
+	}
+	std::vector<vks::tools::MappedFile> dependencyFiles(dependencies.size());
+	for (size_t i = 0; i < dependencies.size(); i++) {
+		if (!dependencyFiles[i].open(dependencies[i])) {
+			return;
+		}
+	}
+
+	CacheWriter writer;
+	writer.write(meshCacheMagic);
+	writer.write(meshCacheVersion);
+	// Total size of the cache, written at the end to detect incomplete files
+	writer.write(static_cast<uint64_t>(0));
+	writer.write(fileLoadingFlags);
+	writer.write(scale);
+	writer.write(static_cast<uint32_t>(packedVertices ? sizeof(PackedVertex) : sizeof(Vertex)));
+	writer.write(lodLevelCount);
+
+	writer.write(static_cast<uint32_t>(dependencies.size()));
+	for (size_t i = 0; i < dependencies.size(); i++) {
+		writer.writeString(dependencies[i]);
+		writer.write(static_cast<uint64_t>(dependencyFiles[i].size()));
+		writer.write(hashData(dependencyFiles[i].data(), dependencyFiles[i].size()));
+	}
+
+	// Image sources, either an external file or a range inside one of the dependencies
+	writer.write(static_cast<uint32_t>(textures.size()));
+	for (size_t i = 0; i < textures.size(); i++) {
+		const tinygltf::Image& image = gltfModel.images[i];
+		int32_t dependency = -1;
+		uint64_t offset = 0;
+		uint64_t size = 0;
+		if (image.bufferView > -1) {
+			const tinygltf::BufferView& bufferView = gltfModel.bufferViews[image.bufferView];
+			dependency = bufferDependencies[bufferView.buffer];
+			if (dependency < 0) {
+				return;
+			}
+			offset = bufferView.byteOffset + ((gltfModel.buffers[bufferView.buffer].uri.empty()) ? getBinaryChunkOffset(dependencyFiles[0]) : 0);
+			size = bufferView.byteLength;
+		} else if (image.uri.rfind("data:", 0) == 0) {
+			return;
+		}
+		writer.writeString(image.uri);
+		writer.write(dependency);
+		writer.write(offset);
+		writer.write(size);
+	}
+
+	auto getTextureIndex = [this](const vkglTF::Texture* texture) -> int32_t {
+		if (!texture) {
+			return -1;
+		}
+		if (texture == &emptyTexture) {
+			return -2;
+		}
+		return static_cast<int32_t>(texture - textures.data());
+	};
+	writer.write(static_cast<uint8_t>(metallicRoughnessWorkflow));
+	writer.write(static_cast<uint32_t>(materials.size()));
+	for (const Material& material : materials) {
+		writer.write(static_cast<uint32_t>(material.alphaMode));
+		writer.write(material.alphaCutoff);
+		writer.write(material.metallicFactor);
+		writer.write(material.roughnessFactor);
+		writer.write(material.baseColorFactor);
+		writer.write(getTextureIndex(material.baseColorTexture));
+		writer.write(getTextureIndex(material.metallicRoughnessTexture));
+		writer.write(getTextureIndex(material.normalTexture));
+		writer.write(getTextureIndex(material.occlusionTexture));
+		writer.write(getTextureIndex(material.emissiveTexture));
+	}
+
+	// Nodes are stored in the order of linearNodes with parents referenced by their position in that list
+	std::unordered_map<const Node*, int32_t> linearNodeIndices;
+	for (size_t i = 0; i < linearNodes.size(); i++) {
+		linearNodeIndices[linearNodes[i]] = static_cast<int32_t>(i);
+	}
+	writer.write(static_cast<uint32_t>(meshTable.size()));
+	for (const auto& primitives : meshTable) {
+		writer.write(static_cast<uint32_t>(primitives.size()));
+		for (const Primitive* primitive : primitives) {
+			writer.write(primitive->firstIndex);
+			writer.write(primitive->indexCount);
+			writer.write(primitive->firstVertex);
+			writer.write(primitive->vertexCount);
+			writer.write(static_cast<uint32_t>(&primitive->material - materials.data()));
+			writer.write(primitive->dimensions.min);
+			writer.write(primitive->dimensions.max);
+			writer.writeVector(primitive->lods);
+			writer.write(primitive->firstMeshlet);
+			writer.write(primitive->meshletCount);
+		}
+	}
+	writer.writeVector(instanceData);
+	writer.writeVector(meshlets);
+	writer.writeVector(meshletBounds);
+	writer.writeVector(meshletVertices);
+	writer.writeVector(meshletTriangles);
+
+	writer.write(static_cast<uint32_t>(linearNodes.size()));
+	for (const Node* node : linearNodes) {
+		writer.write(node->index);
+		writer.write(node->parent ? linearNodeIndices[node->parent] : -1);
+		writer.writeString(node->name);
+		writer.write(node->skinIndex);
+		writer.write(node->matrix);
+		writer.write(node->translation);
+		writer.write(node->scale);
+		writer.write(node->rotation);
+		writer.write(static_cast<uint8_t>(node->mesh != nullptr));
+		if (node->mesh) {
+			writer.writeString(node->mesh->name);
+			writer.write(node->mesh->meshIndex);
+			writer.write(node->firstInstance);
+			writer.write(node->instanceCount);
+		}
+	}
+
+	writer.write(static_cast<uint32_t>(skins.size()));
+	for (const Skin* skin : skins) {
+		writer.writeString(skin->name);
+		writer.write(skin->skeletonRoot ? static_cast<int32_t>(skin->skeletonRoot->index) : -1);
+		std::vector<uint32_t> joints;
+		for (const Node* joint : skin->joints) {
+			joints.push_back(joint->index);
+		}
+		writer.writeVector(joints);
+		writer.writeVector(skin->inverseBindMatrices);
+	}
+
+	writer.write(static_cast<uint32_t>(animations.size()));
+	for (const Animation& animation : animations) {
+		writer.writeString(animation.name);
+		writer.write(animation.start);
+		writer.write(animation.end);
+		writer.write(static_cast<uint32_t>(animation.samplers.size()));
+		for (const AnimationSampler& sampler : animation.samplers) {
+			writer.write(static_cast<uint32_t>(sampler.interpolation));
+			writer.writeVector(sampler.inputs);
+			writer.writeVector(sampler.outputsVec4);
+			writer.write(static_cast<uint8_t>(sampler.compressed));
+			writer.write(static_cast<uint8_t>(sampler.quantizedRotation));
+			writer.writeVector(sampler.quantizedOutputs);
+			writer.write(sampler.quantizationMin);
+			writer.write(sampler.quantizationScale);
+		}
+		writer.write(static_cast<uint32_t>(animation.channels.size()));
+		for (const AnimationChannel& channel : animation.channels) {
+			writer.write(static_cast<uint32_t>(channel.path));
+			writer.write(channel.node->index);
+			writer.write(channel.samplerIndex);
+		}
+	}
+
+	writer.write(static_cast<uint32_t>(vertexBufferSize / (packedVertices ? sizeof(PackedVertex) : sizeof(Vertex))));
+	writer.write(static_cast<uint64_t>(vertexBufferSize));
+	writer.writeData(vertexData, vertexBufferSize);
+	writer.writeVector(indexBuffer);
+
+	const uint64_t cacheSize = writer.data.size();
+	memcpy(writer.data.data() + 2 * sizeof(uint32_t), &cacheSize, sizeof(uint64_t));
+
+	std::ofstream file(cacheFilename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open()) {
+		std::cerr << "Could not write mesh cache " << cacheFilename << std::endl;
+		return;
+	}
+	file.write(reinterpret_cast<const char*>(writer.data.data()), writer.data.size());
+}
+
+/**
+* Load the model from a mesh cache file
+*
+* @param cacheFilename Name of the cache file to load
+* @param filename Name of the glTF file the cache was built from
+* @param fileLoadingFlags Flags the model is loaded with
+* @param scale Scale the model is loaded with
+*
+* @return True if the cache was up to date and the model has been loaded from it
+*
+* @note Doesn't touch any queue, images and geometry are left in pendingUpload
+*/
+bool vkglTF::Model::loadFromCache(const std::string& cacheFilename, const std::string& filename, uint32_t fileLoadingFlags, float scale)
+{
+	vks::tools::MappedFile cacheFile;
+	if (!cacheFile.open(cacheFilename)) {
+		return false;
+	}
+	CacheReader reader(cacheFile.data(), cacheFile.size());
+
+	const uint32_t magic = reader.read<uint32_t>();
+	const uint32_t version = reader.read<uint32_t>();
+	const uint64_t cacheSize = reader.read<uint64_t>();
+	const uint32_t cacheFileLoadingFlags = reader.read<uint32_t>();
+	const float cacheScale = reader.read<float>();
+	const uint32_t vertexStride = reader.read<uint32_t>();
+	const uint32_t cacheLodLevelCount = reader.read<uint32_t>();
+	const bool packed = (fileLoadingFlags & FileLoadingFlags::PackVertices);
+	if (!reader.valid || (magic != meshCacheMagic) || (version != meshCacheVersion) || (cacheSize != cacheFile.size()) || (cacheFileLoadingFlags != fileLoadingFlags) || (cacheScale != scale) || (vertexStride != (packed ? sizeof(PackedVertex) : sizeof(Vertex))) || (cacheLodLevelCount != lodLevelCount)) {
+		return false;
+	}
+
+	// The cache is outdated if any of the files it was built from has changed
+	const uint32_t dependencyCount = reader.read<uint32_t>();
+	std::vector<vks::tools::MappedFile> dependencyFiles(dependencyCount);
+	for (uint32_t i = 0; i < dependencyCount; i++) {
+		const std::string dependency = reader.readString();
+		const uint64_t size = reader.read<uint64_t>();
+		const uint64_t hash = reader.read<uint64_t>();
+		if (!reader.valid || ((i == 0) && (dependency != filename)) || !dependencyFiles[i].open(dependency) || (dependencyFiles[i].size() != size) || (hashData(dependencyFiles[i].data(), dependencyFiles[i].size()) != hash)) {
+			return false;
+		}
+	}
+
+	// Read all images before anything else, so a missing image file can still fall back to loading the glTF file
+	std::vector<tinygltf::Image> images;
+	std::vector<std::vector<unsigned char>> encodedImages;
+	const uint32_t imageCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < imageCount) && reader.valid; i++) {
+		tinygltf::Image image;
+		image.uri = reader.readString();
+		const int32_t dependency = reader.read<int32_t>();
+		const uint64_t offset = reader.read<uint64_t>();
+		const uint64_t size = reader.read<uint64_t>();
+		std::string error, warning;
+		if (dependency >= 0) {
+			if ((dependency >= static_cast<int32_t>(dependencyFiles.size())) || (offset + size > dependencyFiles[dependency].size())) {
+				return false;
+			}
+			if (!loadImageDataFunc(&image, static_cast<int>(i), &error, &warning, 0, 0, dependencyFiles[dependency].data() + offset, static_cast<int>(size), &encodedImages)) {
+				return false;
+			}
+		} else {
+			// Images in external ktx files are loaded by the texture itself
+			const bool isKtx = (image.uri.find_last_of(".") != std::string::npos) && (image.uri.substr(image.uri.find_last_of(".") + 1) == "ktx");
+			vks::tools::MappedFile imageFile;
+			if (!isKtx && !imageFile.open(path + "/" + tinygltf::dlib::urldecode(image.uri))) {
+				return false;
+			}
+			if (!loadImageDataFunc(&image, static_cast<int>(i), &error, &warning, 0, 0, imageFile.data(), static_cast<int>(imageFile.size()), &encodedImages)) {
+				return false;
+			}
+		}
+		images.push_back(std::move(image));
+	}
+	if (!reader.valid) {
+		return false;
+	}
+
+	// Textures are only created on upload, but need to exist so materials can reference them
+	textures.resize(images.size());
+	pendingUpload->images = std::move(images);
+	pendingUpload->encodedImages = std::move(encodedImages);
+
+	auto getTexture = [this](int32_t index) -> vkglTF::Texture* {
+		if (index == -2) {
+			return &emptyTexture;
+		}
+		return (index >= 0) ? this->getTexture(static_cast<uint32_t>(index)) : nullptr;
+	};
+	metallicRoughnessWorkflow = reader.read<uint8_t>() != 0;
+	const uint32_t materialCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < materialCount) && reader.valid; i++) {
+		vkglTF::Material material(device);
+		material.alphaMode = static_cast<Material::AlphaMode>(reader.read<uint32_t>());
+		material.alphaCutoff = reader.read<float>();
+		material.metallicFactor = reader.read<float>();
+		material.roughnessFactor = reader.read<float>();
+		material.baseColorFactor = reader.read<glm::vec4>();
+		material.baseColorTexture = getTexture(reader.read<int32_t>());
+		material.metallicRoughnessTexture = getTexture(reader.read<int32_t>());
+		material.normalTexture = getTexture(reader.read<int32_t>());
+		material.occlusionTexture = getTexture(reader.read<int32_t>());
+		material.emissiveTexture = getTexture(reader.read<int32_t>());
+		materials.push_back(material);
+	}
+
+	if (!reader.valid || materials.empty()) {
+		vks::tools::exitFatal("Mesh cache \"" + cacheFilename + "\" is corrupt, delete it to rebuild it from the glTF file", -1);
+		return false;
+	}
+
+	const uint32_t meshCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < meshCount) && reader.valid; i++) {
+		std::vector<Primitive*> primitives;
+		const uint32_t primitiveCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; (j < primitiveCount) && reader.valid; j++) {
+			const uint32_t firstIndex = reader.read<uint32_t>();
+			const uint32_t indexCount = reader.read<uint32_t>();
+			const uint32_t firstVertex = reader.read<uint32_t>();
+			const uint32_t vertexCount = reader.read<uint32_t>();
+			const uint32_t materialIndex = reader.read<uint32_t>();
+			const glm::vec3 posMin = reader.read<glm::vec3>();
+			const glm::vec3 posMax = reader.read<glm::vec3>();
+			Primitive *newPrimitive = new Primitive(firstIndex, indexCount, materials[std::min(materialIndex, static_cast<uint32_t>(materials.size()) - 1)]);
+			newPrimitive->firstVertex = firstVertex;
+			newPrimitive->vertexCount = vertexCount;
+			newPrimitive->setDimensions(posMin, posMax);
+			newPrimitive->lods = reader.readVector<Primitive::LOD>();
+			newPrimitive->firstMeshlet = reader.read<uint32_t>();
+			newPrimitive->meshletCount = reader.read<uint32_t>();
+			primitives.push_back(newPrimitive);
+		}
+		meshTable.push_back(primitives);
+	}
+	instanceData = reader.readVector<InstanceData>();
+	meshlets = reader.readVector<Meshlet>();
+	meshletBounds = reader.readVector<MeshletBounds>();
+	meshletVertices = reader.readVector<uint32_t>();
+	meshletTriangles = reader.readVector<uint8_t>();
+
+	const uint32_t nodeCount = reader.read<uint32_t>();
+	std::vector<int32_t> parents;
+	for (uint32_t i = 0; (i < nodeCount) && reader.valid; i++) {
+		vkglTF::Node *newNode = new Node{};
+		newNode->index = reader.read<uint32_t>();
+		parents.push_back(reader.read<int32_t>());
+		newNode->name = reader.readString();
+		newNode->skinIndex = reader.read<int32_t>();
+		newNode->matrix = reader.read<glm::mat4>();
+		newNode->translation = reader.read<glm::vec3>();
+		newNode->scale = reader.read<glm::vec3>();
+		newNode->rotation = reader.read<glm::quat>();
+		linearNodes.push_back(newNode);
+		if (reader.read<uint8_t>() != 0) {
+			Mesh *newMesh = new Mesh(device, newNode->matrix);
+			newMesh->name = reader.readString();
+			newMesh->meshIndex = reader.read<uint32_t>();
+			if (newMesh->meshIndex < meshTable.size()) {
+				newMesh->primitives = meshTable[newMesh->meshIndex];
+			} else {
+				newMesh->meshIndex = 0;
+				reader.valid = false;
+			}
+			newNode->mesh = newMesh;
+			newNode->firstInstance = reader.read<uint32_t>();
+			newNode->instanceCount = reader.read<uint32_t>();
+			if ((newNode->firstInstance > 0) && (static_cast<size_t>(newNode->firstInstance) + newNode->instanceCount > instanceData.size())) {
+				newNode->firstInstance = 0;
+				newNode->instanceCount = 1;
+				reader.valid = false;
+			}
+		}
+	}
+	// Children were stored before their parents, so the hierarchy can only be linked once all nodes exist
+	for (size_t i = 0; i < linearNodes.size(); i++) {
+		if ((parents[i] >= 0) && (parents[i] < static_cast<int32_t>(linearNodes.size()))) {
+			linearNodes[i]->parent = linearNodes[parents[i]];
+			linearNodes[i]->parent->children.push_back(linearNodes[i]);
+		} else {
+			nodes.push_back(linearNodes[i]);
+		}
+	}
+
+	const uint32_t skinCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < skinCount) && reader.valid; i++) {
+		Skin *newSkin = new Skin{};
+		newSkin->name = reader.readString();
+		const int32_t skeletonRoot = reader.read<int32_t>();
+		if (skeletonRoot > -1) {
+			newSkin->skeletonRoot = nodeFromIndex(skeletonRoot);
+		}
+		for (uint32_t jointIndex : reader.readVector<uint32_t>()) {
+			newSkin->joints.push_back(nodeFromIndex(jointIndex));
+		}
+		newSkin->inverseBindMatrices = reader.readVector<glm::mat4>();
+		skins.push_back(newSkin);
+	}
+
+	const uint32_t animationCount = reader.read<uint32_t>();
+	for (uint32_t i = 0; (i < animationCount) && reader.valid; i++) {
+		vkglTF::Animation animation{};
+		animation.name = reader.readString();
+		animation.start = reader.read<float>();
+		animation.end = reader.read<float>();
+		const uint32_t samplerCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; (j < samplerCount) && reader.valid; j++) {
+			vkglTF::AnimationSampler sampler{};
+			sampler.interpolation = static_cast<AnimationSampler::InterpolationType>(reader.read<uint32_t>());
+			sampler.inputs = reader.readVector<float>();
+			sampler.outputsVec4 = reader.readVector<glm::vec4>();
+			sampler.compressed = reader.read<uint8_t>() != 0;
+			sampler.quantizedRotation = reader.read<uint8_t>() != 0;
+			sampler.quantizedOutputs = reader.readVector<uint16_t>();
+			sampler.quantizationMin = reader.read<glm::vec3>();
+			sampler.quantizationScale = reader.read<glm::vec3>();
+			animation.samplers.push_back(sampler);
+		}
+		const uint32_t channelCount = reader.read<uint32_t>();
+		for (uint32_t j = 0; (j < channelCount) && reader.valid; j++) {
+			vkglTF::AnimationChannel channel{};
+			channel.path = static_cast<AnimationChannel::PathType>(reader.read<uint32_t>());
+			channel.node = nodeFromIndex(reader.read<uint32_t>());
+			channel.samplerIndex = reader.read<uint32_t>();
+			animation.channels.push_back(channel);
+		}
+		animations.push_back(animation);
+	}
+
+	const uint32_t vertexCount = reader.read<uint32_t>();
+	const uint64_t vertexBufferSize = reader.read<uint64_t>();
+	const unsigned char* vertexData = reader.skip(static_cast<size_t>(vertexBufferSize));
+	const uint64_t indexCount = reader.read<uint64_t>();
+	const unsigned char* indexData = reader.skip(static_cast<size_t>(indexCount) * sizeof(uint32_t));
+	if (!reader.valid) {
+		vks::tools::exitFatal("Mesh cache \"" + cacheFilename + "\" is corrupt, delete it to rebuild it from the glTF file", -1);
+		return false;
+	}
+
+	// Assign skins
+	for (auto node : linearNodes) {
+		if (node->skinIndex > -1) {
+			node->skin = skins[node->skinIndex];
+		}
+	}
+	// Initial pose
+	buildTransforms();
+	createNodeBuffer();
+	updateNodes();
+
+	// Vertices are stored upload ready, so they're copied straight from the mapped cache into the staging buffer
+	packedVertices = packed;
+	pendingUpload->vertexData = vertexData;
+	pendingUpload->vertexBufferSize = static_cast<size_t>(vertexBufferSize);
+	pendingUpload->vertexCount = vertexCount;
+	pendingUpload->indexData = reinterpret_cast<const uint32_t*>(indexData);
+	pendingUpload->indexCount = static_cast<uint32_t>(indexCount);
+	pendingUpload->cacheFile = std::move(cacheFile);
+	return true;
+}
+
+void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device, VkQueue transferQueue, uint32_t fileLoadingFlags, float scale)
+{
+	this->device = device;
+	loadData(filename, fileLoadingFlags, scale);
+	uploadData(transferQueue);
+}
+
+/**
+* Start loading a model on a background thread
+*
+* @param filename Name of the glTF file to load
+* @param device Device used for resource creation
+* @param fileLoadingFlags Flags for the loading process (see vkglTF::FileLoadingFlags)
+* @param scale Global scale for the model
+*
+* @return Future that becomes ready once parsing and decoding has finished
+*
+* @note The model must not be used (or destroyed) before finishLoading returned true
+*/
+std::shared_future<void> vkglTF::Model::loadFromFileAsync(std::string filename, vks::VulkanDevice *device, uint32_t fileLoadingFlags, float scale)
+{
+	this->device = device;
+	pendingLoad = std::async(std::launch::async, [this, filename, fileLoadingFlags, scale]() {
+		loadData(filename, fileLoadingFlags, scale);
+		// Nothing can be uploaded before finishLoading, so all images are decoded in the background
+		if (pendingUpload->loadImages) {
+			const std::vector<bool> srgbImages = bakeMipmaps ? getSrgbImages(materials, textures) : std::vector<bool>();
+			decodeImages(pendingUpload->images, pendingUpload->encodedImages, bakeMipmaps ? &srgbImages : nullptr, nullptr);
+		}
+	}).share();
+	return pendingLoad;
+}
+
+/**
+* Finish loading a model started with loadFromFileAsync by uploading its data, doesn't block if the background part hasn't finished yet
+*
+* @param transferQueue Queue used for texture and buffer uploads, this is the only place the loading process touches a queue
+*
+* @return True if the model is ready to be drawn
+*/
+bool vkglTF::Model::finishLoading(VkQueue transferQueue)
+{
+	if (pendingLoad.valid()) {
+		if (pendingLoad.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			return false;
+		}
+		pendingLoad = std::shared_future<void>();
+		uploadData(transferQueue);
+	}
+	return true;
+}
+
+/**
+* Load and decode all data of a glTF file (or its mesh cache) without touching a queue, so this can run on any thread
+*
+* @param filename Name of the glTF file to load
+* @param fileLoadingFlags Flags for the loading process (see vkglTF::FileLoadingFlags)
+* @param scale Global scale for the model
+*/
+void vkglTF::Model::loadData(const std::string& filename, uint32_t fileLoadingFlags, float scale)
+{
+	size_t pos = filename.find_last_of('/');
+	path = filename.substr(0, pos);
+
+	pendingUpload = std::make_shared<PendingUpload>();
+	pendingUpload->loadImages = !(fileLoadingFlags & FileLoadingFlags::DontLoadImages);
+	loadingFlags = fileLoadingFlags;
+	useIndirectDraws = (fileLoadingFlags & FileLoadingFlags::IndirectDraws);
+	retainGeometry = (fileLoadingFlags & FileLoadingFlags::RetainGeometry);
+	bakeMipmaps = (fileLoadingFlags & FileLoadingFlags::BakeMipmaps);
+
+#if !defined(__ANDROID__)
+	const std::string cacheFilename = filename + ".cache";
+	const bool useCache = (fileLoadingFlags & FileLoadingFlags::UseMeshCache);
+	if (useCache && loadFromCache(cacheFilename, filename, fileLoadingFlags, scale)) {
+		return;
+	}
+#endif
+
+	tinygltf::Model gltfModel;
+	tinygltf::TinyGLTF gltfContext;
+	if (fileLoadingFlags & FileLoadingFlags::DontLoadImages) {
+		gltfContext.SetImageLoader(loadImageDataFuncEmpty, nullptr);
+	} else {
+		gltfContext.SetImageLoader(loadImageDataFunc, &pendingUpload->encodedImages);
+	}
+#if defined(__ANDROID__)
+	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
+	// We let tinygltf handle this, by passing the asset manager of our app
+	tinygltf::asset_manager = androidApp->activity->assetManager;
+#endif
+
+	std::string error, warning;
+
+#if defined(__ANDROID__)
+	// On Android all assets are packed with the apk in a compressed form, so we need to open them using the asset manager
+	// We let tinygltf handle this, by passing the asset manager of our app
+	tinygltf::asset_manager = androidApp->activity->assetManager;
+	const bool binary = (filename.size() > 4) && (filename.substr(filename.size() - 4) == ".glb");
+	bool fileLoaded = binary ? gltfContext.LoadBinaryFromFile(&gltfModel, &error, &warning, filename) : gltfContext.LoadASCIIFromFile(&gltfModel, &error, &warning, filename);
+#else
+	bool fileLoaded = loadFromMappedFile(filename, gltfContext, gltfModel, error, warning);
+#endif
+
+	std::vector<uint32_t>& indexBuffer = pendingUpload->indexBuffer;
+	std::vector<Vertex>& vertexBuffer = pendingUpload->vertexBuffer;
+
+	if (fileLoaded) {
+		// Textures are only created on upload, but need to exist so materials can reference them
+		if (pendingUpload->loadImages) {
+			textures.resize(gltfModel.images.size());
+		}
+		loadMaterials(gltfModel);
+		const tinygltf::Scene &scene = gltfModel.scenes[gltfModel.defaultScene > -1 ? gltfModel.defaultScene : 0];
+		// Pre-transformed vertices bake the node's matrix into the geometry, so every node needs a copy of its mesh then
+		gltfMeshTableIndices.assign((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) ? 0 : gltfModel.meshes.size(), -1);
+		for (size_t i = 0; i < scene.nodes.size(); i++) {
+			const tinygltf::Node node = gltfModel.nodes[scene.nodes[i]];
+			loadNode(nullptr, node, scene.nodes[i], gltfModel, scale);
+		}
+		loadPrimitives(gltfModel, indexBuffer, vertexBuffer);
+		if (gltfModel.animations.size() > 0) {
+			loadAnimations(gltfModel);
+			if (fileLoadingFlags & FileLoadingFlags::CompressAnimations) {
+				compressAnimations();
+			}
+		}
+		loadSkins(gltfModel);
+
+		// Assign skins
+		for (auto node : linearNodes) {
+			if (node->skinIndex > -1) {
+				node->skin = skins[node->skinIndex];
+			}
+		}
+		// Initial pose
+		buildTransforms();
+		createNodeBuffer();
+		updateNodes();
+	}
+	else {
+		vks::tools::exitFatal("Could not load glTF file \"" + filename + "\": " + error, -1);
+		return;
+	}
+
+	// Pre-Calculations for requested features
+	if ((fileLoadingFlags & FileLoadingFlags::PreTransformVertices) || (fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors) || (fileLoadingFlags & FileLoadingFlags::FlipY)) {
+		const bool preTransform = fileLoadingFlags & FileLoadingFlags::PreTransformVertices;
+		const bool preMultiplyColor = fileLoadingFlags & FileLoadingFlags::PreMultiplyVertexColors;
+		const bool flipY = fileLoadingFlags & FileLoadingFlags::FlipY;
+		// Shared meshes must only be processed once
+		std::vector<bool> processedMeshes(meshTable.size(), false);
+		for (Node* node : linearNodes) {
+			if (node->mesh && !processedMeshes[node->mesh->meshIndex]) {
+				processedMeshes[node->mesh->meshIndex] = true;
+				const glm::mat4 localMatrix = node->getMatrix();
+				// Instances are applied before the node matrix, so they have to be moved into the pre-transformed space of the vertices
+				if (preTransform && (node->firstInstance > 0)) {
+					const glm::mat4 inverseMatrix = glm::inverse(localMatrix);
+					for (uint32_t i = 0; i < node->instanceCount; i++) {
+						glm::mat4& instanceMatrix = instanceData[node->firstInstance + i].matrix;
+						instanceMatrix = localMatrix * instanceMatrix * inverseMatrix;
+					}
+				}
+				for (Primitive* primitive : node->mesh->primitives) {
+					for (uint32_t i = 0; i < primitive->vertexCount; i++) {
+						Vertex& vertex = vertexBuffer[primitive->firstVertex + i];
+						// Pre-transform vertex positions by node-hierarchy
+						if (preTransform) {
+							vertex.pos = glm::vec3(localMatrix * glm::vec4(vertex.pos, 1.0f));
+							vertex.normal = glm::normalize(glm::mat3(localMatrix) * vertex.normal);
+						}
+						// Flip Y-Axis of vertex positions
+						if (flipY) {
+							vertex.pos.y *= -1.0f;
+							vertex.normal.y *= -1.0f;
+						}
+						// Pre-Multiply vertex colors with material base color
+						if (preMultiplyColor) {
+							vertex.color = primitive->material.baseColorFactor * vertex.color;
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (auto extension : gltfModel.extensionsUsed) {
 		if (extension == "KHR_materials_pbrSpecularGlossiness") {
 			std::cout << "Required extension: " << extension;
 			metallicRoughnessWorkflow = false;
 		}
 	}
 
-	size_t vertexBufferSize = vertexBuffer.size() * sizeof(Vertex);
-	size_t indexBufferSize = indexBuffer.size() * sizeof(uint32_t);
-	indices.count = static_cast<uint32_t>(indexBuffer.size());
-	vertices.count = static_cast<uint32_t>(vertexBuffer.size());
+	if ((fileLoadingFlags & FileLoadingFlags::OptimizeMeshes) || (fileLoadingFlags & FileLoadingFlags::GenerateLods)) {
+		optimizeMeshes(vertexBuffer, indexBuffer, fileLoadingFlags & FileLoadingFlags::OptimizeMeshes, (fileLoadingFlags & FileLoadingFlags::GenerateLods) ? lodLevelCount : 0);
+	}
+	if (fileLoadingFlags & FileLoadingFlags::BuildMeshlets) {
+		// Mirroring the positions reverses the winding of all triangles
+		buildMeshlets(vertexBuffer, indexBuffer, fileLoadingFlags & FileLoadingFlags::FlipY);
+	}
 
-	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
+	// Pack vertices after all pre-calculations, as those need the full precision vertex data
+	std::vector<PackedVertex>& packedVertexBuffer = pendingUpload->packedVertexBuffer;
+	packedVertices = (fileLoadingFlags & FileLoadingFlags::PackVertices);
+	if (packedVertices) {
+		packedVertexBuffer.resize(vertexBuffer.size());
+		for (size_t i = 0; i < vertexBuffer.size(); i++) {
+			packedVertexBuffer[i] = PackedVertex::pack(vertexBuffer[i]);
+		}
+	}
 
-	struct StagingBuffer {
-		VkBuffer buffer;
-		VkDeviceMemory memory;
-	} vertexStaging, indexStaging;
+	pendingUpload->vertexData = packedVertices ? static_cast<const void*>(packedVertexBuffer.data()) : static_cast<const void*>(vertexBuffer.data());
+	pendingUpload->vertexBufferSize = vertexBuffer.size() * (packedVertices ? sizeof(PackedVertex) : sizeof(Vertex));
+	pendingUpload->vertexCount = static_cast<uint32_t>(vertexBuffer.size());
+	pendingUpload->indexData = indexBuffer.data();
+	pendingUpload->indexCount = static_cast<uint32_t>(indexBuffer.size());
 
-	// Create staging buffers
-	// Vertex data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		vertexBufferSize,
-		&vertexStaging.buffer,
-		&vertexStaging.memory,
-		vertexBuffer.data()));
-	// Index data
-	VK_CHECK_RESULT(device->createBuffer(
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-		indexBufferSize,
-		&indexStaging.buffer,
-		&indexStaging.memory,
-		indexBuffer.data()));
+#if !defined(__ANDROID__)
+	if (useCache) {
+		writeCache(cacheFilename, filename, gltfModel, fileLoadingFlags, scale, pendingUpload->vertexData, pendingUpload->vertexBufferSize, indexBuffer);
+	}
+#endif
+
+	pendingUpload->images = std::move(gltfModel.images);
+}
+
+/**
+* Upload everything loadData decoded, must be called from the thread that owns the transfer queue
+* All textures and buffers are recorded into one upload batch, so the whole model costs a single submit and wait
+*
+* @param transferQueue Queue used for texture and buffer uploads
+*/
+void vkglTF::Model::uploadData(VkQueue transferQueue)
+{
+	vks::UploadBatch uploadBatch(device, transferQueue);
+	if (pendingUpload->loadImages) {
+		uploadImages(pendingUpload->images, device, uploadBatch, &pendingUpload->encodedImages);
+	}
+	createBuffers(pendingUpload->vertexData, pendingUpload->vertexBufferSize, pendingUpload->vertexCount, pendingUpload->indexData, pendingUpload->indexCount, uploadBatch);
+	if (useIndirectDraws) {
+		createIndirectDraws(uploadBatch);
+	}
+	if (retainGeometry) {
+		// Positions are stored first in both vertex layouts
+		const size_t vertexStride = packedVertices ? sizeof(PackedVertex) : sizeof(Vertex);
+		const unsigned char* vertexData = static_cast<const unsigned char*>(pendingUpload->vertexData);
+		retainedPositions.resize(pendingUpload->vertexCount);
+		for (uint32_t i = 0; i < pendingUpload->vertexCount; i++) {
+			memcpy(&retainedPositions[i], vertexData + i * vertexStride, sizeof(glm::vec3));
+		}
+		retainedIndices.assign(pendingUpload->indexData, pendingUpload->indexData + pendingUpload->indexCount);
+	}
+	uploadBatch.flush();
+	pendingUpload.reset();
+	setupDescriptors();
+}
+
+/**
+* Create the device local vertex and index buffers and upload the model's geometry
+*
+* @param vertexData Vertex data to upload, either in Vertex or PackedVertex layout
+* @param vertexBufferSize Size of the vertex data in bytes
+* @param vertexCount Number of vertices
+* @param indexData Index data to upload
+* @param indexCount Number of indices
+* @param uploadBatch Batch the buffer copies are recorded to
+*/
+void vkglTF::Model::createBuffers(const void* vertexData, size_t vertexBufferSize, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount, vks::UploadBatch& uploadBatch)
+{
+	size_t indexBufferSize = indexCount * sizeof(uint32_t);
+	indices.count = static_cast<int>(indexCount);
+	vertices.count = static_cast<int>(vertexCount);
+
+	assert((vertexBufferSize > 0) && (indexBufferSize > 0));
 
 	// Create device local buffers
 	// Vertex buffer
@@ -1310,41 +2898,68 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 		&indices.buffer,
 		&indices.memory));
 
-	// Copy from staging buffers
-	VkCommandBuffer copyCmd = device->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-	VkBufferCopy copyRegion = {};
-
-	copyRegion.size = vertexBufferSize;
-	vkCmdCopyBuffer(copyCmd, vertexStaging.buffer, vertices.buffer, 1, &copyRegion);
-
-	copyRegion.size = indexBufferSize;
-	vkCmdCopyBuffer(copyCmd, indexStaging.buffer, indices.buffer, 1, &copyRegion);
-
-	device->flushCommandBuffer(copyCmd, transferQueue, true);
+	uploadBatch.copyToBuffer(vertices.buffer, vertexData, vertexBufferSize);
+	uploadBatch.copyToBuffer(indices.buffer, indexData, indexBufferSize);
+
+	// Instance buffer
+	if (!instanceData.empty()) {
+		const VkDeviceSize instanceBufferSize = instanceData.size() * sizeof(InstanceData);
+		instances.count = static_cast<int>(instanceData.size());
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			instanceBufferSize,
+			&instances.buffer,
+			&instances.memory));
+		uploadBatch.copyToBuffer(instances.buffer, instanceData.data(), instanceBufferSize);
+	}
 
-	vkDestroyBuffer(device->logicalDevice, vertexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, vertexStaging.memory, nullptr);
-	vkDestroyBuffer(device->logicalDevice, indexStaging.buffer, nullptr);
-	vkFreeMemory(device->logicalDevice, indexStaging.memory, nullptr);
+	// Meshlet buffer
+	if (!meshlets.empty()) {
+		const VkDeviceSize storageAlignment = std::max(device->properties.limits.minStorageBufferOffsetAlignment, static_cast<VkDeviceSize>(4));
+		VkDeviceSize meshletBufferSize = 0;
+		auto addRange = [&](VkDescriptorBufferInfo& descriptor, VkDeviceSize size) {
+			meshletBufferSize = (meshletBufferSize + storageAlignment - 1) / storageAlignment * storageAlignment;
+			descriptor = { VK_NULL_HANDLE, meshletBufferSize, size };
+			meshletBufferSize += size;
+		};
+		addRange(meshletBuffer.meshlets, meshlets.size() * sizeof(Meshlet));
+		addRange(meshletBuffer.bounds, meshletBounds.size() * sizeof(MeshletBounds));
+		addRange(meshletBuffer.vertices, meshletVertices.size() * sizeof(uint32_t));
+		// Shaders read the packed triangles as 32 bit words
+		addRange(meshletBuffer.triangles, (meshletTriangles.size() + 3) & ~static_cast<VkDeviceSize>(3));
+		VK_CHECK_RESULT(device->createBuffer(
+			VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | memoryPropertyFlags,
+			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+			meshletBufferSize,
+			&meshletBuffer.buffer,
+			&meshletBuffer.memory));
+		for (VkDescriptorBufferInfo* descriptor : { &meshletBuffer.meshlets, &meshletBuffer.bounds, &meshletBuffer.vertices, &meshletBuffer.triangles }) {
+			descriptor->buffer = meshletBuffer.buffer;
+		}
+		uploadBatch.copyToBuffer(meshletBuffer.buffer, meshlets.data(), meshletBuffer.meshlets.range, meshletBuffer.meshlets.offset);
+		uploadBatch.copyToBuffer(meshletBuffer.buffer, meshletBounds.data(), meshletBuffer.bounds.range, meshletBuffer.bounds.offset);
+		uploadBatch.copyToBuffer(meshletBuffer.buffer, meshletVertices.data(), meshletBuffer.vertices.range, meshletBuffer.vertices.offset);
+		uploadBatch.copyToBuffer(meshletBuffer.buffer, meshletTriangles.data(), meshletTriangles.size(), meshletBuffer.triangles.offset);
+	}
+}
 
+/** @brief Calculates the scene dimensions and sets up the descriptors for all nodes and materials */
+void vkglTF::Model::setupDescriptors()
+{
 	getSceneDimensions();
 
 	// Setup descriptors
-	uint32_t uboCount{ 0 };
 	uint32_t imageCount{ 0 };
-	for (auto node : linearNodes) {
-		if (node->mesh) {
-			uboCount++;
-		}
-	}
 	for (auto material : materials) {
 		if (material.baseColorTexture != nullptr) {
 			imageCount++;
 		}
 	}
+	// All meshes share one node descriptor set
 	std::vector<VkDescriptorPoolSize> poolSizes = {
-		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uboCount },
+		{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1 },
+		{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 },
 	};
 	if (imageCount > 0) {
 		if (descriptorBindingFlags & DescriptorBindingFlags::ImageBaseColor) {
@@ -1358,15 +2973,16 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 	descriptorPoolCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
 	descriptorPoolCI.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	descriptorPoolCI.pPoolSizes = poolSizes.data();
-	descriptorPoolCI.maxSets = uboCount + imageCount;
+	descriptorPoolCI.maxSets = 1 + imageCount;
 	VK_CHECK_RESULT(vkCreateDescriptorPool(device->logicalDevice, &descriptorPoolCI, nullptr, &descriptorPool));
 
-	// Descriptors for per-node uniform buffers
+	// Descriptors for the node buffer
 	{
 		// Layout is global, so only create if it hasn't already been created before
 		if (descriptorSetLayoutUbo == VK_NULL_HANDLE) {
 			std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_SHADER_STAGE_VERTEX_BIT, 0),
+				vks::initializers::descriptorSetLayoutBinding(VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_VERTEX_BIT, 1),
 			};
 			VkDescriptorSetLayoutCreateInfo descriptorLayoutCI{};
 			descriptorLayoutCI.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
@@ -1374,6 +2990,15 @@ void vkglTF::Model::loadFromFile(std::string filename, vks::VulkanDevice *device
 			descriptorLayoutCI.pBindings = setLayoutBindings.data();
 			VK_CHECK_RESULT(vkCreateDescriptorSetLayout(device->logicalDevice, &descriptorLayoutCI, nullptr, &descriptorSetLayoutUbo));
 		}
+		VkDescriptorSetAllocateInfo descriptorSetAllocInfo = vks::initializers::descriptorSetAllocateInfo(descriptorPool, &descriptorSetLayoutUbo, 1);
+		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &nodeDescriptorSet));
+		// The uniform block range is selected per mesh with its dynamic offset, shaders index the joint matrices with the jointOffset from the uniform block
+		VkDescriptorBufferInfo uniformDescriptor = { nodeBuffer.buffer, 0, sizeof(Mesh::UniformBlock) };
+		std::vector<VkWriteDescriptorSet> writeDescriptorSets = {
+			vks::initializers::writeDescriptorSet(nodeDescriptorSet, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 0, &uniformDescriptor),
+			vks::initializers::writeDescriptorSet(nodeDescriptorSet, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, &jointDescriptor),
+		};
+		vkUpdateDescriptorSets(device->logicalDevice, static_cast<uint32_t>(writeDescriptorSets.size()), writeDescriptorSets.data(), 0, nullptr);
 		for (auto node : nodes) {
 			prepareNodeDescriptor(node, descriptorSetLayoutUbo);
 		}
@@ -1408,30 +3033,43 @@ void vkglTF::Model::bindBuffers(VkCommandBuffer commandBuffer)
 {
 	const VkDeviceSize offsets[1] = {0};
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+	if (instances.buffer != VK_NULL_HANDLE) {
+		vkCmdBindVertexBuffers(commandBuffer, instanceBufferBinding, 1, &instances.buffer, offsets);
+	}
 	vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	buffersBound = true;
 }
 
+namespace
+{
+	// Returns true if the render flags exclude the alpha mode of a material
+	bool skipMaterial(const vkglTF::Material& material, uint32_t renderFlags)
+	{
+		bool skip = false;
+		if (renderFlags & vkglTF::RenderFlags::RenderOpaqueNodes) {
+			skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_OPAQUE);
+		}
+		if (renderFlags & vkglTF::RenderFlags::RenderAlphaMaskedNodes) {
+			skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_MASK);
+		}
+		if (renderFlags & vkglTF::RenderFlags::RenderAlphaBlendedNodes) {
+			skip = (material.alphaMode != vkglTF::Material::ALPHAMODE_BLEND);
+		}
+		return skip;
+	}
+}
+
 void vkglTF::Model::drawNode(Node *node, VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
 {
 	if (node->mesh) {
 		for (Primitive* primitive : node->mesh->primitives) {
-			bool skip = false;
 			const vkglTF::Material& material = primitive->material;
-			if (renderFlags & RenderFlags::RenderOpaqueNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_OPAQUE);
-			}
-			if (renderFlags & RenderFlags::RenderAlphaMaskedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_MASK);
-			}
-			if (renderFlags & RenderFlags::RenderAlphaBlendedNodes) {
-				skip = (material.alphaMode != Material::ALPHAMODE_BLEND);
-			}
-			if (!skip) {
+			if (!skipMaterial(material, renderFlags)) {
 				if (renderFlags & RenderFlags::BindImages) {
 					vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
 				}
-				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, 1, primitive->firstIndex, 0, 0);
+				// All instances of a node are drawn with a single call
+				vkCmdDrawIndexed(commandBuffer, primitive->indexCount, node->instanceCount, primitive->firstIndex, 0, node->firstInstance);
 			}
 		}
 	}
@@ -1445,25 +3083,457 @@ void vkglTF::Model::draw(VkCommandBuffer commandBuffer, uint32_t renderFlags, Vk
 	if (!buffersBound) {
 		const VkDeviceSize offsets[1] = {0};
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertices.buffer, offsets);
+		if (instances.buffer != VK_NULL_HANDLE) {
+			vkCmdBindVertexBuffers(commandBuffer, instanceBufferBinding, 1, &instances.buffer, offsets);
+		}
 		vkCmdBindIndexBuffer(commandBuffer, indices.buffer, 0, VK_INDEX_TYPE_UINT32);
 	}
+	if (frustumCulling) {
+		drawVisible(commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+		return;
+	}
+	if (indirectDraws.buffer != VK_NULL_HANDLE) {
+		drawIndirect(commandBuffer, renderFlags, pipelineLayout, bindImageSet);
+		return;
+	}
 	for (auto& node : nodes) {
 		drawNode(node, commandBuffer, renderFlags, pipelineLayout, bindImageSet);
 	}
 }
 
+/**
+* Test the bounds of all primitives against a frustum and store the visible ones for draw
+*
+* @param frustum Frustum in the model's world space, e.g. updated with projection * view * model matrix
+* @param cameraPosition (Optional) Camera position in the model's world space, used for level of detail selection
+* @param lodScale (Optional) Pixels per world unit at a distance of one, i.e. viewport height / (2 * tan(fovy / 2)), 0 always draws the full detail primitives
+* @param maxPixelError (Optional) Largest acceptable screen space error of a selected level of detail in pixels
+*
+* @note Skinned primitives are never culled, as their bounds only cover the bind pose
+* @note Command buffers recorded by draw only see the result of the cull call made before recording them
+*/
+void vkglTF::Model::cull(const vks::Frustum& frustum, const glm::vec3& cameraPosition, float lodScale, float maxPixelError)
+{
+	visiblePrimitives.clear();
+	cullingStats = {};
+	frustumCulling = true;
+	std::vector<glm::mat4> matrices;
+	// Same order as the recursive draw
+	std::vector<Node*> stack(nodes.rbegin(), nodes.rend());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+		if (!node->mesh) {
+			continue;
+		}
+		// Primitive bounds come from the accessors, so they miss the pre-transform and flip loadData applied to the vertex buffer
+		glm::mat4 boundsMatrix = (loadingFlags & FileLoadingFlags::PreTransformVertices) ? node->getMatrix() : glm::mat4(1.0f);
+		if (loadingFlags & FileLoadingFlags::FlipY) {
+			boundsMatrix = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f)) * boundsMatrix;
+		}
+		matrices.resize(node->instanceCount);
+		for (uint32_t instance = 0; instance < node->instanceCount; instance++) {
+			matrices[instance] = getVertexMatrix(node, instance) * boundsMatrix;
+		}
+		for (Primitive* primitive : node->mesh->primitives) {
+			if (node->skin) {
+				visiblePrimitives.push_back({ node, primitive, primitive->firstIndex, primitive->indexCount });
+				continue;
+			}
+			cullingStats.tested++;
+			const glm::vec3 extents = primitive->dimensions.size * 0.5f;
+			bool visible = false;
+			// All instances share one draw, so the level of detail has to satisfy the closest visible instance
+			float pixelsPerUnit = 0.0f;
+			for (const glm::mat4& matrix : matrices) {
+				// World space box enclosing the transformed local box
+				const glm::vec3 center = glm::vec3(matrix * glm::vec4(primitive->dimensions.center, 1.0f));
+				const glm::vec3 worldExtents = glm::abs(glm::vec3(matrix[0])) * extents.x + glm::abs(glm::vec3(matrix[1])) * extents.y + glm::abs(glm::vec3(matrix[2])) * extents.z;
+				if (!frustum.checkBox(center, worldExtents)) {
+					continue;
+				}
+				visible = true;
+				if ((lodScale <= 0.0f) || primitive->lods.empty()) {
+					break;
+				}
+				// Distance to the box instead of its center, so the camera being inside the bounds selects the full detail
+				const float distance = glm::length(glm::max(glm::abs(cameraPosition - center) - worldExtents, glm::vec3(0.0f)));
+				const float matrixScale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+				pixelsPerUnit = (distance > 0.0f) ? std::max(pixelsPerUnit, lodScale * matrixScale / distance) : FLT_MAX;
+			}
+			if (visible) {
+				const uint32_t level = (lodScale > 0.0f) ? primitive->selectLod(pixelsPerUnit, maxPixelError) : 0;
+				if (level > 0) {
+					const Primitive::LOD& lod = primitive->lods[level - 1];
+					visiblePrimitives.push_back({ node, primitive, lod.firstIndex, lod.indexCount });
+				} else {
+					visiblePrimitives.push_back({ node, primitive, primitive->firstIndex, primitive->indexCount });
+				}
+			} else {
+				cullingStats.culled++;
+			}
+		}
+	}
+}
+
+/**
+* CPU reference of per meshlet frustum and backface culling as done by a task or mesh shader
+*
+* @param frustum Frustum in the model's world space, e.g. updated with projection * view * model matrix
+* @param cameraPosition Camera position in the model's world space
+* @param visibleMeshlets (Optional) Receives the indices of the visible meshlets in draw order, meshlets of instanced nodes are listed once per node
+*
+* @return Number of visible meshlets, culling rates are stored in meshletCullingStats
+*
+* @note Skinned primitives are never culled, the cone test assumes node matrices without non-uniform scale
+*/
+uint32_t vkglTF::Model::cullMeshlets(const vks::Frustum& frustum, const glm::vec3& cameraPosition, std::vector<uint32_t>* visibleMeshlets)
+{
+	meshletCullingStats = {};
+	if (visibleMeshlets) {
+		visibleMeshlets->clear();
+	}
+	uint32_t visibleCount = 0;
+	std::vector<glm::mat4> matrices;
+	std::vector<glm::vec3> localCameraPositions;
+	std::vector<Node*> stack(nodes.rbegin(), nodes.rend());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+		if (!node->mesh) {
+			continue;
+		}
+		matrices.clear();
+		localCameraPositions.clear();
+		for (uint32_t instance = 0; instance < node->instanceCount; instance++) {
+			matrices.push_back(getVertexMatrix(node, instance));
+			// Backface tests are done in the space of the bounds
+			localCameraPositions.push_back(glm::vec3(glm::inverse(matrices.back()) * glm::vec4(cameraPosition, 1.0f)));
+		}
+		for (Primitive* primitive : node->mesh->primitives) {
+			for (uint32_t i = primitive->firstMeshlet; i < primitive->firstMeshlet + primitive->meshletCount; i++) {
+				bool visible = (node->skin != nullptr);
+				if (!visible) {
+					meshletCullingStats.tested++;
+					const MeshletBounds& bounds = meshletBounds[i];
+					bool insideFrustum = false;
+					for (size_t instance = 0; (instance < matrices.size()) && !visible; instance++) {
+						const glm::mat4& matrix = matrices[instance];
+						const float matrixScale = std::max(glm::length(glm::vec3(matrix[0])), std::max(glm::length(glm::vec3(matrix[1])), glm::length(glm::vec3(matrix[2]))));
+						if (!frustum.checkSphere(glm::vec3(matrix * glm::vec4(glm::vec3(bounds.sphere), 1.0f)), bounds.sphere.w * matrixScale)) {
+							continue;
+						}
+						insideFrustum = true;
+						visible = !meshlets::isBackfacing(bounds, localCameraPositions[instance]);
+					}
+					if (!visible) {
+						if (insideFrustum) {
+							meshletCullingStats.backfaceCulled++;
+						} else {
+							meshletCullingStats.frustumCulled++;
+						}
+						continue;
+					}
+				}
+				visibleCount++;
+				if (visibleMeshlets) {
+					visibleMeshlets->push_back(i);
+				}
+			}
+		}
+	}
+	return visibleCount;
+}
+
+/**
+* Build the bounding volume hierarchy over the triangles of all mesh nodes for CPU ray queries
+*
+* @param jobSystem (Optional) Job system used to build the hierarchy in parallel
+*
+* @note Requires the model to be loaded with FileLoadingFlags::RetainGeometry
+* @note Skinned meshes are added in their bind pose
+*/
+void vkglTF::Model::buildBvh(vks::JobSystem* jobSystem)
+{
+	assert(retainGeometry && "Building a bvh requires the model to be loaded with FileLoadingFlags::RetainGeometry");
+	bvhRanges.clear();
+	uint32_t triangleCount = 0;
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		for (uint32_t instance = 0; instance < node->instanceCount; instance++) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				bvhRanges.push_back({ node, primitive, instance, triangleCount });
+				triangleCount += primitive->indexCount / 3;
+			}
+		}
+	}
+	bvhVertices.resize(triangleCount * 3);
+	updateBvhVertices(jobSystem);
+	bvh.build(bvhVertices.data(), triangleCount, jobSystem);
+}
+
+/**
+* Update the bounding volume hierarchy to the current node transforms, e.g. after updateAnimation
+*
+* @param jobSystem (Optional) Job system used to transform the triangles and refit the hierarchy in parallel
+*/
+void vkglTF::Model::refitBvh(vks::JobSystem* jobSystem)
+{
+	updateBvhVertices(jobSystem);
+	bvh.refit(bvhVertices.data(), jobSystem);
+}
+
+/** @brief Transform the retained triangles of all bvh ranges into the model's space */
+void vkglTF::Model::updateBvhVertices(vks::JobSystem* jobSystem)
+{
+	// Node matrices are resolved up front, as the transform hierarchy must not be updated from multiple threads
+	std::vector<glm::mat4> matrices(bvhRanges.size());
+	for (size_t i = 0; i < bvhRanges.size(); i++) {
+		const BvhRange& range = bvhRanges[i];
+		if ((i > 0) && (bvhRanges[i - 1].node == range.node) && (bvhRanges[i - 1].instance == range.instance)) {
+			matrices[i] = matrices[i - 1];
+			continue;
+		}
+		matrices[i] = getVertexMatrix(range.node, range.instance);
+	}
+	auto transformRange = [this, &matrices](uint32_t i) {
+		const BvhRange& range = bvhRanges[i];
+		const glm::mat4& matrix = matrices[i];
+		const uint32_t* indices = &retainedIndices[range.primitive->firstIndex];
+		glm::vec3* vertices = &bvhVertices[range.firstTriangle * 3];
+		for (uint32_t j = 0; j < range.primitive->indexCount / 3 * 3; j++) {
+			vertices[j] = glm::vec3(matrix * glm::vec4(retainedPositions[indices[j]], 1.0f));
+		}
+	};
+	if (jobSystem) {
+		jobSystem->parallelFor(static_cast<uint32_t>(bvhRanges.size()), 1, transformRange);
+	} else {
+		for (uint32_t i = 0; i < bvhRanges.size(); i++) {
+			transformRange(i);
+		}
+	}
+}
+
+/**
+* Get the matrix that moves the vertices of a node instance from the vertex buffer into the model's space
+*
+* @note Pre-transformed vertices already contain the node matrix (and the flip of FileLoadingFlags::FlipY), so only the instance matrix is left, which loadData moved into their space
+*/
+glm::mat4 vkglTF::Model::getVertexMatrix(Node* node, uint32_t instance) const
+{
+	const glm::mat4 instanceMatrix = instanceData.empty() ? glm::mat4(1.0f) : instanceData[node->firstInstance + instance].matrix;
+	if (loadingFlags & FileLoadingFlags::PreTransformVertices) {
+		return instanceMatrix;
+	}
+	return node->getMatrix() * instanceMatrix;
+}
+
+/**
+* Find the closest triangle hit by a ray
+*
+* @param origin Ray origin in the model's space
+* @param direction Ray direction in the model's space, distances are returned in multiples of its length
+* @param maxDistance Hits further away than this are ignored
+* @param hit Receives the closest hit
+*
+* @return True if the ray hit a triangle
+*/
+bool vkglTF::Model::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RaycastHit& hit) const
+{
+	Bvh::Ray ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.tMax = maxDistance;
+	Bvh::Hit bvhHit;
+	if (!bvh.intersect(ray, bvhHit)) {
+		return false;
+	}
+	// Ranges are sorted by their first triangle
+	const auto range = std::upper_bound(bvhRanges.begin(), bvhRanges.end(), bvhHit.triangle, [](uint32_t triangle, const BvhRange& range) {
+		return triangle < range.firstTriangle;
+	}) - 1;
+	hit.node = range->node;
+	hit.primitive = range->primitive;
+	hit.instance = range->instance;
+	hit.triangle = bvhHit.triangle - range->firstTriangle;
+	hit.distance = bvhHit.t;
+	hit.position = origin + direction * bvhHit.t;
+	hit.barycentrics = glm::vec2(bvhHit.u, bvhHit.v);
+	return true;
+}
+
+/**
+* Check if any triangle blocks a ray, e.g. for visibility or shadow tests
+*
+* @param origin Ray origin in the model's space
+* @param direction Ray direction in the model's space
+* @param maxDistance Only triangles closer than this in multiples of the direction's length are considered
+*
+* @return True if the ray hit a triangle
+*/
+bool vkglTF::Model::occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const
+{
+	Bvh::Ray ray;
+	ray.origin = origin;
+	ray.direction = direction;
+	ray.tMax = maxDistance;
+	return bvh.occluded(ray);
+}
+
+/**
+* Draw the primitives that passed the last culling pass, material descriptor sets are only rebound when the material changes
+*/
+void vkglTF::Model::drawVisible(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+{
+	const Material* boundMaterial = nullptr;
+	for (const VisiblePrimitive& visible : visiblePrimitives) {
+		const Material& material = visible.primitive->material;
+		if (skipMaterial(material, renderFlags)) {
+			continue;
+		}
+		if ((renderFlags & RenderFlags::BindImages) && (&material != boundMaterial)) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+			boundMaterial = &material;
+		}
+		vkCmdDrawIndexed(commandBuffer, visible.indexCount, visible.node->instanceCount, visible.firstIndex, 0, visible.node->firstInstance);
+	}
+}
+
+/**
+* Compile the draws of all nodes into an indirect draw buffer, sorted by alpha mode and material so each material is bound only once per draw
+*
+* @param uploadBatch Batch the buffer copy is recorded to
+*
+* @note The draw list only depends on the node tree, animations and node transforms don't invalidate it
+*/
+void vkglTF::Model::createIndirectDraws(vks::UploadBatch& uploadBatch)
+{
+	struct Draw {
+		uint32_t alphaMode;
+		uint32_t materialIndex;
+		VkDrawIndexedIndirectCommand command;
+	};
+	std::vector<Draw> draws;
+	// Same order as the recursive draw, so draws that share a material keep their relative order
+	std::vector<Node*> stack(nodes.rbegin(), nodes.rend());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		if (node->mesh) {
+			for (Primitive* primitive : node->mesh->primitives) {
+				if (primitive->indexCount == 0) {
+					continue;
+				}
+				Draw draw{};
+				draw.alphaMode = static_cast<uint32_t>(primitive->material.alphaMode);
+				draw.materialIndex = static_cast<uint32_t>(&primitive->material - materials.data());
+				draw.command.indexCount = primitive->indexCount;
+				draw.command.instanceCount = node->instanceCount;
+				draw.command.firstIndex = primitive->firstIndex;
+				draw.command.vertexOffset = 0;
+				draw.command.firstInstance = node->firstInstance;
+				draws.push_back(draw);
+			}
+		}
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+	}
+	if (draws.empty()) {
+		return;
+	}
+	std::stable_sort(draws.begin(), draws.end(), [](const Draw& a, const Draw& b) {
+		return (a.alphaMode != b.alphaMode) ? (a.alphaMode < b.alphaMode) : (a.materialIndex < b.materialIndex);
+	});
+
+	std::vector<VkDrawIndexedIndirectCommand> commands;
+	drawBatches.clear();
+	for (const Draw& draw : draws) {
+		if (drawBatches.empty() || (drawBatches.back().materialIndex != draw.materialIndex)) {
+			drawBatches.push_back({ draw.materialIndex, static_cast<uint32_t>(commands.size()), 0 });
+		}
+		drawBatches.back().drawCount++;
+		commands.push_back(draw.command);
+	}
+
+	const VkDeviceSize indirectBufferSize = commands.size() * sizeof(VkDrawIndexedIndirectCommand);
+	indirectDraws.count = static_cast<int>(commands.size());
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+		VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+		indirectBufferSize,
+		&indirectDraws.buffer,
+		&indirectDraws.memory));
+	uploadBatch.copyToBuffer(indirectDraws.buffer, commands.data(), indirectBufferSize);
+
+	// Indirect commands with a first instance other than zero require drawIndirectFirstInstance, instance 0 is only used by nodes without EXT_mesh_gpu_instancing
+	const bool needsFirstInstance = std::any_of(commands.begin(), commands.end(), [](const VkDrawIndexedIndirectCommand& command) { return command.firstInstance != 0; });
+	indirectDraws.commands.clear();
+	if (needsFirstInstance && !device->enabledFeatures.drawIndirectFirstInstance) {
+		indirectDraws.commands = std::move(commands);
+	}
+}
+
+/**
+* Draw the model from the indirect draw buffer, one material bind and (with multiDrawIndirect) one draw call per material
+*/
+void vkglTF::Model::drawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet)
+{
+	const bool multiDraw = device->enabledFeatures.multiDrawIndirect;
+	const uint32_t maxDrawCount = multiDraw ? std::max(device->properties.limits.maxDrawIndirectCount, 1u) : 1u;
+	const uint32_t stride = sizeof(VkDrawIndexedIndirectCommand);
+	for (const DrawBatch& batch : drawBatches) {
+		const Material& material = materials[batch.materialIndex];
+		if (skipMaterial(material, renderFlags)) {
+			continue;
+		}
+		if (renderFlags & RenderFlags::BindImages) {
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, bindImageSet, 1, &material.descriptorSet, 0, nullptr);
+		}
+		// Without multiDrawIndirect the commands have to be issued one by one (see the indirectdraw example)
+		auto drawRange = [&](uint32_t firstDraw, uint32_t count) {
+			for (uint32_t draw = 0; draw < count; draw += maxDrawCount) {
+				const uint32_t drawCount = std::min(count - draw, maxDrawCount);
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectDraws.buffer, static_cast<VkDeviceSize>(firstDraw + draw) * stride, drawCount, stride);
+			}
+		};
+		if (indirectDraws.commands.empty()) {
+			drawRange(batch.firstDraw, batch.drawCount);
+			continue;
+		}
+		// Without drawIndirectFirstInstance the draws of instanced nodes are issued directly, the ones in between still come from the indirect buffer
+		uint32_t firstIndirectDraw = batch.firstDraw;
+		for (uint32_t draw = batch.firstDraw; draw < batch.firstDraw + batch.drawCount; draw++) {
+			const VkDrawIndexedIndirectCommand& command = indirectDraws.commands[draw];
+			if (command.firstInstance == 0) {
+				continue;
+			}
+			drawRange(firstIndirectDraw, draw - firstIndirectDraw);
+			vkCmdDrawIndexed(commandBuffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+			firstIndirectDraw = draw + 1;
+		}
+		drawRange(firstIndirectDraw, batch.firstDraw + batch.drawCount - firstIndirectDraw);
+	}
+}
+
 void vkglTF::Model::getNodeDimensions(Node *node, glm::vec3 &min, glm::vec3 &max)
 {
 	if (node->mesh) {
-		for (Primitive *primitive : node->mesh->primitives) {
-			glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * node->getMatrix();
-			glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * node->getMatrix();
-			if (locMin.x < min.x) { min.x = locMin.x; }
-			if (locMin.y < min.y) { min.y = locMin.y; }
-			if (locMin.z < min.z) { min.z = locMin.z; }
-			if (locMax.x > max.x) { max.x = locMax.x; }
-			if (locMax.y > max.y) { max.y = locMax.y; }
-			if (locMax.z > max.z) { max.z = locMax.z; }
+		const glm::mat4 nodeMatrix = node->getMatrix();
+		for (uint32_t instance = 0; instance < node->instanceCount; instance++) {
+			const glm::mat4 matrix = instanceData.empty() ? nodeMatrix : nodeMatrix * instanceData[node->firstInstance + instance].matrix;
+			for (Primitive *primitive : node->mesh->primitives) {
+				glm::vec4 locMin = glm::vec4(primitive->dimensions.min, 1.0f) * matrix;
+				glm::vec4 locMax = glm::vec4(primitive->dimensions.max, 1.0f) * matrix;
+				if (locMin.x < min.x) { min.x = locMin.x; }
+				if (locMin.y < min.y) { min.y = locMin.y; }
+				if (locMin.z < min.z) { min.z = locMin.z; }
+				if (locMax.x > max.x) { max.x = locMax.x; }
+				if (locMax.y > max.y) { max.y = locMax.y; }
+				if (locMax.z > max.z) { max.z = locMax.z; }
+			}
 		}
 	}
 	for (auto child : node->children) {
@@ -1483,61 +3553,224 @@ void vkglTF::Model::getSceneDimensions()
 	dimensions.radius = glm::distance(dimensions.min, dimensions.max) / 2.0f;
 }
 
-void vkglTF::Model::updateAnimation(uint32_t index, float time)
+void vkglTF::Model::updateAnimation(uint32_t index, float time, vks::JobSystem* jobSystem)
 {
 	if (index > static_cast<uint32_t>(animations.size()) - 1) {
 		std::cout << "No animation with index " << index << std::endl;
 		return;
 	}
-	Animation &animation = animations[index];
+	if (animationStates.size() != animations.size()) {
+		animationStates.resize(animations.size());
+		for (uint32_t i = 0; i < animationStates.size(); i++) {
+			animationStates[i].animation = i;
+		}
+	}
+	// The state is kept between calls, so the key cursors of all channels carry over to the next frame
+	AnimationInstance& state = animationStates[index];
+	state.time = time;
+	evaluateAnimation(state);
+	applyAnimation(state);
+	updateNodes(jobSystem);
+}
+
+void vkglTF::Model::evaluateAnimation(AnimationInstance& instance) const
+{
+	if (instance.animation >= animations.size()) {
+		return;
+	}
+	const Animation& animation = animations[instance.animation];
+	const size_t channelCount = animation.channels.size();
+	if (instance.cursors.size() != channelCount) {
+		instance.cursors.assign(channelCount, 0);
+		instance.values.resize(channelCount);
+		instance.sampled.resize(channelCount);
+	}
+	for (size_t i = 0; i < channelCount; i++) {
+		const AnimationChannel& channel = animation.channels[i];
+		const bool rotation = (channel.path == AnimationChannel::PathType::ROTATION);
+		instance.sampled[i] = animation.samplers[channel.samplerIndex].sample(instance.time, instance.cursors[i], rotation, instance.values[i]);
+	}
+}
+
+/**
+* Sample all channels of a batch of animation instances without touching the nodes
+*
+* @param instances Animations and times to evaluate, results are written to each instance's values
+*
+* @note Only reads the model's animations, so disjoint instance batches can be evaluated on several threads at once
+*/
+void vkglTF::Model::evaluateAnimations(std::vector<AnimationInstance>& instances) const
+{
+	for (AnimationInstance& instance : instances) {
+		evaluateAnimation(instance);
+	}
+}
 
-	bool updated = false;
-	for (auto& channel : animation.channels) {
-		vkglTF::AnimationSampler &sampler = animation.samplers[channel.samplerIndex];
-		if (sampler.inputs.size() > sampler.outputsVec4.size()) {
+/**
+* Write the sampled channel values of an animation instance to the animated nodes
+*
+* @param instance Instance evaluated with evaluateAnimations, call updateNodes afterwards to update the node matrices
+*/
+void vkglTF::Model::applyAnimation(const AnimationInstance& instance)
+{
+	if ((instance.animation >= animations.size()) || (instance.values.size() != animations[instance.animation].channels.size())) {
+		return;
+	}
+	const Animation& animation = animations[instance.animation];
+	for (size_t i = 0; i < animation.channels.size(); i++) {
+		if (!instance.sampled[i]) {
 			continue;
 		}
+		const AnimationChannel& channel = animation.channels[i];
+		const glm::vec4& value = instance.values[i];
+		switch (channel.path) {
+		case AnimationChannel::PathType::TRANSLATION:
+			channel.node->translation = glm::vec3(value);
+			break;
+		case AnimationChannel::PathType::SCALE:
+			channel.node->scale = glm::vec3(value);
+			break;
+		case AnimationChannel::PathType::ROTATION:
+			channel.node->rotation = glm::quat(value.w, value.x, value.y, value.z);
+			break;
+		}
+		channel.node->markDirty();
+	}
+}
 
-		for (auto i = 0; i < sampler.inputs.size() - 1; i++) {
-			if ((time >= sampler.inputs[i]) && (time <= sampler.inputs[i + 1])) {
-				float u = std::max(0.0f, time - sampler.inputs[i]) / (sampler.inputs[i + 1] - sampler.inputs[i]);
-				if (u <= 1.0f) {
-					switch (channel.path) {
-					case vkglTF::AnimationChannel::PathType::TRANSLATION: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->translation = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::SCALE: {
-						glm::vec4 trans = glm::mix(sampler.outputsVec4[i], sampler.outputsVec4[i + 1], u);
-						channel.node->scale = glm::vec3(trans);
-						break;
-					}
-					case vkglTF::AnimationChannel::PathType::ROTATION: {
-						glm::quat q1;
-						q1.x = sampler.outputsVec4[i].x;
-						q1.y = sampler.outputsVec4[i].y;
-						q1.z = sampler.outputsVec4[i].z;
-						q1.w = sampler.outputsVec4[i].w;
-						glm::quat q2;
-						q2.x = sampler.outputsVec4[i + 1].x;
-						q2.y = sampler.outputsVec4[i + 1].y;
-						q2.z = sampler.outputsVec4[i + 1].z;
-						q2.w = sampler.outputsVec4[i + 1].w;
-						channel.node->rotation = glm::normalize(glm::slerp(q1, q2, u));
-						break;
-					}
-					}
-					updated = true;
+/**
+* Compress the keys of all animations (see AnimationSampler::compress), called at load time for FileLoadingFlags::CompressAnimations
+*
+* @param (Optional) tolerance Maximum error of any output component introduced by removing keys
+*
+* @note The sizes before and after compression are kept in Animation::uncompressedSize and Animation::memorySize and printed per clip
+*/
+void vkglTF::Model::compressAnimations(float tolerance)
+{
+	for (Animation& animation : animations) {
+		if (animation.uncompressedSize == 0) {
+			animation.uncompressedSize = animation.memorySize();
+		}
+		for (const AnimationChannel& channel : animation.channels) {
+			animation.samplers[channel.samplerIndex].compress(channel.path == AnimationChannel::PathType::ROTATION, tolerance);
+		}
+		std::cout << "Animation \"" << animation.name << "\": " << animation.uncompressedSize / 1024.0f << " KB -> " << animation.memorySize() / 1024.0f << " KB" << std::endl;
+	}
+}
+
+/**
+* Flatten the node hierarchy into the model's transform arrays (depth first, so every subtree is stored contiguously after its root)
+*/
+void vkglTF::Model::buildTransforms()
+{
+	transforms = std::make_shared<TransformHierarchy>();
+	std::vector<Node*> stack(nodes.rbegin(), nodes.rend());
+	while (!stack.empty()) {
+		Node* node = stack.back();
+		stack.pop_back();
+		const int32_t parent = node->parent ? static_cast<int32_t>(node->parent->transformIndex) : -1;
+		node->transformIndex = transforms->add(parent, node->translation, node->rotation, node->scale, node->matrix);
+		node->transforms = transforms.get();
+		stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+	}
+	for (Skin* skin : skins) {
+		skin->jointTransformIndices.clear();
+		for (Node* joint : skin->joints) {
+			skin->jointTransformIndices.push_back(joint->transformIndex);
+		}
+	}
+}
+
+/**
+* Allocate the uniform blocks of all meshes and the joint matrix ranges of all skinned meshes in a single persistently mapped buffer
+*/
+void vkglTF::Model::createNodeBuffer()
+{
+	const VkDeviceSize uniformAlignment = std::max(device->properties.limits.minUniformBufferOffsetAlignment, static_cast<VkDeviceSize>(1));
+	const VkDeviceSize storageAlignment = std::max(device->properties.limits.minStorageBufferOffsetAlignment, static_cast<VkDeviceSize>(1));
+	const VkDeviceSize uniformStride = (sizeof(Mesh::UniformBlock) + uniformAlignment - 1) / uniformAlignment * uniformAlignment;
+
+	VkDeviceSize uniformSize = 0;
+	uint32_t jointCount = 0;
+	for (Node* node : linearNodes) {
+		if (node->mesh) {
+			node->mesh->uniformBuffer.dynamicOffset = static_cast<uint32_t>(uniformSize);
+			uniformSize += uniformStride;
+			if (node->skin) {
+				node->mesh->uniformBlock.jointOffset = jointCount;
+				node->mesh->uniformBlock.jointcount = static_cast<float>(node->skin->joints.size());
+				jointCount += static_cast<uint32_t>(node->skin->joints.size());
+			}
+		}
+	}
+	// Models without meshes or skins still get a minimal range for both bindings so the node descriptor set is always complete
+	uniformSize = std::max(uniformSize, uniformStride);
+	const VkDeviceSize jointOffset = (uniformSize + storageAlignment - 1) / storageAlignment * storageAlignment;
+	const VkDeviceSize jointSize = std::max(jointCount, 1u) * sizeof(glm::mat4);
+	VK_CHECK_RESULT(device->createBuffer(
+		VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+		VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+		&nodeBuffer,
+		jointOffset + jointSize));
+	VK_CHECK_RESULT(nodeBuffer.map());
+	jointDescriptor = { nodeBuffer.buffer, jointOffset, jointSize };
+
+	uint8_t* mapped = static_cast<uint8_t*>(nodeBuffer.mapped);
+	glm::mat4* jointMatrices = reinterpret_cast<glm::mat4*>(mapped + jointOffset);
+	for (Node* node : linearNodes) {
+		if (node->mesh) {
+			Mesh::UniformBuffer& uniformBuffer = node->mesh->uniformBuffer;
+			uniformBuffer.buffer = nodeBuffer.buffer;
+			uniformBuffer.descriptor = { nodeBuffer.buffer, uniformBuffer.dynamicOffset, sizeof(Mesh::UniformBlock) };
+			uniformBuffer.mapped = mapped + uniformBuffer.dynamicOffset;
+			memcpy(uniformBuffer.mapped, &node->mesh->uniformBlock, sizeof(Mesh::UniformBlock));
+			if (node->skin) {
+				node->mesh->jointMatrices = jointMatrices + node->mesh->uniformBlock.jointOffset;
+			}
+		}
+	}
+}
+
+/**
+* Recompute the world matrices of all nodes whose transform has changed and update the uniform buffers and joint matrices of the affected meshes
+*
+* @param jobSystem (Optional) Job system used to update the affected meshes in parallel
+*/
+void vkglTF::Model::updateNodes(vks::JobSystem* jobSystem)
+{
+	if (!transforms) {
+		return;
+	}
+	transforms->update();
+	std::vector<Node*> updatedNodes;
+	for (Node* node : linearNodes) {
+		if (!node->mesh) {
+			continue;
+		}
+		bool changed = transforms->changed[node->transformIndex] != 0;
+		if (!changed && node->skin) {
+			for (uint32_t jointIndex : node->skin->jointTransformIndices) {
+				if (transforms->changed[jointIndex]) {
+					changed = true;
+					break;
 				}
 			}
 		}
+		if (changed) {
+			updatedNodes.push_back(node);
+		}
 	}
-	if (updated) {
-		for (auto &node : nodes) {
-			node->update();
+	// Every mesh owns its uniform buffer and joint range, so the updates are independent of each other
+	if (jobSystem && (updatedNodes.size() > 1)) {
+		jobSystem->parallelFor(static_cast<uint32_t>(updatedNodes.size()), 1, [&updatedNodes](uint32_t i) {
+			updatedNodes[i]->updateUniformBuffer();
+		});
+	} else {
+		for (Node* node : updatedNodes) {
+			node->updateUniformBuffer();
 		}
 	}
+	transforms->clearChanged();
 }
 
 /*
@@ -1568,24 +3801,10 @@ vkglTF::Node* vkglTF::Model::nodeFromIndex(uint32_t index) {
 	return nodeFound;
 }
 
+/** @brief Point the meshes of a node's subtree to the model's shared node descriptor set */
 void vkglTF::Model::prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout) {
 	if (node->mesh) {
-		VkDescriptorSetAllocateInfo descriptorSetAllocInfo{};
-		descriptorSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		descriptorSetAllocInfo.descriptorPool = descriptorPool;
-		descriptorSetAllocInfo.pSetLayouts = &descriptorSetLayout;
-		descriptorSetAllocInfo.descriptorSetCount = 1;
-		VK_CHECK_RESULT(vkAllocateDescriptorSets(device->logicalDevice, &descriptorSetAllocInfo, &node->mesh->uniformBuffer.descriptorSet));
-
-		VkWriteDescriptorSet writeDescriptorSet{};
-		writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-		writeDescriptorSet.descriptorCount = 1;
-		writeDescriptorSet.dstSet = node->mesh->uniformBuffer.descriptorSet;
-		writeDescriptorSet.dstBinding = 0;
-		writeDescriptorSet.pBufferInfo = &node->mesh->uniformBuffer.descriptor;
-
-		vkUpdateDescriptorSets(device->logicalDevice, 1, &writeDescriptorSet, 0, nullptr);
+		node->mesh->uniformBuffer.descriptorSet = nodeDescriptorSet;
 	}
 	for (auto& child : node->children) {
 		prepareNodeDescriptor(child, descriptorSetLayout);
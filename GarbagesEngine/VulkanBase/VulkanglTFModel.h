@@ -19,9 +19,16 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <future>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
 
 #include "vulkan/vulkan.h"
 #include "VulkanDevice.h"
+#include "VulkanUploadBatch.h"
+#include "VulkanglTFAccessor.h"
 
 #include <ktx.h>
 #include <ktxvulkan.h>
@@ -31,6 +38,11 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+#include "VulkanglTFTransforms.h"
+#include "VulkanglTFMeshlets.h"
+#include "VulkanglTFBvh.h"
 
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #ifdef VK_USE_PLATFORM_ANDROID_KHR
@@ -39,6 +51,12 @@
 #include "../../vendor/tinygltf/tiny_gltf.h"
 
 
+namespace vks
+{
+	class JobSystem;
+	class Frustum;
+}
+
 namespace vkglTF
 {
 	enum DescriptorBindingFlags {
@@ -61,6 +79,7 @@ namespace vkglTF
 		VkImage image;
 		VkImageLayout imageLayout;
 		VkDeviceMemory deviceMemory;
+		VmaAllocation allocation = VK_NULL_HANDLE;
 		VkImageView view;
 		uint32_t width, height;
 		uint32_t mipLevels;
@@ -71,6 +90,39 @@ namespace vkglTF
 		void updateDescriptor();
 		void destroy();
 		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, VkQueue copyQueue);
+		void fromglTfImage(tinygltf::Image& gltfimage, std::string path, vks::VulkanDevice* device, vks::UploadBatch& uploadBatch, vks::JobSystem* jobSystem = nullptr);
+	};
+
+	/*
+		Reference counted textures shared by all models of a device, so images with the same source are only created once
+	*/
+	class TextureCache {
+	public:
+		struct Statistics {
+			uint32_t hits = 0;
+			uint32_t misses = 0;
+			/** @brief Number of distinct textures currently alive */
+			uint32_t textureCount = 0;
+			/** @brief Number of acquired textures that haven't been released yet */
+			uint32_t referenceCount = 0;
+		};
+		vks::VulkanDevice* device;
+		TextureCache(vks::VulkanDevice* device) : device(device) {};
+		~TextureCache();
+		Texture acquire(const std::string& key, const std::function<void(Texture&)>& create);
+		bool tryAcquire(const std::string& key, Texture& texture);
+		void release(const Texture& texture);
+		Statistics getStatistics();
+	private:
+		struct Entry {
+			Texture texture;
+			uint32_t references;
+		};
+		std::unordered_map<std::string, Entry> entries;
+		/** @brief Key of each cached image, used to find the entry of a released texture */
+		std::unordered_map<VkImage, std::string> keys;
+		Statistics statistics;
+		std::mutex mutex;
 	};
 
 	/*
@@ -107,6 +159,9 @@ namespace vkglTF
 		uint32_t indexCount;
 		uint32_t firstVertex;
 		uint32_t vertexCount;
+		/** @brief Range of the primitive's clusters in Model::meshlets, only set with FileLoadingFlags::BuildMeshlets */
+		uint32_t firstMeshlet = 0;
+		uint32_t meshletCount = 0;
 		Material& material;
 
 		struct Dimensions {
@@ -117,7 +172,18 @@ namespace vkglTF
 			float radius;
 		} dimensions;
 
+		/** @brief Simplified version of the primitive, the indices reference the primitive's own vertex range */
+		struct LOD {
+			uint32_t firstIndex;
+			uint32_t indexCount;
+			/** @brief Upper bound of the deviation from the full detail surface in the primitive's local units */
+			float error;
+		};
+		/** @brief Levels generated with FileLoadingFlags::GenerateLods, each one coarser than the previous, level 0 is the primitive itself */
+		std::vector<LOD> lods;
+
 		void setDimensions(glm::vec3 min, glm::vec3 max);
+		uint32_t selectLod(float pixelsPerUnit, float maxPixelError = 1.0f) const;
 		Primitive(uint32_t firstIndex, uint32_t indexCount, Material& material) : firstIndex(firstIndex), indexCount(indexCount), material(material) {};
 	};
 
@@ -127,25 +193,34 @@ namespace vkglTF
 	struct Mesh {
 		vks::VulkanDevice* device;
 
+		/** @brief Primitives owned by the model's mesh table, shared with all other nodes instancing the same glTF mesh */
 		std::vector<Primitive*> primitives;
+		/** @brief Entry of the primitives in Model::meshTable */
+		uint32_t meshIndex = 0;
 		std::string name;
 
+		/** @brief Range of the mesh's uniform block inside the model's node buffer */
 		struct UniformBuffer {
-			VkBuffer buffer;
-			VkDeviceMemory memory;
-			VkDescriptorBufferInfo descriptor;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDescriptorBufferInfo descriptor{};
+			/** @brief Node descriptor set shared by all meshes of the model, binding 0 is a dynamic uniform buffer */
 			VkDescriptorSet descriptorSet = VK_NULL_HANDLE;
-			void* mapped;
+			/** @brief Dynamic offset to pass when binding descriptorSet */
+			uint32_t dynamicOffset = 0;
+			void* mapped = nullptr;
 		} uniformBuffer;
 
 		struct UniformBlock {
 			glm::mat4 matrix;
-			glm::mat4 jointMatrix[64]{};
 			float jointcount{ 0 };
+			/** @brief Index of the mesh's first joint matrix in the model's joint buffer */
+			uint32_t jointOffset{ 0 };
 		} uniformBlock;
 
+		/** @brief Joint matrices of the mesh's skin inside the model's mapped joint buffer, null for meshes without a skin */
+		glm::mat4* jointMatrices = nullptr;
+
 		Mesh(vks::VulkanDevice* device, glm::mat4 matrix);
-		~Mesh();
 	};
 
 	/*
@@ -156,6 +231,8 @@ namespace vkglTF
 		Node* skeletonRoot = nullptr;
 		std::vector<glm::mat4> inverseBindMatrices;
 		std::vector<Node*> joints;
+		/** @brief Transform index of each joint, lets the joint matrices be computed without touching the nodes */
+		std::vector<uint32_t> jointTransformIndices;
 	};
 
 	/*
@@ -170,11 +247,20 @@ namespace vkglTF
 		Mesh* mesh;
 		Skin* skin;
 		int32_t skinIndex = -1;
+		/** @brief Range of the node's instances in Model::instanceData, nodes without EXT_mesh_gpu_instancing use the identity instance at index 0 */
+		uint32_t firstInstance = 0;
+		uint32_t instanceCount = 1;
 		glm::vec3 translation{};
 		glm::vec3 scale{ 1.0f };
 		glm::quat rotation{};
+		/** @brief Flattened hierarchy of the owning model, null until the model has finished loading its nodes */
+		TransformHierarchy* transforms = nullptr;
+		uint32_t transformIndex = 0;
 		glm::mat4 localMatrix();
 		glm::mat4 getMatrix();
+		/** @brief Has to be called after changing translation, rotation, scale or matrix so the new local transform is picked up */
+		void markDirty();
+		void updateUniformBuffer();
 		void update();
 		~Node();
 	};
@@ -196,7 +282,26 @@ namespace vkglTF
 		enum InterpolationType { LINEAR, STEP, CUBICSPLINE };
 		InterpolationType interpolation;
 		std::vector<float> inputs;
+		/** @brief One value per key, cubic spline samplers store in-tangent, value and out-tangent for every key */
 		std::vector<glm::vec4> outputsVec4;
+		/** @brief Outputs are stored in quantizedOutputs instead of outputsVec4 (see compress) */
+		bool compressed = false;
+		/** @brief Compressed outputs are quaternions stored as their smallest three components */
+		bool quantizedRotation = false;
+		/** @brief Three 16 bit values per key for compressed samplers */
+		std::vector<uint16_t> quantizedOutputs;
+		/** @brief Range of compressed translation and scale outputs, value = min + quantized * scale */
+		glm::vec3 quantizationMin{ 0.0f };
+		glm::vec3 quantizationScale{ 0.0f };
+		/** @brief True if there are enough outputs for all keys of the interpolation type */
+		bool isValid() const;
+		size_t outputCount() const;
+		glm::vec4 getOutput(size_t index) const;
+		uint32_t findKey(float time, uint32_t& cursor) const;
+		bool sample(float time, uint32_t& cursor, bool rotation, glm::vec4& value) const;
+		void compress(bool rotation, float tolerance);
+		/** @brief Memory used by the key times and outputs in bytes */
+		size_t memorySize() const;
 	};
 
 	/*
@@ -208,6 +313,24 @@ namespace vkglTF
 		std::vector<AnimationChannel> channels;
 		float start = std::numeric_limits<float>::max();
 		float end = std::numeric_limits<float>::min();
+		/** @brief Memory used by the samplers before compression in bytes, zero if the animation has not been compressed */
+		size_t uncompressedSize = 0;
+		/** @brief Memory currently used by all samplers in bytes */
+		size_t memorySize() const;
+	};
+
+	/*
+		Playback state of a glTF animation
+	*/
+	struct AnimationInstance {
+		uint32_t animation = 0;
+		float time = 0.0f;
+		/** @brief Key interval each channel was sampled from last, lets forward playback find its keys without searching */
+		std::vector<uint32_t> cursors;
+		/** @brief Sampled value of each channel (xyz for translation and scale, quaternion xyzw for rotation) */
+		std::vector<glm::vec4> values;
+		/** @brief Set for channels that produced a value in the last evaluation */
+		std::vector<uint8_t> sampled;
 	};
 
 	/*
@@ -233,12 +356,62 @@ namespace vkglTF
 		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
 	};
 
+	/*
+		Compact vertex layout used for models loaded with FileLoadingFlags::PackVertices (52 instead of 96 bytes per vertex)
+		All attributes except the joint indices use formats the vertex input stage converts to floats, so shaders written for the default layout work unchanged
+		Skinning shaders need to declare the joint input as uvec4 for packed models
+	*/
+	struct PackedVertex {
+		glm::vec3 pos;
+		/** @brief R16G16B16A16_SNORM */
+		glm::i16vec4 normal;
+		/** @brief R16G16_SFLOAT */
+		glm::u16vec2 uv;
+		/** @brief R8G8B8A8_UNORM */
+		glm::u8vec4 color;
+		/** @brief R16G16B16A16_UINT, covers every joint index glTF can store (unsigned byte or short) */
+		glm::u16vec4 joint0;
+		/** @brief R16G16B16A16_UNORM */
+		glm::u16vec4 weight0;
+		/** @brief R16G16B16A16_SNORM */
+		glm::i16vec4 tangent;
+		static VkVertexInputBindingDescription vertexInputBindingDescription;
+		static std::vector<VkVertexInputAttributeDescription> vertexInputAttributeDescriptions;
+		static VkPipelineVertexInputStateCreateInfo pipelineVertexInputStateCreateInfo;
+		static PackedVertex pack(const Vertex& vertex);
+		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
+		static VkVertexInputAttributeDescription inputAttributeDescription(uint32_t binding, uint32_t location, VertexComponent component);
+		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, const std::vector<VertexComponent> components);
+		/** @brief Returns the pipeline vertex input state create info structure for the requested vertex components of a packed model */
+		static VkPipelineVertexInputStateCreateInfo* getPipelineVertexInputState(const std::vector<VertexComponent> components);
+	};
+
+	/*
+		Per-instance data of nodes using EXT_mesh_gpu_instancing, bound as an instance rate vertex buffer (see Model::bindBuffers)
+		Shaders apply the instance matrix before the node matrix: position = node.matrix * instance.matrix * vertex.pos
+	*/
+	struct InstanceData {
+		glm::mat4 matrix;
+		static VkVertexInputBindingDescription inputBindingDescription(uint32_t binding);
+		/** @brief The matrix occupies four consecutive locations (one per column) starting at location */
+		static std::vector<VkVertexInputAttributeDescription> inputAttributeDescriptions(uint32_t binding, uint32_t location);
+	};
+
 	enum FileLoadingFlags {
 		None = 0x00000000,
 		PreTransformVertices = 0x00000001,
 		PreMultiplyVertexColors = 0x00000002,
 		FlipY = 0x00000004,
-		DontLoadImages = 0x00000008
+		DontLoadImages = 0x00000008,
+		PackVertices = 0x00000010,
+		UseMeshCache = 0x00000020,
+		CompressAnimations = 0x00000040,
+		IndirectDraws = 0x00000080,
+		OptimizeMeshes = 0x00000100,
+		GenerateLods = 0x00000200,
+		BuildMeshlets = 0x00000400,
+		RetainGeometry = 0x00000800,
+		BakeMipmaps = 0x00001000
 	};
 
 	enum RenderFlags {
@@ -255,26 +428,177 @@ namespace vkglTF
 	private:
 		vkglTF::Texture* getTexture(uint32_t index);
 		vkglTF::Texture emptyTexture;
-		void createEmptyTexture(VkQueue transferQueue);
+		void createEmptyTexture(vks::UploadBatch& uploadBatch);
+		bool loadFromMappedFile(const std::string& filename, tinygltf::TinyGLTF& gltfContext, tinygltf::Model& gltfModel, std::string& error, std::string& warning);
+		const unsigned char* getAccessorData(const tinygltf::Model& model, const tinygltf::Accessor& accessor) const;
+		accessor::View getAccessorView(const tinygltf::Model& model, const tinygltf::Accessor& accessor) const;
+		/** @brief Range of the vertex and index buffers reserved for a glTF primitive by loadNode (only valid during loading) */
+		struct PrimitiveLoadJob {
+			const tinygltf::Primitive* primitive;
+			uint32_t firstVertex;
+			uint32_t vertexCount;
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+		std::vector<PrimitiveLoadJob> primitiveLoadJobs;
+		/** @brief Mesh table entry of each glTF mesh, -1 until the mesh has been loaded, empty if meshes can't be shared (only valid during loading) */
+		std::vector<int32_t> gltfMeshTableIndices;
+		std::vector<Primitive*> loadMeshPrimitives(const tinygltf::Mesh& mesh, const tinygltf::Model& model);
+		uint32_t loadedVertexCount = 0;
+		uint32_t loadedIndexCount = 0;
+		void decodePrimitive(const tinygltf::Model& model, const PrimitiveLoadJob& job, Vertex* vertexBuffer, uint32_t* indexBuffer) const;
+		struct PendingUpload;
+		/** @brief Decoded data waiting for uploadData (only valid during loading) */
+		std::shared_ptr<PendingUpload> pendingUpload;
+		/** @brief Background part of a load started with loadFromFileAsync */
+		std::shared_future<void> pendingLoad;
+		void loadData(const std::string& filename, uint32_t fileLoadingFlags, float scale);
+		void uploadData(VkQueue transferQueue);
+		void uploadImages(std::vector<tinygltf::Image>& images, vks::VulkanDevice* device, vks::UploadBatch& uploadBatch, std::vector<std::vector<unsigned char>>* encodedImages = nullptr);
+		bool loadFromCache(const std::string& cacheFilename, const std::string& filename, uint32_t fileLoadingFlags, float scale);
+		void writeCache(const std::string& cacheFilename, const std::string& filename, const tinygltf::Model& gltfModel, uint32_t fileLoadingFlags, float scale, const void* vertexData, size_t vertexBufferSize, const std::vector<uint32_t>& indexBuffer);
+		void createBuffers(const void* vertexData, size_t vertexBufferSize, uint32_t vertexCount, const uint32_t* indexData, uint32_t indexCount, vks::UploadBatch& uploadBatch);
+		void loadInstances(Node* node, const tinygltf::Value& attributes, const tinygltf::Model& model);
+		void optimizeMeshes(std::vector<Vertex>& vertexBuffer, std::vector<uint32_t>& indexBuffer, bool optimize, uint32_t lodLevels);
+		void buildMeshlets(const std::vector<Vertex>& vertexBuffer, const std::vector<uint32_t>& indexBuffer, bool clockwise);
+		/** @brief Consecutive bvh triangles taken from the same primitive and node instance */
+		struct BvhRange {
+			Node* node;
+			Primitive* primitive;
+			uint32_t instance;
+			uint32_t firstTriangle;
+		};
+		std::vector<BvhRange> bvhRanges;
+		/** @brief Triangle soup the bvh is built from, three vertices per triangle in the model's space */
+		std::vector<glm::vec3> bvhVertices;
+		void updateBvhVertices(vks::JobSystem* jobSystem);
+		glm::mat4 getVertexMatrix(Node* node, uint32_t instance) const;
+		void setupDescriptors();
+		void buildTransforms();
+		void createNodeBuffer();
+		void createIndirectDraws(vks::UploadBatch& uploadBatch);
+		void drawIndirect(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet);
+		void drawVisible(VkCommandBuffer commandBuffer, uint32_t renderFlags, VkPipelineLayout pipelineLayout, uint32_t bindImageSet);
+		/** @brief Playback state used by updateAnimation, one per animation */
+		std::vector<AnimationInstance> animationStates;
+		void evaluateAnimation(AnimationInstance& instance) const;
 	public:
 		vks::VulkanDevice* device;
-		VkDescriptorPool descriptorPool;
+		VkDescriptorPool descriptorPool = VK_NULL_HANDLE;
 
 		struct Vertices {
-			int count;
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
 		} vertices;
 		struct Indices {
-			int count;
-			VkBuffer buffer;
-			VkDeviceMemory memory;
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
 		} indices;
+		/** @brief Instance rate vertex buffer with instanceData, only created for models using EXT_mesh_gpu_instancing */
+		struct Instances {
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+		} instances;
+		/** @brief Vertex buffer binding the instance buffer is bound to by bindBuffers and draw */
+		static const uint32_t instanceBufferBinding = 1;
+		/** @brief Indirect draw commands of all primitives sorted by alpha mode and material, only created with FileLoadingFlags::IndirectDraws */
+		struct IndirectDraws {
+			int count = 0;
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			/** @brief Copy of the commands for issuing the draws of instanced nodes directly, only kept if they need a first instance and drawIndirectFirstInstance isn't enabled */
+			std::vector<VkDrawIndexedIndirectCommand> commands;
+		} indirectDraws;
+		/** @brief Consecutive indirect draw commands sharing the same material */
+		struct DrawBatch {
+			uint32_t materialIndex;
+			uint32_t firstDraw;
+			uint32_t drawCount;
+		};
+		std::vector<DrawBatch> drawBatches;
+
+		/** @brief Primitive of a node that passed the last culling pass */
+		struct VisiblePrimitive {
+			Node* node;
+			Primitive* primitive;
+			/** @brief Index range of the level of detail selected by cull */
+			uint32_t firstIndex;
+			uint32_t indexCount;
+		};
+		/** @brief Primitives that passed the last call to cull in draw order, draw only submits these while frustumCulling is set */
+		std::vector<VisiblePrimitive> visiblePrimitives;
+		/** @brief Set by cull, clear it to go back to drawing all primitives */
+		bool frustumCulling = false;
+		struct CullingStats {
+			uint32_t tested = 0;
+			uint32_t culled = 0;
+		} cullingStats;
+
+		/** @brief Clusters of all primitives built with FileLoadingFlags::BuildMeshlets, meshletVertices holds indices into the model's vertex buffer */
+		std::vector<Meshlet> meshlets;
+		std::vector<MeshletBounds> meshletBounds;
+		std::vector<uint32_t> meshletVertices;
+		std::vector<uint8_t> meshletTriangles;
+		/**
+		* @brief Storage buffer with the meshlets, their bounds, vertex indices and packed triangles for mesh shaders
+		* @note Each array starts at a storage buffer offset aligned position and has its own descriptor
+		*/
+		struct MeshletBuffer {
+			VkBuffer buffer = VK_NULL_HANDLE;
+			VkDeviceMemory memory = VK_NULL_HANDLE;
+			VkDescriptorBufferInfo meshlets{};
+			VkDescriptorBufferInfo bounds{};
+			VkDescriptorBufferInfo vertices{};
+			VkDescriptorBufferInfo triangles{};
+		} meshletBuffer;
+		/** @brief Result of the last call to cullMeshlets */
+		struct MeshletCullingStats {
+			uint32_t tested = 0;
+			uint32_t frustumCulled = 0;
+			uint32_t backfaceCulled = 0;
+		} meshletCullingStats;
+
+		/** @brief Vertex positions and indices kept on the CPU with FileLoadingFlags::RetainGeometry, laid out like the device vertex and index buffers */
+		std::vector<glm::vec3> retainedPositions;
+		std::vector<uint32_t> retainedIndices;
+		/** @brief Hierarchy over the triangles of all mesh nodes in the model's space, built by buildBvh */
+		Bvh bvh;
+		struct RaycastHit {
+			Node* node = nullptr;
+			Primitive* primitive = nullptr;
+			/** @brief Instance of the node, 0 for nodes without EXT_mesh_gpu_instancing */
+			uint32_t instance = 0;
+			/** @brief Triangle of the primitive, its indices start at primitive->firstIndex + triangle * 3 */
+			uint32_t triangle = 0;
+			/** @brief Distance along the ray in multiples of the ray direction */
+			float distance = 0.0f;
+			glm::vec3 position = glm::vec3(0.0f);
+			/** @brief Weights of the triangle's second and third vertex */
+			glm::vec2 barycentrics = glm::vec2(0.0f);
+		};
 
 		std::vector<Node*> nodes;
 		std::vector<Node*> linearNodes;
+		/** @brief Primitives of every loaded mesh, stored once no matter how many nodes instance the mesh (see Mesh::meshIndex) */
+		std::vector<std::vector<Primitive*>> meshTable;
+		/** @brief Instance transforms of all nodes using EXT_mesh_gpu_instancing, empty if the model doesn't use the extension */
+		std::vector<InstanceData> instanceData;
+		/** @brief World matrices of all nodes, kept up to date by updateNodes */
+		std::shared_ptr<TransformHierarchy> transforms;
 
 		std::vector<Skin*> skins;
+		/**
+		* @brief Uniform blocks of all meshes followed by the joint matrices of all skinned meshes, allocated and mapped once per model
+		* @note Each mesh's uniform block is reached through the dynamic offset of binding 0 of nodeDescriptorSet, joint matrices through binding 1 and the mesh's jointOffset
+		*/
+		vks::Buffer nodeBuffer;
+		/** @brief Joint matrix range of nodeBuffer */
+		VkDescriptorBufferInfo jointDescriptor{};
+		/** @brief Single node descriptor set (layout descriptorSetLayoutUbo) shared by all meshes */
+		VkDescriptorSet nodeDescriptorSet = VK_NULL_HANDLE;
 
 		std::vector<Texture> textures;
 		std::vector<Material> materials;
@@ -289,23 +613,50 @@ namespace vkglTF
 		} dimensions;
 
 		bool metallicRoughnessWorkflow = true;
+		/** @brief Flags the model was loaded with (see vkglTF::FileLoadingFlags) */
+		uint32_t loadingFlags = 0;
+		/** @brief Vertex buffer uses the PackedVertex layout (see FileLoadingFlags::PackVertices) */
+		bool packedVertices = false;
+		/** @brief Draw issues the batched indirect draws instead of walking the node tree (see FileLoadingFlags::IndirectDraws) */
+		bool useIndirectDraws = false;
+		/** @brief Keep retainedPositions and retainedIndices after the upload (see FileLoadingFlags::RetainGeometry) */
+		bool retainGeometry = false;
+		/** @brief Mip chains of decoded images are generated on the CPU while decoding instead of being blitted after the upload (see FileLoadingFlags::BakeMipmaps) */
+		bool bakeMipmaps = false;
+		/** @brief Maximum number of levels of detail generated per primitive with FileLoadingFlags::GenerateLods, needs to be set before loading */
+		uint32_t lodLevelCount = 4;
+		/** @brief Shares the model's textures with all other models using the same cache, needs to be set before loading and has to outlive the model */
+		TextureCache* textureCache = nullptr;
 		bool buffersBound = false;
 		std::string path;
 
 		Model() {};
 		~Model();
-		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer, float globalscale);
+		void loadNode(vkglTF::Node* parent, const tinygltf::Node& node, uint32_t nodeIndex, const tinygltf::Model& model, float globalscale);
+		void loadPrimitives(const tinygltf::Model& model, std::vector<uint32_t>& indexBuffer, std::vector<Vertex>& vertexBuffer);
 		void loadSkins(tinygltf::Model& gltfModel);
 		void loadImages(tinygltf::Model& gltfModel, vks::VulkanDevice* device, VkQueue transferQueue);
 		void loadMaterials(tinygltf::Model& gltfModel);
 		void loadAnimations(tinygltf::Model& gltfModel);
 		void loadFromFile(std::string filename, vks::VulkanDevice* device, VkQueue transferQueue, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
+		std::shared_future<void> loadFromFileAsync(std::string filename, vks::VulkanDevice* device, uint32_t fileLoadingFlags = vkglTF::FileLoadingFlags::None, float scale = 1.0f);
+		bool finishLoading(VkQueue transferQueue);
 		void bindBuffers(VkCommandBuffer commandBuffer);
 		void drawNode(Node* node, VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
 		void draw(VkCommandBuffer commandBuffer, uint32_t renderFlags = 0, VkPipelineLayout pipelineLayout = VK_NULL_HANDLE, uint32_t bindImageSet = 1);
+		void cull(const vks::Frustum& frustum, const glm::vec3& cameraPosition = glm::vec3(0.0f), float lodScale = 0.0f, float maxPixelError = 1.0f);
+		uint32_t cullMeshlets(const vks::Frustum& frustum, const glm::vec3& cameraPosition, std::vector<uint32_t>* visibleMeshlets = nullptr);
+		void buildBvh(vks::JobSystem* jobSystem = nullptr);
+		void refitBvh(vks::JobSystem* jobSystem = nullptr);
+		bool raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, RaycastHit& hit) const;
+		bool occluded(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const;
 		void getNodeDimensions(Node* node, glm::vec3& min, glm::vec3& max);
 		void getSceneDimensions();
-		void updateAnimation(uint32_t index, float time);
+		void updateAnimation(uint32_t index, float time, vks::JobSystem* jobSystem = nullptr);
+		void evaluateAnimations(std::vector<AnimationInstance>& instances) const;
+		void applyAnimation(const AnimationInstance& instance);
+		void compressAnimations(float tolerance = 0.0005f);
+		void updateNodes(vks::JobSystem* jobSystem = nullptr);
 		Node* findNode(Node* parent, uint32_t index);
 		Node* nodeFromIndex(uint32_t index);
 		void prepareNodeDescriptor(vkglTF::Node* node, VkDescriptorSetLayout descriptorSetLayout);
@@ -0,0 +1,725 @@
+/*
+ * glTF mesh optimization functions
+ *
+ * Vertex welding, vertex cache, overdraw and vertex fetch optimization of indexed triangle lists along with a quadric error mesh simplifier used to generate LODs
+ * All functions work on a single primitive with indices relative to its first vertex and are deterministic, so their results can be stored in the mesh cache
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VulkanglTFOptimizer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+
+namespace vkglTF
+{
+	namespace optimizer
+	{
+		namespace
+		{
+			// Open addressing hash table storing vertex indices, vertices are compared by their binary contents
+			class VertexHashTable
+			{
+			public:
+				VertexHashTable(const unsigned char* vertices, size_t vertexSize, size_t vertexCount) : vertices(vertices), vertexSize(vertexSize)
+				{
+					size_t capacity = 16;
+					while (capacity < vertexCount * 2) {
+						capacity *= 2;
+					}
+					slots.assign(capacity, unusedVertex);
+				}
+
+				// Returns the index of a previously inserted vertex with the same contents, or inserts the vertex and returns its own index
+				uint32_t insert(uint32_t vertex)
+				{
+					const unsigned char* data = vertices + vertex * vertexSize;
+					const size_t mask = slots.size() - 1;
+					size_t slot = hash(data) & mask;
+					// Linear probing, the table is never more than half full so there is always a free slot
+					while (slots[slot] != unusedVertex) {
+						if (memcmp(vertices + slots[slot] * vertexSize, data, vertexSize) == 0) {
+							return slots[slot];
+						}
+						slot = (slot + 1) & mask;
+					}
+					slots[slot] = vertex;
+					return vertex;
+				}
+
+			private:
+				const unsigned char* vertices;
+				size_t vertexSize;
+				std::vector<uint32_t> slots;
+
+				// FNV-1a
+				uint32_t hash(const unsigned char* data) const
+				{
+					uint32_t result = 2166136261u;
+					for (size_t i = 0; i < vertexSize; i++) {
+						result = (result ^ data[i]) * 16777619u;
+					}
+					return result;
+				}
+			};
+
+			// Simulated FIFO post-transform cache, resetting it only bumps the timestamp
+			class VertexCacheSimulation
+			{
+			public:
+				VertexCacheSimulation(size_t vertexCount, uint32_t cacheSize) : timestamps(vertexCount, 0), cacheSize(cacheSize), timestamp(cacheSize + 1) {}
+
+				// Returns the number of cache misses caused by a triangle
+				uint32_t addTriangle(const uint32_t* triangle)
+				{
+					uint32_t misses = 0;
+					for (uint32_t i = 0; i < 3; i++) {
+						const uint32_t vertex = triangle[i];
+						if (timestamp - timestamps[vertex] > cacheSize) {
+							timestamps[vertex] = timestamp++;
+							misses++;
+						}
+					}
+					return misses;
+				}
+
+				void reset()
+				{
+					timestamp += cacheSize + 1;
+				}
+
+			private:
+				std::vector<uint32_t> timestamps;
+				uint32_t cacheSize;
+				uint32_t timestamp;
+			};
+
+			// Vertex scoring as described in Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+			const uint32_t scoringCacheSize = 32;
+			const uint32_t scoringMaxValence = 32;
+
+			struct VertexScoreTable {
+				float cache[scoringCacheSize];
+				float valence[scoringMaxValence + 1];
+
+				VertexScoreTable()
+				{
+					for (uint32_t i = 0; i < scoringCacheSize; i++) {
+						// The last triangle's vertices get a fixed score so the next triangle doesn't simply reuse them in the same order
+						cache[i] = (i < 3) ? 0.75f : powf(1.0f - static_cast<float>(i - 3) / static_cast<float>(scoringCacheSize - 3), 1.5f);
+					}
+					valence[0] = 0.0f;
+					for (uint32_t i = 1; i <= scoringMaxValence; i++) {
+						// Vertices with few remaining triangles are preferred, so they can leave the cache for good
+						valence[i] = 2.0f / sqrtf(static_cast<float>(i));
+					}
+				}
+
+				float score(int32_t cachePosition, uint32_t liveTriangles) const
+				{
+					if (liveTriangles == 0) {
+						return 0.0f;
+					}
+					const float cacheScore = (cachePosition >= 0) ? cache[cachePosition] : 0.0f;
+					return cacheScore + valence[std::min(liveTriangles, scoringMaxValence)];
+				}
+			};
+
+			// Symmetric 4x4 matrix of the squared distance to a set of planes, weighted by the area of the triangles the planes belong to
+			struct Quadric {
+				double a00 = 0.0, a11 = 0.0, a22 = 0.0, a10 = 0.0, a20 = 0.0, a21 = 0.0;
+				double b0 = 0.0, b1 = 0.0, b2 = 0.0, c = 0.0;
+				double weight = 0.0;
+
+				void addPlane(const glm::vec3& normal, float distance, float planeWeight)
+				{
+					const double x = normal.x, y = normal.y, z = normal.z, w = distance, s = planeWeight;
+					a00 += s * x * x; a11 += s * y * y; a22 += s * z * z;
+					a10 += s * y * x; a20 += s * z * x; a21 += s * z * y;
+					b0 += s * x * w; b1 += s * y * w; b2 += s * z * w;
+					c += s * w * w;
+					weight += s;
+				}
+
+				void add(const Quadric& other)
+				{
+					a00 += other.a00; a11 += other.a11; a22 += other.a22;
+					a10 += other.a10; a20 += other.a20; a21 += other.a21;
+					b0 += other.b0; b1 += other.b1; b2 += other.b2;
+					c += other.c;
+					weight += other.weight;
+				}
+
+				// Mean squared distance of a point to the planes
+				float error(const glm::vec3& p) const
+				{
+					const double x = p.x, y = p.y, z = p.z;
+					const double rx = a00 * x + a10 * y + a20 * z + b0;
+					const double ry = a10 * x + a11 * y + a21 * z + b1;
+					const double rz = a20 * x + a21 * y + a22 * z + b2;
+					const double result = rx * x + ry * y + rz * z + (b0 * x + b1 * y + b2 * z) + c;
+					return (weight > 0.0) ? static_cast<float>(std::fabs(result) / weight) : 0.0f;
+				}
+			};
+
+			struct Collapse {
+				uint32_t source;
+				uint32_t target;
+				float error;
+			};
+
+			inline glm::vec3 loadPosition(const float* positions, size_t positionStride, uint32_t vertex)
+			{
+				const float* p = reinterpret_cast<const float*>(reinterpret_cast<const unsigned char*>(positions) + vertex * positionStride);
+				return glm::vec3(p[0], p[1], p[2]);
+			}
+		}
+
+		/**
+		* Simulate a FIFO post-transform vertex cache for an index buffer
+		*
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices
+		* @param vertexCount Number of vertices the indices refer to
+		* @param (Optional) cacheSize Number of vertices held by the simulated cache
+		*/
+		VertexCacheStatistics analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize)
+		{
+			VertexCacheStatistics result{};
+			VertexCacheSimulation cache(vertexCount, cacheSize);
+			std::vector<uint8_t> referenced(vertexCount, 0);
+			for (size_t i = 0; i + 2 < indexCount; i += 3) {
+				result.transformedVertices += cache.addTriangle(indices + i);
+				for (uint32_t j = 0; j < 3; j++) {
+					result.vertexCount += referenced[indices[i + j]] ? 0 : 1;
+					referenced[indices[i + j]] = 1;
+				}
+			}
+			result.triangleCount = static_cast<uint32_t>(indexCount / 3);
+			result.acmr = (result.triangleCount > 0) ? static_cast<float>(result.transformedVertices) / static_cast<float>(result.triangleCount) : 0.0f;
+			result.atvr = (result.vertexCount > 0) ? static_cast<float>(result.transformedVertices) / static_cast<float>(result.vertexCount) : 0.0f;
+			return result;
+		}
+
+		/**
+		* Generate a remap table that welds vertices with identical contents
+		*
+		* @param remap Destination for vertexCount entries, new index of each vertex or unusedVertex for vertices that aren't referenced
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices
+		* @param vertices Vertex data
+		* @param vertexCount Number of vertices
+		* @param vertexSize Size of a vertex in bytes, vertices are compared bytewise so padding has to be initialized
+		*
+		* @return Number of unique vertices, new indices are assigned in order of first use
+		*/
+		size_t generateVertexRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t vertexSize)
+		{
+			std::fill(remap, remap + vertexCount, unusedVertex);
+			VertexHashTable table(static_cast<const unsigned char*>(vertices), vertexSize, vertexCount);
+			uint32_t uniqueCount = 0;
+			for (size_t i = 0; i < indexCount; i++) {
+				const uint32_t vertex = indices[i];
+				assert(vertex < vertexCount);
+				if (remap[vertex] != unusedVertex) {
+					continue;
+				}
+				const uint32_t original = table.insert(vertex);
+				remap[vertex] = (original == vertex) ? uniqueCount++ : remap[original];
+			}
+			return uniqueCount;
+		}
+
+		/** @brief Apply a remap table to an index buffer, destination may be the same as indices */
+		void remapIndices(uint32_t* destination, const uint32_t* indices, size_t indexCount, const uint32_t* remap)
+		{
+			for (size_t i = 0; i < indexCount; i++) {
+				destination[i] = remap[indices[i]];
+			}
+		}
+
+		/** @brief Apply a remap table to a vertex buffer, destination must not overlap vertices */
+		void remapVertices(void* destination, const void* vertices, size_t vertexCount, size_t vertexSize, const uint32_t* remap)
+		{
+			unsigned char* dst = static_cast<unsigned char*>(destination);
+			const unsigned char* src = static_cast<const unsigned char*>(vertices);
+			for (size_t i = 0; i < vertexCount; i++) {
+				if (remap[i] != unusedVertex) {
+					memcpy(dst + remap[i] * vertexSize, src + i * vertexSize, vertexSize);
+				}
+			}
+		}
+
+		/**
+		* Reorder the triangles of an index buffer to reduce post-transform vertex cache misses
+		*
+		* @param destination Destination for the reordered indices, may be the same as indices
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices
+		* @param vertexCount Number of vertices the indices refer to
+		*/
+		void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount)
+		{
+			static const VertexScoreTable scoreTable;
+			const std::vector<uint32_t> input(indices, indices + indexCount);
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount == 0) {
+				return;
+			}
+
+			// Triangles using each vertex, the first liveTriangles[v] entries of a vertex's range are the ones not emitted yet
+			std::vector<uint32_t> liveTriangles(vertexCount, 0);
+			for (size_t i = 0; i < triangleCount * 3; i++) {
+				liveTriangles[input[i]]++;
+			}
+			std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+			for (size_t v = 0; v < vertexCount; v++) {
+				adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+			}
+			std::vector<uint32_t> adjacency(triangleCount * 3);
+			{
+				std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < triangleCount * 3; i++) {
+					adjacency[fill[input[i]]++] = static_cast<uint32_t>(i / 3);
+				}
+			}
+
+			std::vector<int32_t> cachePositions(vertexCount, -1);
+			std::vector<float> vertexScores(vertexCount);
+			for (size_t v = 0; v < vertexCount; v++) {
+				vertexScores[v] = scoreTable.score(-1, liveTriangles[v]);
+			}
+			std::vector<float> triangleScores(triangleCount);
+			uint32_t current = 0;
+			for (size_t t = 0; t < triangleCount; t++) {
+				triangleScores[t] = vertexScores[input[t * 3]] + vertexScores[input[t * 3 + 1]] + vertexScores[input[t * 3 + 2]];
+				if (triangleScores[t] > triangleScores[current]) {
+					current = static_cast<uint32_t>(t);
+				}
+			}
+
+			std::vector<uint8_t> emitted(triangleCount, 0);
+			std::vector<uint32_t> cache, newCache;
+			cache.reserve(scoringCacheSize + 3);
+			newCache.reserve(scoringCacheSize + 3);
+			size_t inputCursor = 0;
+			size_t outputCount = 0;
+			while (current != unusedVertex) {
+				const uint32_t* triangle = &input[current * 3];
+				for (uint32_t i = 0; i < 3; i++) {
+					destination[outputCount++] = triangle[i];
+				}
+				emitted[current] = 1;
+
+				// The emitted triangle's vertices move to the front of the cache
+				newCache.assign(triangle, triangle + 3);
+				for (uint32_t vertex : cache) {
+					if ((vertex != triangle[0]) && (vertex != triangle[1]) && (vertex != triangle[2])) {
+						newCache.push_back(vertex);
+					}
+				}
+				for (uint32_t i = 0; i < 3; i++) {
+					const uint32_t vertex = triangle[i];
+					uint32_t* begin = &adjacency[adjacencyOffsets[vertex]];
+					uint32_t* end = begin + liveTriangles[vertex];
+					uint32_t* it = std::find(begin, end, current);
+					if (it != end) {
+						std::swap(*it, *(end - 1));
+						liveTriangles[vertex]--;
+					}
+				}
+
+				// Vertices pushed out of the cache need their scores updated as well
+				for (size_t i = 0; i < newCache.size(); i++) {
+					const uint32_t vertex = newCache[i];
+					cachePositions[vertex] = (i < scoringCacheSize) ? static_cast<int32_t>(i) : -1;
+					vertexScores[vertex] = scoreTable.score(cachePositions[vertex], liveTriangles[vertex]);
+				}
+				uint32_t best = unusedVertex;
+				float bestScore = 0.0f;
+				for (size_t i = 0; i < newCache.size(); i++) {
+					const uint32_t vertex = newCache[i];
+					for (uint32_t j = 0; j < liveTriangles[vertex]; j++) {
+						const uint32_t t = adjacency[adjacencyOffsets[vertex] + j];
+						triangleScores[t] = vertexScores[input[t * 3]] + vertexScores[input[t * 3 + 1]] + vertexScores[input[t * 3 + 2]];
+						if ((i < scoringCacheSize) && (triangleScores[t] > bestScore)) {
+							best = t;
+							bestScore = triangleScores[t];
+						}
+					}
+				}
+				newCache.resize(std::min(newCache.size(), static_cast<size_t>(scoringCacheSize)));
+				cache.swap(newCache);
+
+				// Continue with the next triangle in input order if no triangle is connected to the cache
+				if (best == unusedVertex) {
+					while ((inputCursor < triangleCount) && emitted[inputCursor]) {
+						inputCursor++;
+					}
+					best = (inputCursor < triangleCount) ? static_cast<uint32_t>(inputCursor) : unusedVertex;
+				}
+				current = best;
+			}
+			assert(outputCount == triangleCount * 3);
+		}
+
+		/**
+		* Reorder clusters of a vertex cache optimized index buffer so that triangles facing outwards are drawn first, which reduces overdraw from most view directions
+		*
+		* @param destination Destination for the reordered indices, may be the same as indices
+		* @param indices Triangle list indices, should already be optimized with optimizeVertexCache
+		* @param indexCount Number of indices
+		* @param positions Pointer to the position of the first vertex (three floats)
+		* @param vertexCount Number of vertices the indices refer to
+		* @param positionStride Distance in bytes between two positions
+		* @param (Optional) threshold Factor by which the cache miss ratio of a cluster may exceed the one of the unsplit input, higher values give smaller clusters and less overdraw
+		*
+		* @note Based on "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander et al.)
+		*/
+		void optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride, float threshold)
+		{
+			const std::vector<uint32_t> input(indices, indices + indexCount);
+			const size_t triangleCount = indexCount / 3;
+			if (triangleCount == 0) {
+				return;
+			}
+			const uint32_t cacheSize = 16;
+
+			// Hard boundaries are the points where the vertex cache optimizer had to restart with a disconnected triangle
+			std::vector<uint32_t> hardBoundaries;
+			{
+				VertexCacheSimulation cache(vertexCount, cacheSize);
+				for (size_t t = 0; t < triangleCount; t++) {
+					if ((cache.addTriangle(&input[t * 3]) == 3) || (t == 0)) {
+						hardBoundaries.push_back(static_cast<uint32_t>(t));
+					}
+				}
+				hardBoundaries.push_back(static_cast<uint32_t>(triangleCount));
+			}
+
+			// Hard clusters are split further wherever the cache miss ratio of the part so far is close enough to the one of the whole cluster
+			std::vector<uint32_t> clusters;
+			VertexCacheSimulation cache(vertexCount, cacheSize);
+			for (size_t i = 0; i + 1 < hardBoundaries.size(); i++) {
+				const uint32_t start = hardBoundaries[i];
+				const uint32_t end = hardBoundaries[i + 1];
+				cache.reset();
+				uint32_t clusterMisses = 0;
+				for (uint32_t t = start; t < end; t++) {
+					clusterMisses += cache.addTriangle(&input[t * 3]);
+				}
+				const float limit = static_cast<float>(clusterMisses) / static_cast<float>(end - start) * threshold;
+
+				cache.reset();
+				clusters.push_back(start);
+				uint32_t clusterStart = start;
+				uint32_t misses = 0;
+				for (uint32_t t = start; t < end; t++) {
+					misses += cache.addTriangle(&input[t * 3]);
+					if ((t + 1 < end) && (static_cast<float>(misses) <= limit * static_cast<float>(t + 1 - clusterStart))) {
+						clusters.push_back(t + 1);
+						clusterStart = t + 1;
+						misses = 0;
+						cache.reset();
+					}
+				}
+			}
+			const size_t clusterCount = clusters.size();
+			clusters.push_back(static_cast<uint32_t>(triangleCount));
+
+			// Clusters facing away from the mesh center are drawn first
+			std::vector<glm::vec3> clusterCentroids(clusterCount, glm::vec3(0.0f));
+			std::vector<glm::vec3> clusterNormals(clusterCount, glm::vec3(0.0f));
+			std::vector<float> clusterAreas(clusterCount, 0.0f);
+			glm::vec3 meshCentroid(0.0f);
+			float meshArea = 0.0f;
+			for (size_t c = 0; c < clusterCount; c++) {
+				for (uint32_t t = clusters[c]; t < clusters[c + 1]; t++) {
+					const glm::vec3 p0 = loadPosition(positions, positionStride, input[t * 3]);
+					const glm::vec3 p1 = loadPosition(positions, positionStride, input[t * 3 + 1]);
+					const glm::vec3 p2 = loadPosition(positions, positionStride, input[t * 3 + 2]);
+					const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+					const float area = glm::length(normal) * 0.5f;
+					const glm::vec3 centroid = (p0 + p1 + p2) / 3.0f;
+					clusterCentroids[c] += centroid * area;
+					clusterNormals[c] += normal;
+					clusterAreas[c] += area;
+					meshCentroid += centroid * area;
+					meshArea += area;
+				}
+			}
+			if (meshArea > 0.0f) {
+				meshCentroid /= meshArea;
+			}
+			std::vector<float> sortKeys(clusterCount, 0.0f);
+			for (size_t c = 0; c < clusterCount; c++) {
+				const float normalLength = glm::length(clusterNormals[c]);
+				if ((clusterAreas[c] > 0.0f) && (normalLength > 0.0f)) {
+					sortKeys[c] = glm::dot(clusterCentroids[c] / clusterAreas[c] - meshCentroid, clusterNormals[c] / normalLength);
+				}
+			}
+			std::vector<uint32_t> order(clusterCount);
+			for (size_t c = 0; c < clusterCount; c++) {
+				order[c] = static_cast<uint32_t>(c);
+			}
+			std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) { return sortKeys[a] > sortKeys[b]; });
+
+			size_t outputCount = 0;
+			for (uint32_t c : order) {
+				const size_t first = clusters[c] * 3;
+				const size_t count = (clusters[c + 1] - clusters[c]) * 3;
+				std::copy(input.begin() + first, input.begin() + first + count, destination + outputCount);
+				outputCount += count;
+			}
+		}
+
+		/**
+		* Generate a remap table that orders vertices by their first use in the index buffer, so vertex fetches follow the index order
+		*
+		* @param remap Destination for vertexCount entries, new index of each vertex or unusedVertex for vertices that aren't referenced
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices
+		* @param vertexCount Number of vertices the indices refer to
+		*
+		* @return Number of referenced vertices
+		*/
+		size_t optimizeVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, size_t vertexCount)
+		{
+			std::fill(remap, remap + vertexCount, unusedVertex);
+			uint32_t nextVertex = 0;
+			for (size_t i = 0; i < indexCount; i++) {
+				assert(indices[i] < vertexCount);
+				if (remap[indices[i]] == unusedVertex) {
+					remap[indices[i]] = nextVertex++;
+				}
+			}
+			return nextVertex;
+		}
+
+		/**
+		* Reduce the number of triangles with quadric error metric guided edge collapses
+		*
+		* @param destination Destination for up to indexCount indices, may be the same as indices
+		* @param indices Triangle list indices
+		* @param indexCount Number of indices
+		* @param positions Pointer to the position of the first vertex (three floats)
+		* @param vertexCount Number of vertices the indices refer to
+		* @param positionStride Distance in bytes between two positions
+		* @param targetIndexCount Number of indices to reduce the mesh to
+		* @param targetError Maximum deviation from the input surface relative to the mesh extent (e.g. 0.01 for 1%)
+		* @param resultError (Optional) Receives the largest deviation caused by the simplification, relative to the mesh extent
+		*
+		* @return Number of indices written to destination, may be larger than targetIndexCount if the error limit has been reached first
+		*
+		* @note Vertices are only ever collapsed onto other existing vertices, so the result references a subset of the input's vertices
+		* @note Vertices on borders, attribute seams and non-manifold edges are kept in place, so simplified meshes stay watertight where the input was
+		*/
+		size_t simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride, size_t targetIndexCount, float targetError, float* resultError)
+		{
+			// Degenerate triangles are dropped right away
+			std::vector<uint32_t> result;
+			result.reserve(indexCount);
+			for (size_t i = 0; i + 2 < indexCount; i += 3) {
+				if ((indices[i] != indices[i + 1]) && (indices[i + 1] != indices[i + 2]) && (indices[i] != indices[i + 2])) {
+					result.insert(result.end(), indices + i, indices + i + 3);
+				}
+			}
+			float maxError = 0.0f;
+
+			// Positions are normalized to the unit cube so errors are relative to the mesh extent
+			std::vector<uint8_t> referenced(vertexCount, 0);
+			glm::vec3 minPosition(FLT_MAX), maxPosition(-FLT_MAX);
+			for (uint32_t vertex : result) {
+				if (!referenced[vertex]) {
+					referenced[vertex] = 1;
+					const glm::vec3 p = loadPosition(positions, positionStride, vertex);
+					minPosition = glm::min(minPosition, p);
+					maxPosition = glm::max(maxPosition, p);
+				}
+			}
+			const glm::vec3 size = maxPosition - minPosition;
+			const float extent = std::max(size.x, std::max(size.y, size.z));
+			const float scale = (extent > 0.0f) ? 1.0f / extent : 0.0f;
+			std::vector<glm::vec3> points(vertexCount, glm::vec3(0.0f));
+			for (size_t v = 0; v < vertexCount; v++) {
+				if (referenced[v]) {
+					points[v] = (loadPosition(positions, positionStride, static_cast<uint32_t>(v)) - minPosition) * scale;
+				}
+			}
+
+			// Vertices sharing a position (e.g. along UV seams) are mapped to the first of them
+			std::vector<uint32_t> positionIndices(vertexCount);
+			std::vector<uint32_t> wedgeCounts(vertexCount, 0);
+			{
+				VertexHashTable table(reinterpret_cast<const unsigned char*>(points.data()), sizeof(glm::vec3), vertexCount);
+				for (size_t v = 0; v < vertexCount; v++) {
+					positionIndices[v] = referenced[v] ? table.insert(static_cast<uint32_t>(v)) : static_cast<uint32_t>(v);
+					wedgeCounts[positionIndices[v]] += referenced[v];
+				}
+			}
+
+			// Only vertices with a single wedge whose edges are all shared by exactly two consistently oriented triangles may be collapsed
+			std::vector<uint8_t> locked(vertexCount, 0);
+			{
+				std::unordered_map<uint64_t, uint32_t> edges;
+				auto edgeKey = [](uint32_t a, uint32_t b) { return (static_cast<uint64_t>(a) << 32) | b; };
+				for (size_t i = 0; i < result.size(); i += 3) {
+					for (uint32_t e = 0; e < 3; e++) {
+						edges[edgeKey(positionIndices[result[i + e]], positionIndices[result[i + (e + 1) % 3]])]++;
+					}
+				}
+				for (size_t i = 0; i < result.size(); i += 3) {
+					for (uint32_t e = 0; e < 3; e++) {
+						const uint32_t a = positionIndices[result[i + e]];
+						const uint32_t b = positionIndices[result[i + (e + 1) % 3]];
+						auto reverse = edges.find(edgeKey(b, a));
+						if ((edges[edgeKey(a, b)] != 1) || (reverse == edges.end()) || (reverse->second != 1)) {
+							locked[a] = 1;
+							locked[b] = 1;
+						}
+					}
+				}
+				for (size_t v = 0; v < vertexCount; v++) {
+					if (wedgeCounts[positionIndices[v]] > 1) {
+						locked[positionIndices[v]] = 1;
+					}
+				}
+			}
+
+			std::vector<Quadric> quadrics(vertexCount);
+			for (size_t i = 0; i < result.size(); i += 3) {
+				const glm::vec3& p0 = points[result[i]];
+				const glm::vec3 normal = glm::cross(points[result[i + 1]] - p0, points[result[i + 2]] - p0);
+				const float length = glm::length(normal);
+				if (length > 0.0f) {
+					const glm::vec3 n = normal / length;
+					for (uint32_t j = 0; j < 3; j++) {
+						quadrics[positionIndices[result[i + j]]].addPlane(n, -glm::dot(n, p0), length * 0.5f);
+					}
+				}
+			}
+
+			const size_t targetTriangles = targetIndexCount / 3;
+			const float errorLimit = targetError * targetError;
+			std::vector<uint32_t> adjacencyOffsets(vertexCount + 1);
+			std::vector<uint32_t> adjacency;
+			std::vector<Collapse> collapses;
+			std::vector<uint32_t> collapseTargets(vertexCount);
+			std::vector<uint8_t> touched(vertexCount);
+			// Every pass performs a batch of independent collapses, so each collapse only needs to be validated against the triangles of the current pass
+			while (result.size() / 3 > targetTriangles) {
+				const size_t triangleCount = result.size() / 3;
+				std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+				for (uint32_t vertex : result) {
+					adjacencyOffsets[vertex + 1]++;
+				}
+				for (size_t v = 0; v < vertexCount; v++) {
+					adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+				}
+				adjacency.resize(result.size());
+				{
+					std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+					for (size_t i = 0; i < result.size(); i++) {
+						adjacency[fill[result[i]]++] = static_cast<uint32_t>(i / 3);
+					}
+				}
+
+				collapses.clear();
+				for (size_t i = 0; i < result.size(); i += 3) {
+					for (uint32_t e = 0; e < 3; e++) {
+						const uint32_t a = result[i + e];
+						const uint32_t b = result[i + (e + 1) % 3];
+						if (!locked[positionIndices[a]]) {
+							collapses.push_back({ a, b, quadrics[positionIndices[a]].error(points[b]) });
+						}
+						if (!locked[positionIndices[b]]) {
+							collapses.push_back({ b, a, quadrics[positionIndices[b]].error(points[a]) });
+						}
+					}
+				}
+				std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+					if (a.error != b.error) {
+						return a.error < b.error;
+					}
+					return (a.source != b.source) ? (a.source < b.source) : (a.target < b.target);
+				});
+
+				// Each collapse removes two triangles of a closed manifold
+				const size_t collapseGoal = std::max<size_t>((triangleCount - targetTriangles + 1) / 2, 1);
+				size_t collapseCount = 0;
+				for (size_t v = 0; v < vertexCount; v++) {
+					collapseTargets[v] = static_cast<uint32_t>(v);
+				}
+				std::fill(touched.begin(), touched.end(), 0);
+				for (const Collapse& collapse : collapses) {
+					if ((collapse.error > errorLimit) || (collapseCount >= collapseGoal)) {
+						break;
+					}
+					if (touched[positionIndices[collapse.source]] || touched[positionIndices[collapse.target]]) {
+						continue;
+					}
+					// Reject collapses that would flip or fold the remaining triangles around the source vertex
+					bool flipped = false;
+					const glm::vec3& target = points[collapse.target];
+					for (uint32_t j = adjacencyOffsets[collapse.source]; (j < adjacencyOffsets[collapse.source + 1]) && !flipped; j++) {
+						const uint32_t* triangle = &result[adjacency[j] * 3];
+						if ((triangle[0] == collapse.target) || (triangle[1] == collapse.target) || (triangle[2] == collapse.target)) {
+							continue;
+						}
+						const uint32_t corner = (triangle[0] == collapse.source) ? 0 : ((triangle[1] == collapse.source) ? 1 : 2);
+						const glm::vec3& p1 = points[triangle[(corner + 1) % 3]];
+						const glm::vec3& p2 = points[triangle[(corner + 2) % 3]];
+						const glm::vec3 before = glm::cross(p1 - points[collapse.source], p2 - points[collapse.source]);
+						const glm::vec3 after = glm::cross(p1 - target, p2 - target);
+						flipped = glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after);
+					}
+					if (flipped) {
+						continue;
+					}
+					collapseTargets[collapse.source] = collapse.target;
+					quadrics[positionIndices[collapse.target]].add(quadrics[positionIndices[collapse.source]]);
+					for (uint32_t j = adjacencyOffsets[collapse.source]; j < adjacencyOffsets[collapse.source + 1]; j++) {
+						const uint32_t* triangle = &result[adjacency[j] * 3];
+						for (uint32_t k = 0; k < 3; k++) {
+							touched[positionIndices[triangle[k]]] = 1;
+						}
+					}
+					maxError = std::max(maxError, collapse.error);
+					collapseCount++;
+				}
+				if (collapseCount == 0) {
+					break;
+				}
+
+				size_t writeOffset = 0;
+				for (size_t i = 0; i < result.size(); i += 3) {
+					const uint32_t a = collapseTargets[result[i]];
+					const uint32_t b = collapseTargets[result[i + 1]];
+					const uint32_t c = collapseTargets[result[i + 2]];
+					if ((a != b) && (b != c) && (a != c)) {
+						result[writeOffset++] = a;
+						result[writeOffset++] = b;
+						result[writeOffset++] = c;
+					}
+				}
+				result.resize(writeOffset);
+			}
+
+			std::copy(result.begin(), result.end(), destination);
+			if (resultError) {
+				*resultError = sqrtf(maxError);
+			}
+			return result.size();
+		}
+	}
+}
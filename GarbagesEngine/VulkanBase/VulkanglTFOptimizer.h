@@ -0,0 +1,44 @@
+/*
+ * glTF mesh optimization functions
+ *
+ * Vertex welding, vertex cache, overdraw and vertex fetch optimization of indexed triangle lists along with a quadric error mesh simplifier used to generate LODs
+ * All functions work on a single primitive with indices relative to its first vertex and are deterministic, so their results can be stored in the mesh cache
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vkglTF
+{
+	namespace optimizer
+	{
+		/** @brief Result of a post-transform vertex cache simulation */
+		struct VertexCacheStatistics {
+			/** @brief Number of distinct vertices referenced by the indices */
+			uint32_t vertexCount = 0;
+			uint32_t triangleCount = 0;
+			/** @brief Number of vertex shader invocations, i.e. cache misses */
+			uint32_t transformedVertices = 0;
+			/** @brief Average cache miss ratio, transformed vertices per triangle (3 is the worst case, around 0.5 the best case for regular meshes) */
+			float acmr = 0.0f;
+			/** @brief Average transformed vertex ratio, transformed vertices per referenced vertex (1 is the best case) */
+			float atvr = 0.0f;
+		};
+
+		/** @brief Value of remap table entries for vertices that aren't referenced by any index */
+		const uint32_t unusedVertex = ~0u;
+
+		VertexCacheStatistics analyzeVertexCache(const uint32_t* indices, size_t indexCount, size_t vertexCount, uint32_t cacheSize = 16);
+		size_t generateVertexRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, const void* vertices, size_t vertexCount, size_t vertexSize);
+		void remapIndices(uint32_t* destination, const uint32_t* indices, size_t indexCount, const uint32_t* remap);
+		void remapVertices(void* destination, const void* vertices, size_t vertexCount, size_t vertexSize, const uint32_t* remap);
+		void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, size_t vertexCount);
+		void optimizeOverdraw(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride, float threshold = 1.05f);
+		size_t optimizeVertexFetchRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, size_t vertexCount);
+		size_t simplify(uint32_t* destination, const uint32_t* indices, size_t indexCount, const float* positions, size_t vertexCount, size_t positionStride, size_t targetIndexCount, float targetError, float* resultError);
+	}
+}
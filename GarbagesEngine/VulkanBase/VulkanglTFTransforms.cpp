@@ -0,0 +1,197 @@
+/*
+ * Flattened glTF node transform hierarchy
+ *
+ * Stores the local transforms and world matrices of all nodes of a model in parent before child order,
+ * so world matrices can be brought up to date with a single linear pass that only touches dirty subtrees
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#include "VulkanglTFTransforms.h"
+
+#include <algorithm>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define VKGLTF_TRANSFORMS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace vkglTF
+{
+	namespace
+	{
+#if defined(VKGLTF_TRANSFORMS_SSE2)
+		// Column major matrix held in registers
+		struct Matrix4 {
+			__m128 columns[4];
+		};
+
+		inline Matrix4 load(const glm::mat4& m)
+		{
+			const float* p = &m[0][0];
+			return { { _mm_loadu_ps(p), _mm_loadu_ps(p + 4), _mm_loadu_ps(p + 8), _mm_loadu_ps(p + 12) } };
+		}
+
+		inline void store(const Matrix4& m, glm::mat4& result)
+		{
+			float* p = &result[0][0];
+			for (uint32_t c = 0; c < 4; c++) {
+				_mm_storeu_ps(p + c * 4, m.columns[c]);
+			}
+		}
+
+		// Product with an affine matrix b (last row 0, 0, 0, 1), each result column is a combination of the columns of a weighted by a column of b, skipping the known zero and one components
+		inline Matrix4 multiplyAffine(const Matrix4& a, const glm::mat4& b)
+		{
+			Matrix4 result;
+			const float* pb = &b[0][0];
+			for (uint32_t c = 0; c < 4; c++) {
+				const float* col = pb + c * 4;
+				const __m128 xyz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a.columns[0], _mm_set1_ps(col[0])), _mm_mul_ps(a.columns[1], _mm_set1_ps(col[1]))), _mm_mul_ps(a.columns[2], _mm_set1_ps(col[2])));
+				result.columns[c] = (c == 3) ? _mm_add_ps(xyz, a.columns[3]) : xyz;
+			}
+			return result;
+		}
+#endif
+
+		// result = a * b for affine column major matrices, result may alias a or b
+		inline void multiplyAffine(const glm::mat4& a, const glm::mat4& b, glm::mat4& result)
+		{
+#if defined(VKGLTF_TRANSFORMS_SSE2)
+			store(multiplyAffine(load(a), b), result);
+#else
+			result = a * b;
+#endif
+		}
+	}
+
+	/**
+	* Append a node to the hierarchy, the node starts out dirty
+	*
+	* @param parent Index of the parent returned by an earlier call, -1 for root nodes
+	* @param translation Local translation
+	* @param rotation Local rotation
+	* @param scale Local scale
+	* @param matrix Static node matrix
+	*
+	* @return Index of the node's transform
+	*/
+	uint32_t TransformHierarchy::add(int32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, const glm::mat4& matrix)
+	{
+		const uint32_t index = static_cast<uint32_t>(parents.size());
+		assert(parent < static_cast<int32_t>(index));
+		parents.push_back(parent);
+		translations.push_back(translation);
+		rotations.push_back(rotation);
+		scales.push_back(scale);
+		matrices.push_back(matrix);
+		worldMatrices.push_back(glm::mat4(1.0f));
+		changed.push_back(0);
+		dirty.push_back(1);
+		firstDirty = std::min(firstDirty, static_cast<size_t>(index));
+		return index;
+	}
+
+	/**
+	* Replace the local transform of a node and flag it for the next update
+	*
+	* @param index Index of the node's transform
+	* @param translation Local translation
+	* @param rotation Local rotation
+	* @param scale Local scale
+	* @param matrix Static node matrix
+	*/
+	void TransformHierarchy::setLocal(uint32_t index, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, const glm::mat4& matrix)
+	{
+		translations[index] = translation;
+		rotations[index] = rotation;
+		scales[index] = scale;
+		matrices[index] = matrix;
+		dirty[index] = 1;
+		firstDirty = std::min(firstDirty, static_cast<size_t>(index));
+	}
+
+	/**
+	* Recompute the world matrices of all dirty nodes and their descendants
+	*
+	* @return True if at least one world matrix has been recomputed
+	*/
+	bool TransformHierarchy::update()
+	{
+		const size_t count = parents.size();
+		if (firstDirty >= count) {
+			return false;
+		}
+		// Parents are visited before their children, so a dirty flag set here propagates down the whole subtree within the same pass
+		for (size_t i = firstDirty; i < count; i++) {
+			const int32_t parent = parents[i];
+			if (!dirty[i] && ((parent < 0) || !dirty[parent])) {
+				continue;
+			}
+			dirty[i] = 1;
+			changed[i] = 1;
+			// Same as translate(translation) * mat4(rotation) * scale(scale) * matrix, without the full matrix products
+			glm::mat4 local = glm::mat4_cast(rotations[i]);
+			local[0] *= scales[i].x;
+			local[1] *= scales[i].y;
+			local[2] *= scales[i].z;
+			local[3] = glm::vec4(translations[i], 1.0f);
+			// glTF node transforms are affine, so are all products of them
+			multiplyAffine(local, matrices[i], local);
+			if (parent < 0) {
+				worldMatrices[i] = local;
+			} else {
+				multiplyAffine(worldMatrices[parent], local, worldMatrices[i]);
+			}
+		}
+		std::fill(dirty.begin() + firstDirty, dirty.end(), 0);
+		firstDirty = count;
+		return true;
+	}
+
+	/** @brief Reset the changed flags once the recomputed world matrices have been consumed */
+	void TransformHierarchy::clearChanged()
+	{
+		std::fill(changed.begin(), changed.end(), 0);
+	}
+
+	/**
+	* Compute the joint matrices of a skin from the current world matrices
+	*
+	* @note All matrices are expected to be affine, which holds for glTF node transforms and inverse bind matrices
+	*
+	* @param inverseMeshMatrix Inverse world matrix of the skinned mesh's node
+	* @param jointIndices Transform index of each joint
+	* @param inverseBindMatrices Inverse bind matrix of each joint
+	* @param count Number of joints
+	* @param result Destination for count joint matrices, may point to mapped device memory as it is only written sequentially
+	*/
+	void TransformHierarchy::computeJointMatrices(const glm::mat4& inverseMeshMatrix, const uint32_t* jointIndices, const glm::mat4* inverseBindMatrices, size_t count, glm::mat4* result) const
+	{
+#if defined(VKGLTF_TRANSFORMS_SSE2)
+		// The inverse mesh matrix and the intermediate product stay in registers for the whole batch
+		const Matrix4 inverseMesh = load(inverseMeshMatrix);
+		for (size_t i = 0; i < count; i++) {
+			store(multiplyAffine(multiplyAffine(inverseMesh, worldMatrices[jointIndices[i]]), inverseBindMatrices[i]), result[i]);
+		}
+#else
+		for (size_t i = 0; i < count; i++) {
+			result[i] = inverseMeshMatrix * worldMatrices[jointIndices[i]] * inverseBindMatrices[i];
+		}
+#endif
+	}
+
+	void TransformHierarchy::clear()
+	{
+		parents.clear();
+		translations.clear();
+		rotations.clear();
+		scales.clear();
+		matrices.clear();
+		worldMatrices.clear();
+		changed.clear();
+		dirty.clear();
+		firstDirty = 0;
+	}
+}
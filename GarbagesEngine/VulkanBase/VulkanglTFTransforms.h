@@ -0,0 +1,61 @@
+/*
+ * Flattened glTF node transform hierarchy
+ *
+ * Stores the local transforms and world matrices of all nodes of a model in parent before child order,
+ * so world matrices can be brought up to date with a single linear pass that only touches dirty subtrees
+ *
+ * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#define GLM_FORCE_RADIANS
+#define GLM_FORCE_DEPTH_ZERO_TO_ONE
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+namespace vkglTF
+{
+	/**
+	* @brief Node transforms stored as arrays, a node's parent is always stored before the node itself
+	* @note Changing a local transform only flags the node, world matrices of the node and its subtree are recomputed by the next update
+	*/
+	class TransformHierarchy
+	{
+	public:
+		/** @brief Index of the parent transform, -1 for root nodes */
+		std::vector<int32_t> parents;
+		std::vector<glm::vec3> translations;
+		std::vector<glm::quat> rotations;
+		std::vector<glm::vec3> scales;
+		/** @brief Static node matrix applied after translation, rotation and scale */
+		std::vector<glm::mat4> matrices;
+		std::vector<glm::mat4> worldMatrices;
+		/** @brief Set for nodes whose world matrix has been recomputed since the last call to clearChanged */
+		std::vector<uint8_t> changed;
+
+		uint32_t add(int32_t parent, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, const glm::mat4& matrix);
+		void setLocal(uint32_t index, const glm::vec3& translation, const glm::quat& rotation, const glm::vec3& scale, const glm::mat4& matrix);
+		bool update();
+		/** @brief World matrix of a node, updates the hierarchy first if any local transform has changed */
+		const glm::mat4& getWorldMatrix(uint32_t index)
+		{
+			update();
+			return worldMatrices[index];
+		}
+		void clearChanged();
+		void computeJointMatrices(const glm::mat4& inverseMeshMatrix, const uint32_t* jointIndices, const glm::mat4* inverseBindMatrices, size_t count, glm::mat4* result) const;
+		void clear();
+		size_t size() const { return parents.size(); }
+
+	private:
+		/** @brief Set for nodes whose local transform has changed since the last update */
+		std::vector<uint8_t> dirty;
+		/** @brief Lowest dirty index, nothing stored before it needs to be visited by the next update */
+		size_t firstDirty = 0;
+	};
+}
@@ -57,7 +57,7 @@ namespace vks
 			}
 		}
 		
-		bool checkSphere(glm::vec3 pos, float radius)
+		bool checkSphere(glm::vec3 pos, float radius) const
 		{
 			for (auto i = 0; i < planes.size(); i++)
 			{
@@ -68,5 +68,20 @@ namespace vks
 			}
 			return true;
 		}
+
+		// Axis aligned box given by its center and half extents, conservative for boxes crossing the corner of two planes
+		bool checkBox(const glm::vec3& center, const glm::vec3& extents) const
+		{
+			for (auto i = 0; i < planes.size(); i++)
+			{
+				const float distance = (planes[i].x * center.x) + (planes[i].y * center.y) + (planes[i].z * center.z) + planes[i].w;
+				const float radius = (fabsf(planes[i].x) * extents.x) + (fabsf(planes[i].y) * extents.y) + (fabsf(planes[i].z) * extents.z);
+				if (distance <= -radius)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
 	};
 }
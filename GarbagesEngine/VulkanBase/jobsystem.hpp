@@ -0,0 +1,478 @@
+/*
+* Work stealing job system
+*
+* Each worker pushes and pops jobs at the bottom of its own lock-free deque, idle workers steal from the top of the others' deques
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace vks
+{
+	/**
+	* @brief Fixed size work stealing deque (Chase-Lev, using the C11 memory model mapping by Le et al.)
+	* @note push and pop may only be called by the owning thread, steal may be called by any thread
+	*/
+	template<typename T>
+	class WorkStealingDeque
+	{
+	private:
+		std::atomic<int64_t> top{ 0 };
+		std::atomic<int64_t> bottom{ 0 };
+		std::unique_ptr<std::atomic<T>[]> items;
+		int64_t mask;
+
+	public:
+		/** @brief capacity must be a power of two */
+		explicit WorkStealingDeque(uint32_t capacity) : items(new std::atomic<T>[capacity]), mask(static_cast<int64_t>(capacity) - 1)
+		{
+			assert((capacity & (capacity - 1)) == 0);
+		}
+
+		// Returns false if the deque is full
+		bool push(T item)
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed);
+			int64_t t = top.load(std::memory_order_acquire);
+			if (b - t > mask)
+			{
+				return false;
+			}
+			items[b & mask].store(item, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			bottom.store(b + 1, std::memory_order_relaxed);
+			return true;
+		}
+
+		// Takes the most recently pushed item, returns a default constructed T if the deque is empty
+		T pop()
+		{
+			int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+			bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = top.load(std::memory_order_relaxed);
+			T item{};
+			if (t <= b)
+			{
+				item = items[b & mask].load(std::memory_order_relaxed);
+				if (t == b)
+				{
+					// Last item, race against concurrent thieves
+					if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+					{
+						item = T{};
+					}
+					bottom.store(b + 1, std::memory_order_relaxed);
+				}
+			}
+			else
+			{
+				bottom.store(b + 1, std::memory_order_relaxed);
+			}
+			return item;
+		}
+
+		// Takes the oldest item, returns a default constructed T if the deque is empty or another thread won the race for the item
+		T steal()
+		{
+			int64_t t = top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = bottom.load(std::memory_order_acquire);
+			if (t >= b)
+			{
+				return T{};
+			}
+			T item = items[t & mask].load(std::memory_order_relaxed);
+			if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+			{
+				return T{};
+			}
+			return item;
+		}
+	};
+
+	/**
+	* @brief Type erased callable with inline storage, so small lambdas can be stored without a heap allocation
+	* @note Callables that don't fit the inline storage are moved to the heap
+	*/
+	class Job
+	{
+	public:
+		static const size_t inlineSize = 48;
+
+		Job() = default;
+		Job(const Job&) = delete;
+		Job& operator=(const Job&) = delete;
+		~Job()
+		{
+			reset();
+		}
+
+		template<typename F>
+		void set(F&& function)
+		{
+			using Function = typename std::decay<F>::type;
+			reset();
+			store<Function>(std::forward<F>(function), std::integral_constant<bool, (sizeof(Function) <= inlineSize) && (alignof(Function) <= alignof(std::max_align_t))>());
+		}
+
+		void operator()()
+		{
+			invokeFunction(storage);
+		}
+
+		void reset()
+		{
+			if (destroyFunction)
+			{
+				destroyFunction(storage);
+				invokeFunction = nullptr;
+				destroyFunction = nullptr;
+			}
+		}
+
+	private:
+		alignas(std::max_align_t) unsigned char storage[inlineSize];
+		void (*invokeFunction)(void*) = nullptr;
+		void (*destroyFunction)(void*) = nullptr;
+
+		template<typename Function, typename F>
+		void store(F&& function, std::true_type)
+		{
+			new (storage) Function(std::forward<F>(function));
+			invokeFunction = [](void* data) { (*static_cast<Function*>(data))(); };
+			destroyFunction = [](void* data) { static_cast<Function*>(data)->~Function(); };
+		}
+
+		template<typename Function, typename F>
+		void store(F&& function, std::false_type)
+		{
+			*reinterpret_cast<Function**>(storage) = new Function(std::forward<F>(function));
+			invokeFunction = [](void* data) { (**static_cast<Function**>(data))(); };
+			destroyFunction = [](void* data) { delete *static_cast<Function**>(data); };
+		}
+	};
+
+	/** @brief Wait group counting the unfinished jobs that were submitted with it, see JobSystem::wait */
+	class JobCounter
+	{
+	public:
+		JobCounter() = default;
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+
+		bool isDone() const
+		{
+			return pending.load(std::memory_order_acquire) == 0;
+		}
+
+	private:
+		friend class JobSystem;
+		std::atomic<uint32_t> pending{ 0 };
+	};
+
+	/**
+	* @brief Work stealing scheduler
+	* @note The thread that creates the job system takes part as worker 0 whenever it waits, so a system with N threads runs jobs on N + 1 threads
+	* @note Jobs can be submitted from any thread, jobs from threads that aren't part of the system go through a shared queue
+	*/
+	class JobSystem
+	{
+	private:
+		static const uint32_t queueCapacity = 1024;
+
+		struct Task
+		{
+			Job job;
+			JobCounter* counter = nullptr;
+			std::atomic<bool> inUse{ false };
+			bool heapAllocated = false;
+		};
+
+		struct Worker
+		{
+			JobSystem* system;
+			WorkStealingDeque<Task*> queue{ queueCapacity };
+			// Ring of tasks submitted by this worker, a slot is reused once the task that used it has finished
+			std::unique_ptr<Task[]> tasks{ new Task[queueCapacity] };
+			uint32_t nextTask = 0;
+			uint32_t random;
+		};
+
+		std::vector<std::unique_ptr<Worker>> workers;
+		std::vector<std::thread> threads;
+		Worker* previousWorker;
+
+		// Jobs submitted from threads that aren't part of this system
+		std::deque<Task*> injectedTasks;
+		std::mutex injectedMutex;
+		std::atomic<uint32_t> injectedCount{ 0 };
+
+		// Number of submitted tasks that have not yet been picked up, idle workers sleep while it is zero
+		std::atomic<int32_t> queuedTasks{ 0 };
+		std::atomic<uint32_t> sleepingWorkers{ 0 };
+		std::mutex sleepMutex;
+		std::condition_variable wakeCondition;
+		bool stopping = false;
+
+		static Worker*& currentWorker()
+		{
+			static thread_local Worker* worker = nullptr;
+			return worker;
+		}
+
+		Worker* localWorker()
+		{
+			Worker* worker = currentWorker();
+			return (worker && worker->system == this) ? worker : nullptr;
+		}
+
+		Task* allocateTask(Worker* worker)
+		{
+			if (worker)
+			{
+				Task* task = &worker->tasks[worker->nextTask++ & (queueCapacity - 1)];
+				// The slot can still be taken by an unfinished task (possibly one further up this thread's stack), waiting for it could deadlock
+				if (!task->inUse.load(std::memory_order_acquire))
+				{
+					task->inUse.store(true, std::memory_order_relaxed);
+					return task;
+				}
+			}
+			Task* task = new Task();
+			task->heapAllocated = true;
+			return task;
+		}
+
+		void execute(Task* task)
+		{
+			task->job();
+			task->job.reset();
+			JobCounter* counter = task->counter;
+			if (task->heapAllocated)
+			{
+				delete task;
+			}
+			else
+			{
+				task->inUse.store(false, std::memory_order_release);
+			}
+			// Must be the last access, a waiting thread may destroy the counter right after this
+			if (counter)
+			{
+				counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+			}
+		}
+
+		Task* findTask(Worker* worker)
+		{
+			Task* task = worker ? worker->queue.pop() : nullptr;
+			if (!task && (injectedCount.load(std::memory_order_acquire) > 0))
+			{
+				std::lock_guard<std::mutex> lock(injectedMutex);
+				if (!injectedTasks.empty())
+				{
+					task = injectedTasks.front();
+					injectedTasks.pop_front();
+					injectedCount.fetch_sub(1, std::memory_order_relaxed);
+				}
+			}
+			if (!task)
+			{
+				uint32_t start = 0;
+				if (worker)
+				{
+					// xorshift to spread thieves over the victims
+					worker->random ^= worker->random << 13;
+					worker->random ^= worker->random >> 17;
+					worker->random ^= worker->random << 5;
+					start = worker->random;
+				}
+				for (size_t i = 0; i < workers.size() && !task; i++)
+				{
+					Worker* victim = workers[(start + i) % workers.size()].get();
+					if (victim != worker)
+					{
+						task = victim->queue.steal();
+					}
+				}
+			}
+			if (task)
+			{
+				queuedTasks.fetch_sub(1);
+			}
+			return task;
+		}
+
+		bool runNext(Worker* worker)
+		{
+			Task* task = findTask(worker);
+			if (task)
+			{
+				execute(task);
+			}
+			return task != nullptr;
+		}
+
+		void workerLoop(Worker* worker)
+		{
+			currentWorker() = worker;
+			while (true)
+			{
+				if (runNext(worker))
+				{
+					continue;
+				}
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				sleepingWorkers.fetch_add(1);
+				wakeCondition.wait(lock, [this] { return queuedTasks.load() > 0 || stopping; });
+				sleepingWorkers.fetch_sub(1);
+				if (stopping && queuedTasks.load() <= 0)
+				{
+					break;
+				}
+			}
+		}
+
+	public:
+		/** @brief Number of worker threads that fully use the CPU together with the thread creating the system */
+		static uint32_t defaultThreadCount()
+		{
+			return std::max(std::thread::hardware_concurrency(), 1u) - 1;
+		}
+
+		explicit JobSystem(uint32_t threadCount = defaultThreadCount())
+		{
+			for (uint32_t i = 0; i <= threadCount; i++)
+			{
+				std::unique_ptr<Worker> worker(new Worker());
+				worker->system = this;
+				worker->random = 0x9E3779B9u * (i + 1);
+				workers.push_back(std::move(worker));
+			}
+			previousWorker = currentWorker();
+			currentWorker() = workers[0].get();
+			for (uint32_t i = 1; i <= threadCount; i++)
+			{
+				threads.push_back(std::thread(&JobSystem::workerLoop, this, workers[i].get()));
+			}
+		}
+
+		~JobSystem()
+		{
+			// Must be destroyed by the thread that created it
+			assert(currentWorker() == workers[0].get());
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				stopping = true;
+			}
+			wakeCondition.notify_all();
+			for (auto& thread : threads)
+			{
+				thread.join();
+			}
+			// Jobs nobody waited for are still run before the system goes away
+			while (runNext(workers[0].get()));
+			currentWorker() = previousWorker;
+		}
+
+		/** @brief Number of worker threads, not counting the thread that created the system */
+		uint32_t getThreadCount() const
+		{
+			return static_cast<uint32_t>(threads.size());
+		}
+
+		/**
+		* @brief Submit a job
+		* @param function Callable without arguments, copied or moved into the job
+		* @param counter (Optional) Wait group the job is added to
+		*/
+		template<typename F>
+		void run(F&& function, JobCounter* counter = nullptr)
+		{
+			if (counter)
+			{
+				counter->pending.fetch_add(1, std::memory_order_relaxed);
+			}
+			Worker* worker = localWorker();
+			Task* task = allocateTask(worker);
+			task->job.set(std::forward<F>(function));
+			task->counter = counter;
+			queuedTasks.fetch_add(1);
+			if (worker)
+			{
+				if (!worker->queue.push(task))
+				{
+					// Queue is full, run the job right away
+					queuedTasks.fetch_sub(1);
+					execute(task);
+					return;
+				}
+			}
+			else
+			{
+				std::lock_guard<std::mutex> lock(injectedMutex);
+				injectedTasks.push_back(task);
+				injectedCount.fetch_add(1, std::memory_order_release);
+			}
+			if (sleepingWorkers.load() > 0)
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				wakeCondition.notify_one();
+			}
+		}
+
+		/** @brief Run jobs (from any queue) until all jobs of the counter have finished */
+		void wait(JobCounter& counter)
+		{
+			Worker* worker = localWorker();
+			while (!counter.isDone())
+			{
+				if (!runNext(worker))
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		/**
+		* @brief Call function(i) for all i in [0, count) and return once all calls have finished
+		* @param count Number of indices
+		* @param grainSize Number of consecutive indices handled by a single job
+		* @param function Callable taking an uint32_t index, called concurrently from multiple threads
+		*/
+		template<typename F>
+		void parallelFor(uint32_t count, uint32_t grainSize, F&& function)
+		{
+			JobCounter counter;
+			grainSize = std::max(grainSize, 1u);
+			for (uint32_t begin = 0; begin < count; begin += grainSize)
+			{
+				uint32_t end = begin + std::min(grainSize, count - begin);
+				run([&function, begin, end]() {
+					for (uint32_t i = begin; i < end; i++)
+					{
+						function(i);
+					}
+				}, &counter);
+			}
+			wait(counter);
+		}
+	};
+}
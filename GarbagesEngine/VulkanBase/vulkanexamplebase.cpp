@@ -160,10 +160,21 @@ VkResult VulkanExampleBase::createInstance()
 
 void VulkanExampleBase::renderFrame()
 {
-	VulkanExampleBase::prepareFrame();
+	// Nothing can be submitted or presented for this frame if no image was acquired, the swap chain has been recreated instead
+	if (!VulkanExampleBase::prepareFrame()) {
+		return;
+	}
 	submitInfo.commandBufferCount = 1;
-	submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
-	VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+	if (maxConcurrentFrames > 0) {
+		// The frame's command buffer can only be recorded once its fence has been waited for and the target image is known
+		buildFrameCommandBuffer();
+		submitInfo.pCommandBuffers = &drawCmdBuffers[currentFrame];
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, waitFences[currentFrame]));
+	}
+	else {
+		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
+		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
+	}
 	VulkanExampleBase::submitFrame();
 }
 
@@ -178,8 +189,8 @@ std::string VulkanExampleBase::getWindowTitle()
 
 void VulkanExampleBase::createCommandBuffers()
 {
-	// Create one command buffer for each swap chain image
-	drawCmdBuffers.resize(swapChain.imageCount);
+	// Create one command buffer for each swap chain image, or one for each frame in flight
+	drawCmdBuffers.resize((maxConcurrentFrames > 0) ? maxConcurrentFrames : swapChain.imageCount);
 	VkCommandBufferAllocateInfo cmdBufAllocateInfo = vks::initializers::commandBufferAllocateInfo(cmdPool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, static_cast<uint32_t>(drawCmdBuffers.size()));
 	VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, drawCmdBuffers.data()));
 }
@@ -216,6 +227,7 @@ void VulkanExampleBase::prepare()
 	if (settings.overlay) {
 		ui.device = vulkanDevice;
 		ui.queue = queue;
+		ui.maxConcurrentFrames = std::max(maxConcurrentFrames, 1u);
 		ui.shaders = {
 			loadShader(getShadersPath() + "base/uioverlay.vert.spv", VK_SHADER_STAGE_VERTEX_BIT),
 			loadShader(getShadersPath() + "base/uioverlay.frag.spv", VK_SHADER_STAGE_FRAGMENT_BIT),
@@ -293,6 +305,9 @@ void VulkanExampleBase::nextFrame()
 
 void VulkanExampleBase::renderLoop()
 {
+	// All assets have been loaded by the example's prepare at this point
+	vulkanDevice->logMemoryStatistics();
+
 // SRS - for non-apple plaforms, handle benchmarking here within VulkanExampleBase::renderLoop()
 //     - for macOS, handle benchmarking within NSApp rendering loop via displayLinkOutputCb()
 #if !(defined(VK_USE_PLATFORM_IOS_MVK) || defined(VK_USE_PLATFORM_MACOS_MVK) || defined(VK_USE_PLATFORM_METAL_EXT))
@@ -695,6 +710,10 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::TextUnformatted(title.c_str());
 	ImGui::TextUnformatted(deviceProperties.deviceName);
 	ImGui::Text("%.2f ms/frame (%.1d fps)", (1000.0f / lastFPS), lastFPS);
+	if (vulkanDevice->allocator) {
+		const vks::VulkanDevice::MemoryStatistics memoryStatistics = vulkanDevice->getMemoryStatistics();
+		ImGui::Text("%u allocations in %u blocks (%.1f MB)", memoryStatistics.allocationCount, memoryStatistics.blockCount, memoryStatistics.blockBytes / (1024.0f * 1024.0f));
+	}
 
 #if defined(VK_USE_PLATFORM_ANDROID_KHR)
 	ImGui::PushStyleVar(ImGuiStyleVar_ItemSpacing, ImVec2(0.0f, 5.0f * ui.scale));
@@ -710,8 +729,14 @@ void VulkanExampleBase::updateOverlay()
 	ImGui::PopStyleVar();
 	ImGui::Render();
 
-	if (ui.update() || ui.updated) {
-		buildCommandBuffers();
+	// With frames in flight the overlay buffers are updated per frame in drawUI(), as command buffers are recorded every frame
+	if (maxConcurrentFrames == 0) {
+		if (ui.update() || ui.updated) {
+			buildCommandBuffers();
+			ui.updated = false;
+		}
+	}
+	else {
 		ui.updated = false;
 	}
 
@@ -730,30 +755,55 @@ void VulkanExampleBase::drawUI(const VkCommandBuffer commandBuffer)
 		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		ui.draw(commandBuffer);
+		if (maxConcurrentFrames > 0) {
+			// The buffers of this frame are no longer in use, as prepareFrame() waited on its fence
+			ui.update(currentFrame);
+			ui.draw(commandBuffer, currentFrame);
+		}
+		else {
+			ui.draw(commandBuffer);
+		}
 	}
 }
 
-void VulkanExampleBase::prepareFrame()
+bool VulkanExampleBase::prepareFrame()
 {
+	VkSemaphore presentCompleteSemaphore = semaphores.presentComplete;
+	if (maxConcurrentFrames > 0) {
+		// Wait until the GPU has finished the last frame that used this frame's command buffer and per-frame resources
+		VK_CHECK_RESULT(vkWaitForFences(device, 1, &waitFences[currentFrame], VK_TRUE, UINT64_MAX));
+		presentCompleteSemaphore = presentCompleteSemaphores[currentFrame];
+		submitInfo.pWaitSemaphores = &presentCompleteSemaphores[currentFrame];
+		submitInfo.pSignalSemaphores = &renderCompleteSemaphores[currentFrame];
+	}
 	// Acquire the next image from the swap chain
-	VkResult result = swapChain.acquireNextImage(semaphores.presentComplete, &currentBuffer);
+	VkResult result = swapChain.acquireNextImage(presentCompleteSemaphore, &currentBuffer);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE)
 	// SRS - If no longer optimal (VK_SUBOPTIMAL_KHR), wait until submitFrame() in case number of swapchain images will change on resize
-	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
-		if (result == VK_ERROR_OUT_OF_DATE_KHR) {
-			windowResize();
-		}
-		return;
+	if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+		// No image has been acquired and the present semaphore won't be signaled, so the frame has to be skipped
+		windowResize();
+		return false;
 	}
-	else {
+	if (result != VK_SUBOPTIMAL_KHR) {
 		VK_CHECK_RESULT(result);
 	}
+	// The fence is only reset once a submission that signals it is certain to follow, resetting it for a skipped frame would deadlock the next wait
+	if (maxConcurrentFrames > 0) {
+		VK_CHECK_RESULT(vkResetFences(device, 1, &waitFences[currentFrame]));
+	}
+	return true;
 }
 
 void VulkanExampleBase::submitFrame()
 {
-	VkResult result = swapChain.queuePresent(queue, currentBuffer, semaphores.renderComplete);
+	VkSemaphore renderCompleteSemaphore = semaphores.renderComplete;
+	if (maxConcurrentFrames > 0) {
+		renderCompleteSemaphore = renderCompleteSemaphores[currentFrame];
+		// Move on to the next frame's resources, the GPU may still be working on this one
+		currentFrame = (currentFrame + 1) % maxConcurrentFrames;
+	}
+	VkResult result = swapChain.queuePresent(queue, currentBuffer, renderCompleteSemaphore);
 	// Recreate the swapchain if it's no longer compatible with the surface (OUT_OF_DATE) or no longer optimal for presentation (SUBOPTIMAL)
 	if ((result == VK_ERROR_OUT_OF_DATE_KHR) || (result == VK_SUBOPTIMAL_KHR)) {
 		windowResize();
@@ -764,7 +814,10 @@ void VulkanExampleBase::submitFrame()
 	else {
 		VK_CHECK_RESULT(result);
 	}
-	VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	// Without frames in flight, wait for the frame to finish before the CPU starts updating data for the next one
+	if (maxConcurrentFrames == 0) {
+		VK_CHECK_RESULT(vkQueueWaitIdle(queue));
+	}
 }
 
 VulkanExampleBase::VulkanExampleBase()
@@ -805,6 +858,7 @@ VulkanExampleBase::VulkanExampleBase()
 	commandLineParser.add("benchmarkresultfile", { "-bf", "--benchfilename" }, 1, "Set file name for benchmark results");
 	commandLineParser.add("benchmarkresultframes", { "-bt", "--benchframetimes" }, 0, "Save frame times to benchmark results file");
 	commandLineParser.add("benchmarkframes", { "-bfs", "--benchmarkframes" }, 1, "Only render the given number of frames");
+	commandLineParser.add("framesinflight", { "-fif", "--framesinflight" }, 1, "Set the max. number of frames in flight (for examples supporting it)");
 
 	commandLineParser.parse(args);
 	if (commandLineParser.isSet("help")) {
@@ -913,6 +967,12 @@ VulkanExampleBase::~VulkanExampleBase()
 
 	vkDestroySemaphore(device, semaphores.presentComplete, nullptr);
 	vkDestroySemaphore(device, semaphores.renderComplete, nullptr);
+	for (auto& semaphore : presentCompleteSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
+	for (auto& semaphore : renderCompleteSemaphores) {
+		vkDestroySemaphore(device, semaphore, nullptr);
+	}
 	for (auto& fence : waitFences) {
 		vkDestroyFence(device, fence, nullptr);
 	}
@@ -1060,6 +1120,13 @@ bool VulkanExampleBase::initVulkan()
 	}
 	device = vulkanDevice->logicalDevice;
 
+	// Buffers and textures created through the device are sub-allocated from larger memory blocks
+	result = vulkanDevice->createAllocator(instance, apiVersion);
+	if (result != VK_SUCCESS) {
+		vks::tools::exitFatal("Could not create memory allocator: \n" + vks::tools::errorString(result), result);
+		return false;
+	}
+
 	// Get a graphics queue from the device
 	vkGetDeviceQueue(device, vulkanDevice->queueFamilyIndices.graphics, 0, &queue);
 
@@ -1084,6 +1151,19 @@ bool VulkanExampleBase::initVulkan()
 	// Ensures that the image is not presented until all commands have been submitted and executed
 	VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &semaphores.renderComplete));
 
+	// Examples supporting frames in flight get one pair of semaphores per frame, so the CPU can record ahead of the GPU
+	if (maxConcurrentFrames > 0) {
+		if (commandLineParser.isSet("framesinflight")) {
+			maxConcurrentFrames = std::max(commandLineParser.getValueAsInt("framesinflight", maxConcurrentFrames), 1);
+		}
+		presentCompleteSemaphores.resize(maxConcurrentFrames);
+		renderCompleteSemaphores.resize(maxConcurrentFrames);
+		for (uint32_t i = 0; i < maxConcurrentFrames; i++) {
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &presentCompleteSemaphores[i]));
+			VK_CHECK_RESULT(vkCreateSemaphore(device, &semaphoreCreateInfo, nullptr, &renderCompleteSemaphores[i]));
+		}
+	}
+
 	// Set up submit info structure
 	// Semaphores will stay the same during application lifetime
 	// Command buffer submission info is set by each example
@@ -2993,6 +3073,11 @@ void VulkanExampleBase::mouseMoved(double x, double y, bool & handled) {}
 
 void VulkanExampleBase::buildCommandBuffers() {}
 
+void VulkanExampleBase::buildFrameCommandBuffer()
+{
+	assert(false && "Samples setting maxConcurrentFrames need to record their per-frame command buffer in buildFrameCommandBuffer");
+}
+
 void VulkanExampleBase::createSynchronizationPrimitives()
 {
 	// Wait fences to sync command buffer access
@@ -3192,13 +3277,16 @@ void VulkanExampleBase::windowResize()
 	// references to the recreated frame buffer
 	destroyCommandBuffers();
 	createCommandBuffers();
-	buildCommandBuffers();
+	if (maxConcurrentFrames == 0) {
+		buildCommandBuffers();
 
-	// SRS - Recreate fences in case number of swapchain images has changed on resize
-	for (auto& fence : waitFences) {
-		vkDestroyFence(device, fence, nullptr);
+		// SRS - Recreate fences in case number of swapchain images has changed on resize
+		// Frames in flight don't depend on the number of swapchain images, so their fences are kept
+		for (auto& fence : waitFences) {
+			vkDestroyFence(device, fence, nullptr);
+		}
+		createSynchronizationPrimitives();
 	}
-	createSynchronizationPrimitives();
 
 	vkDeviceWaitIdle(device);
 
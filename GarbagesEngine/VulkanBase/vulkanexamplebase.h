@@ -130,7 +130,11 @@ protected:
 	VkPipelineStageFlags submitPipelineStages = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
 	// Contains command buffers and semaphores to be presented to the queue
 	VkSubmitInfo submitInfo;
-	// Command buffers used for rendering
+	/** @brief Max. number of frames the CPU may record ahead of the GPU, independent of the swap chain image count (set in the derived constructor, 0 = wait for the queue to become idle after each frame) */
+	uint32_t maxConcurrentFrames = 0;
+	/** @brief Index of the frame in flight that is currently being recorded, selects the per-frame command buffer, fence and uniform data (only used if maxConcurrentFrames > 0) */
+	uint32_t currentFrame = 0;
+	// Command buffers used for rendering (one per swap chain image, or one per frame in flight if maxConcurrentFrames > 0)
 	std::vector<VkCommandBuffer> drawCmdBuffers;
 	// Global render pass for frame buffer writes
 	VkRenderPass renderPass{ VK_NULL_HANDLE };
@@ -153,6 +157,10 @@ protected:
 		// Command buffer submission and execution
 		VkSemaphore renderComplete;
 	} semaphores;
+	// Per frame in flight semaphores (only used if maxConcurrentFrames > 0)
+	std::vector<VkSemaphore> presentCompleteSemaphores;
+	std::vector<VkSemaphore> renderCompleteSemaphores;
+	// One fence per draw command buffer, signaled once the GPU has finished executing it
 	std::vector<VkFence> waitFences;
 	bool requiresStencil{ false };
 public:
@@ -375,6 +383,8 @@ public:
 	virtual void windowResized();
 	/** @brief (Virtual) Called when resources have been recreated that require a rebuild of the command buffers (e.g. frame buffer), to be implemented by the sample application */
 	virtual void buildCommandBuffers();
+	/** @brief (Virtual) Records drawCmdBuffers[currentFrame] for the acquired swap chain image, called by renderFrame between acquiring and submitting if maxConcurrentFrames > 0, must be implemented by samples using frames in flight */
+	virtual void buildFrameCommandBuffer();
 	/** @brief (Virtual) Setup default depth and stencil views */
 	virtual void setupDepthStencil();
 	/** @brief (Virtual) Setup default framebuffers for all requested swapchain images */
@@ -400,8 +410,8 @@ public:
 	/** @brief Adds the drawing commands for the ImGui overlay to the given command buffer */
 	void drawUI(const VkCommandBuffer commandBuffer);
 
-	/** Prepare the next frame for workload submission by acquiring the next swap chain image */
-	void prepareFrame();
+	/** @brief Prepare the next frame for workload submission by acquiring the next swap chain image, returns false if the swap chain was out of date and the frame has to be skipped */
+	bool prepareFrame();
 	/** @brief Presents the current image to the swap chain */
 	void submitFrame();
 	/** @brief (Virtual) Default image acquire + submission and command buffer submission function */
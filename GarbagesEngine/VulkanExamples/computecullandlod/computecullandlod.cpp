@@ -25,9 +25,15 @@ class VulkanExample : public VulkanExampleBase
 {
 public:
 	bool fixedFrustum = false;
+	// Generate the levels of detail from a single mesh at load time instead of using the ones stored in the glTF file
+	bool generateLods = true;
+	// Largest screen space error in pixels a generated level of detail may show before the next finer one is selected
+	float maxPixelError = 1.0f;
 
 	// The model contains multiple versions of a single object with different levels of detail
 	vkglTF::Model lodModel;
+	// Number of levels stored in the LOD buffer
+	uint32_t lodLevelCount = 0;
 
 	// Per-instance data block
 	struct InstanceData {
@@ -242,7 +248,12 @@ public:
 	void loadAssets()
 	{
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
-		lodModel.loadFromFile(getAssetPath() + "models/suzanne_lods.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		if (generateLods) {
+			lodModel.lodLevelCount = MAX_LOD_LEVEL;
+			lodModel.loadFromFile(getAssetPath() + "models/suzanne.gltf", vulkanDevice, queue, glTFLoadingFlags | vkglTF::FileLoadingFlags::OptimizeMeshes | vkglTF::FileLoadingFlags::GenerateLods);
+		} else {
+			lodModel.loadFromFile(getAssetPath() + "models/suzanne_lods.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		}
 	}
 
 	void buildComputeCommandBuffer()
@@ -553,16 +564,40 @@ public:
 		};
 		std::vector<LOD> LODLevels;
 		uint32_t n = 0;
-		for (auto node : lodModel.nodes)
+		if (generateLods)
+		{
+			// Level 0 is the full detail primitive, followed by the simplified levels generated by the loader
+			vkglTF::Node* node = lodModel.nodes[0];
+			const vkglTF::Primitive* primitive = node->mesh->primitives[0];
+			// Same relation as vkglTF::Primitive::selectLod: a level's error in pixels is error * lodScale * scale / distance,
+			// so the shader switches to the next level once that level's error drops below maxPixelError
+			const glm::mat4 nodeMatrix = node->getMatrix();
+			const float scale = instanceData[0].scale * std::max(glm::length(glm::vec3(nodeMatrix[0])), std::max(glm::length(glm::vec3(nodeMatrix[1])), glm::length(glm::vec3(nodeMatrix[2]))));
+			const float lodScale = static_cast<float>(height) * 0.5f * std::abs(camera.matrices.perspective[1][1]);
+			LODLevels.push_back({ primitive->firstIndex, primitive->indexCount, 0.0f, 0.0f });
+			for (const vkglTF::Primitive::LOD& generatedLod : primitive->lods)
+			{
+				LODLevels.back().distance = lodScale * scale * generatedLod.error / maxPixelError;
+				LODLevels.push_back({ generatedLod.firstIndex, generatedLod.indexCount, 0.0f, 0.0f });
+			}
+			// The coarsest level is used up to any distance
+			LODLevels.back().distance = FLT_MAX;
+		}
+		else
 		{
-			LOD lod;
-			lod.firstIndex = node->mesh->primitives[0]->firstIndex;	// First index for this LOD
-			lod.indexCount = node->mesh->primitives[0]->indexCount;	// Index count for this LOD
-			lod.distance = 5.0f + n * 5.0f;							// Starting distance (to viewer) for this LOD
-			n++;
-			LODLevels.push_back(lod);
+			for (auto node : lodModel.nodes)
+			{
+				LOD lod;
+				lod.firstIndex = node->mesh->primitives[0]->firstIndex;	// First index for this LOD
+				lod.indexCount = node->mesh->primitives[0]->indexCount;	// Index count for this LOD
+				lod.distance = 5.0f + n * 5.0f;							// Starting distance (to viewer) for this LOD
+				n++;
+				LODLevels.push_back(lod);
+			}
 		}
 
+		lodLevelCount = static_cast<uint32_t>(LODLevels.size());
+
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
@@ -681,13 +716,13 @@ public:
 		VkComputePipelineCreateInfo computePipelineCreateInfo = vks::initializers::computePipelineCreateInfo(compute.pipelineLayout, 0);
 		computePipelineCreateInfo.stage = loadShader(getShadersPath() + "computecullandlod/cull.comp.spv", VK_SHADER_STAGE_COMPUTE_BIT);
 
-		// Use specialization constants to pass max. level of detail (determined by no. of meshes)
+		// Use specialization constants to pass max. level of detail (determined by no. of LOD levels)
 		VkSpecializationMapEntry specializationEntry{};
 		specializationEntry.constantID = 0;
 		specializationEntry.offset = 0;
 		specializationEntry.size = sizeof(uint32_t);
 
-		uint32_t specializationData = static_cast<uint32_t>(lodModel.nodes.size()) - 1;
+		uint32_t specializationData = static_cast<uint32_t>(lodLevelCount) - 1;
 
 		VkSpecializationInfo specializationInfo;
 		specializationInfo.mapEntryCount = 1;
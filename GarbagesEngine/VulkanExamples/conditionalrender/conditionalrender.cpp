@@ -67,13 +67,9 @@ public:
 
 	void renderNode(vkglTF::Node *node, VkCommandBuffer commandBuffer) {
 		if (node->mesh) {
+			// All nodes share the model's node descriptor set, the node's uniform block is selected with the dynamic offset
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &node->mesh->uniformBuffer.descriptorSet, 1, &node->mesh->uniformBuffer.dynamicOffset);
 			for (vkglTF::Primitive * primitive : node->mesh->primitives) {
-				const std::vector<VkDescriptorSet> descriptorsets = {
-					descriptorSet,
-					node->mesh->uniformBuffer.descriptorSet
-				};
-				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, static_cast<uint32_t>(descriptorsets.size()), descriptorsets.data(), 0, NULL);
-
 				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(primitive->material.baseColorFactor), &primitive->material.baseColorFactor);
 
 				/*
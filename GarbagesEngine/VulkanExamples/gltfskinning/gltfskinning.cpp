@@ -44,12 +44,9 @@ VulkanglTFModel::~VulkanglTFModel()
 	vkFreeMemory(vulkanDevice->logicalDevice, vertices.memory, nullptr);
 	vkDestroyBuffer(vulkanDevice->logicalDevice, indices.buffer, nullptr);
 	vkFreeMemory(vulkanDevice->logicalDevice, indices.memory, nullptr);
-	for (Image image : images)
+	for (Image& image : images)
 	{
-		vkDestroyImageView(vulkanDevice->logicalDevice, image.texture.view, nullptr);
-		vkDestroyImage(vulkanDevice->logicalDevice, image.texture.image, nullptr);
-		vkDestroySampler(vulkanDevice->logicalDevice, image.texture.sampler, nullptr);
-		vkFreeMemory(vulkanDevice->logicalDevice, image.texture.deviceMemory, nullptr);
+		image.texture.destroy();
 	}
 	for (Skin skin : skins)
 	{
@@ -971,6 +968,232 @@ void VulkanExample::loadAssets()
 	loadglTFFile(getAssetPath() + "models/CesiumMan/glTF/CesiumMan.gltf");
 }
 
+/*
+	CPU benchmarks of the flattened transform hierarchy used by vkglTF::Model (see VulkanglTFTransforms.h), run with --benchmark or from the UI
+*/
+
+namespace
+{
+	// Synthetic skeletons, every joint is attached to one of the four joints stored before it in the same skeleton
+	void addSyntheticSkeletons(vkglTF::TransformHierarchy &hierarchy, uint32_t skeletonCount, uint32_t jointCount, std::default_random_engine &rndEngine)
+	{
+		std::uniform_int_distribution<uint32_t> parentDist(1, 4);
+		std::uniform_real_distribution<float>   valueDist(-1.0f, 1.0f);
+		for (uint32_t s = 0; s < skeletonCount; s++)
+		{
+			const uint32_t root = static_cast<uint32_t>(hierarchy.size());
+			for (uint32_t j = 0; j < jointCount; j++)
+			{
+				const int32_t   parent      = (j == 0) ? -1 : static_cast<int32_t>(root + j - std::min(j, parentDist(rndEngine)));
+				const glm::vec3 translation = glm::vec3(valueDist(rndEngine), valueDist(rndEngine), valueDist(rndEngine)) * 0.1f;
+				hierarchy.add(parent, translation, glm::angleAxis(valueDist(rndEngine), glm::vec3(0.0f, 0.0f, 1.0f)), glm::vec3(1.0f), glm::mat4(1.0f));
+			}
+		}
+		hierarchy.update();
+	}
+
+	// Same walk to the root as VulkanglTFModel::getNodeMatrix, using the local transforms stored in a hierarchy
+	glm::mat4 getParentWalkMatrix(const vkglTF::TransformHierarchy &hierarchy, uint32_t index)
+	{
+		auto localMatrix = [&hierarchy](uint32_t i) {
+			return glm::translate(glm::mat4(1.0f), hierarchy.translations[i]) * glm::mat4(hierarchy.rotations[i]) * glm::scale(glm::mat4(1.0f), hierarchy.scales[i]) * hierarchy.matrices[i];
+		};
+		glm::mat4 matrix = localMatrix(index);
+		for (int32_t parent = hierarchy.parents[index]; parent >= 0; parent = hierarchy.parents[parent])
+		{
+			matrix = localMatrix(static_cast<uint32_t>(parent)) * matrix;
+		}
+		return matrix;
+	}
+
+	float getMaxDifference(const glm::mat4 &a, const glm::mat4 &b)
+	{
+		float difference = 0.0f;
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			const glm::vec4 delta = glm::abs(a[i] - b[i]);
+			difference            = std::max(difference, std::max(std::max(delta.x, delta.y), std::max(delta.z, delta.w)));
+		}
+		return difference;
+	}
+}
+
+// Compare updating all world matrices by walking the parents of each node (as this example does) against a single pass over the flattened hierarchy
+// CesiumMan is played back over its whole clip, the synthetic scene has 100 skeletons of 100 joints with either all or every tenth joint animated
+void VulkanExample::runTransformBenchmark()
+{
+	using clock = std::chrono::high_resolution_clock;
+	transformBenchmarkResults.clear();
+	float maxError = 0.0f;
+
+	// CesiumMan, flattened in the same depth first order as vkglTF::Model::buildTransforms
+	{
+		vkglTF::TransformHierarchy                                  hierarchy;
+		std::vector<VulkanglTFModel::Node *>                        nodes;
+		std::unordered_map<VulkanglTFModel::Node *, uint32_t>       transformIndices;
+		std::vector<VulkanglTFModel::Node *>                        stack(glTFModel.nodes.rbegin(), glTFModel.nodes.rend());
+		while (!stack.empty())
+		{
+			VulkanglTFModel::Node *node = stack.back();
+			stack.pop_back();
+			const int32_t parent   = node->parent ? static_cast<int32_t>(transformIndices[node->parent]) : -1;
+			transformIndices[node] = hierarchy.add(parent, node->translation, node->rotation, node->scale, node->matrix);
+			nodes.push_back(node);
+			stack.insert(stack.end(), node->children.rbegin(), node->children.rend());
+		}
+		hierarchy.update();
+
+		VulkanglTFModel::Animation &animation = glTFModel.animations[glTFModel.activeAnimation];
+		std::vector<uint32_t>       animatedNodes;
+		for (const VulkanglTFModel::AnimationChannel &channel : animation.channels)
+		{
+			animatedNodes.push_back(transformIndices[channel.node]);
+		}
+		std::sort(animatedNodes.begin(), animatedNodes.end());
+		animatedNodes.erase(std::unique(animatedNodes.begin(), animatedNodes.end()), animatedNodes.end());
+
+		const float            frameTime  = 1.0f / 60.0f;
+		const uint32_t         frameCount = std::max(static_cast<uint32_t>((animation.end - animation.start) / frameTime), 1u);
+		const float            startTime  = animation.currentTime;
+		std::vector<glm::mat4> worldMatrices(nodes.size());
+		double                 parentWalkTime = 0.0, hierarchyTime = 0.0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			glTFModel.updateAnimation(frameTime);
+			auto tStart = clock::now();
+			for (size_t i = 0; i < nodes.size(); i++)
+			{
+				worldMatrices[i] = glTFModel.getNodeMatrix(nodes[i]);
+			}
+			auto tWalked = clock::now();
+			for (uint32_t index : animatedNodes)
+			{
+				const VulkanglTFModel::Node *node = nodes[index];
+				hierarchy.setLocal(index, node->translation, node->rotation, node->scale, node->matrix);
+			}
+			hierarchy.update();
+			auto tUpdated = clock::now();
+			parentWalkTime += std::chrono::duration<double, std::micro>(tWalked - tStart).count();
+			hierarchyTime += std::chrono::duration<double, std::micro>(tUpdated - tWalked).count();
+			for (size_t i = 0; i < nodes.size(); i++)
+			{
+				maxError = std::max(maxError, getMaxDifference(worldMatrices[i], hierarchy.worldMatrices[i]));
+			}
+		}
+		animation.currentTime = startTime;
+		transformBenchmarkResults.push_back({"CesiumMan (" + std::to_string(nodes.size()) + " nodes)", parentWalkTime / frameCount, hierarchyTime / frameCount});
+	}
+
+	// Synthetic skeletons
+	for (uint32_t animatedStride : {1u, 10u})
+	{
+		std::default_random_engine rndEngine(0);
+		vkglTF::TransformHierarchy hierarchy;
+		addSyntheticSkeletons(hierarchy, 100, 100, rndEngine);
+		const uint32_t         frameCount = 60;
+		std::vector<glm::mat4> worldMatrices(hierarchy.size());
+		double                 parentWalkTime = 0.0, hierarchyTime = 0.0;
+		for (uint32_t frame = 0; frame < frameCount; frame++)
+		{
+			for (uint32_t i = 0; i < hierarchy.size(); i += animatedStride)
+			{
+				const glm::quat rotation = glm::angleAxis(0.01f * frame + 0.1f * (i % 100), glm::vec3(0.0f, 0.0f, 1.0f));
+				hierarchy.setLocal(i, hierarchy.translations[i], rotation, hierarchy.scales[i], hierarchy.matrices[i]);
+			}
+			auto tStart = clock::now();
+			for (uint32_t i = 0; i < hierarchy.size(); i++)
+			{
+				worldMatrices[i] = getParentWalkMatrix(hierarchy, i);
+			}
+			auto tWalked = clock::now();
+			hierarchy.update();
+			auto tUpdated = clock::now();
+			parentWalkTime += std::chrono::duration<double, std::micro>(tWalked - tStart).count();
+			hierarchyTime += std::chrono::duration<double, std::micro>(tUpdated - tWalked).count();
+			for (uint32_t i = 0; i < hierarchy.size(); i++)
+			{
+				maxError = std::max(maxError, getMaxDifference(worldMatrices[i], hierarchy.worldMatrices[i]));
+			}
+		}
+		const std::string name = "Synthetic (" + std::to_string(hierarchy.size()) + " nodes, " + ((animatedStride == 1) ? "all" : "10%") + " animated)";
+		transformBenchmarkResults.push_back({name, parentWalkTime / frameCount, hierarchyTime / frameCount});
+	}
+
+	std::cout << "World matrix updates per frame (parent walk -> transform hierarchy), max difference " << maxError << "\n";
+	for (const TransformBenchmarkResult &result : transformBenchmarkResults)
+	{
+		std::cout << result.name << ": " << result.parentWalkTime << " us -> " << result.hierarchyTime << " us (" << result.parentWalkTime / result.hierarchyTime << "x)\n";
+	}
+}
+
+// Build the joint matrix palettes of 300 skeletons with 100 joints each, once per joint with glm (as updateJoints does) and batched per skin with computeJointMatrices
+void VulkanExample::runSkinningBenchmark()
+{
+	using clock                   = std::chrono::high_resolution_clock;
+	const uint32_t skeletonCount  = 300;
+	const uint32_t jointCount     = 100;
+	const uint32_t iterationCount = 100;
+
+	std::default_random_engine rndEngine(0);
+	vkglTF::TransformHierarchy hierarchy;
+	addSyntheticSkeletons(hierarchy, skeletonCount, jointCount, rndEngine);
+
+	// Inverse bind matrices are the inverse of the rest pose, as exported by modelling tools
+	std::vector<uint32_t>  jointIndices(hierarchy.size());
+	std::vector<glm::mat4> inverseBindMatrices(hierarchy.size());
+	std::vector<glm::mat4> inverseMeshMatrices(skeletonCount);
+	for (uint32_t i = 0; i < hierarchy.size(); i++)
+	{
+		jointIndices[i]        = i;
+		inverseBindMatrices[i] = glm::inverse(hierarchy.worldMatrices[i]);
+	}
+	for (uint32_t s = 0; s < skeletonCount; s++)
+	{
+		inverseMeshMatrices[s] = glm::inverse(glm::translate(glm::mat4(1.0f), glm::vec3(static_cast<float>(s), 0.0f, 0.0f)));
+	}
+	// Move the joints away from the rest pose so the palette is not the identity
+	for (uint32_t i = 0; i < hierarchy.size(); i++)
+	{
+		hierarchy.setLocal(i, hierarchy.translations[i], glm::angleAxis(0.25f, glm::vec3(0.0f, 1.0f, 0.0f)) * hierarchy.rotations[i], hierarchy.scales[i], hierarchy.matrices[i]);
+	}
+	hierarchy.update();
+
+	std::vector<glm::mat4> referenceMatrices(hierarchy.size());
+	std::vector<glm::mat4> paletteMatrices(hierarchy.size());
+	double                 referenceTime = 0.0, paletteTime = 0.0;
+	for (uint32_t iteration = 0; iteration < iterationCount; iteration++)
+	{
+		auto tStart = clock::now();
+		for (uint32_t s = 0; s < skeletonCount; s++)
+		{
+			for (uint32_t j = s * jointCount; j < (s + 1) * jointCount; j++)
+			{
+				referenceMatrices[j] = inverseMeshMatrices[s] * hierarchy.worldMatrices[jointIndices[j]] * inverseBindMatrices[j];
+			}
+		}
+		auto tReference = clock::now();
+		for (uint32_t s = 0; s < skeletonCount; s++)
+		{
+			const uint32_t first = s * jointCount;
+			hierarchy.computeJointMatrices(inverseMeshMatrices[s], &jointIndices[first], &inverseBindMatrices[first], jointCount, &paletteMatrices[first]);
+		}
+		auto tPalette = clock::now();
+		referenceTime += std::chrono::duration<double, std::nano>(tReference - tStart).count();
+		paletteTime += std::chrono::duration<double, std::nano>(tPalette - tReference).count();
+	}
+
+	const double jointUpdates = static_cast<double>(iterationCount) * hierarchy.size();
+	skinningBenchmarkResult.referenceTime = referenceTime / jointUpdates;
+	skinningBenchmarkResult.paletteTime   = paletteTime / jointUpdates;
+	skinningBenchmarkResult.maxError      = 0.0f;
+	for (uint32_t i = 0; i < hierarchy.size(); i++)
+	{
+		skinningBenchmarkResult.maxError = std::max(skinningBenchmarkResult.maxError, getMaxDifference(referenceMatrices[i], paletteMatrices[i]));
+	}
+	std::cout << "Skinning palettes (" << skeletonCount << " skeletons x " << jointCount << " joints): " << skinningBenchmarkResult.referenceTime << " ns/joint -> "
+	          << skinningBenchmarkResult.paletteTime << " ns/joint (" << skinningBenchmarkResult.referenceTime / skinningBenchmarkResult.paletteTime << "x), max difference " << skinningBenchmarkResult.maxError << "\n";
+}
+
 void VulkanExample::prepare()
 {
 	VulkanExampleBase::prepare();
@@ -979,6 +1202,11 @@ void VulkanExample::prepare()
 	setupDescriptors();
 	preparePipelines();
 	buildCommandBuffers();
+	if (benchmark.active)
+	{
+		runTransformBenchmark();
+		runSkinningBenchmark();
+	}
 	prepared = true;
 }
 
@@ -1001,6 +1229,28 @@ void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay *overlay)
 			buildCommandBuffers();
 		}
 	}
+	if (overlay->header("Transform hierarchy"))
+	{
+		if (overlay->button("Run benchmark"))
+		{
+			runTransformBenchmark();
+		}
+		for (const TransformBenchmarkResult &result : transformBenchmarkResults)
+		{
+			overlay->text("%s: %.1f us -> %.1f us", result.name.c_str(), result.parentWalkTime, result.hierarchyTime);
+		}
+	}
+	if (overlay->header("Skinning palettes"))
+	{
+		if (overlay->button("Run skinning benchmark"))
+		{
+			runSkinningBenchmark();
+		}
+		if (skinningBenchmarkResult.paletteTime > 0.0)
+		{
+			overlay->text("300 x 100 joints: %.1f ns -> %.1f ns per joint", skinningBenchmarkResult.referenceTime, skinningBenchmarkResult.paletteTime);
+		}
+	}
 }
 
 VULKAN_EXAMPLE_MAIN()
@@ -36,6 +36,7 @@
 #include "tiny_gltf.h"
 
 #include "vulkanexamplebase.h"
+#include "VulkanglTFTransforms.h"
 #include <vulkan/vulkan.h>
 
 
@@ -219,6 +220,22 @@ class VulkanExample : public VulkanExampleBase
 
 	VulkanglTFModel glTFModel;
 
+	// Average time per frame in microseconds for updating all world matrices of a scene, by walking the parents of every node and with vkglTF::TransformHierarchy
+	struct TransformBenchmarkResult
+	{
+		std::string name;
+		double      parentWalkTime;
+		double      hierarchyTime;
+	};
+	std::vector<TransformBenchmarkResult> transformBenchmarkResults;
+	// Nanoseconds per joint for building skinning palettes with glm and with vkglTF::TransformHierarchy::computeJointMatrices
+	struct SkinningBenchmarkResult
+	{
+		double referenceTime = 0.0;
+		double paletteTime   = 0.0;
+		float  maxError      = 0.0f;
+	} skinningBenchmarkResult;
+
 	VulkanExample();
 	~VulkanExample();
 	void         loadglTFFile(std::string filename);
@@ -229,6 +246,8 @@ class VulkanExample : public VulkanExampleBase
 	void         preparePipelines();
 	void         prepareUniformBuffers();
 	void         updateUniformBuffers();
+	void         runTransformBenchmark();
+	void         runSkinningBenchmark();
 	void         prepare();
 	virtual void render();
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay);
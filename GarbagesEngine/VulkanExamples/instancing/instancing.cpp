@@ -164,14 +164,14 @@ public:
 		}
 	}
 
-	void loadAssets()
+	void loadAssets(vks::UploadBatch& uploadBatch)
 	{
 		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
 		models.rock.loadFromFile(getAssetPath() + "models/rock01.gltf", vulkanDevice, queue, glTFLoadingFlags);
 		models.planet.loadFromFile(getAssetPath() + "models/lavaplanet.gltf", vulkanDevice, queue, glTFLoadingFlags);
 
-		textures.planet.loadFromFile(getAssetPath() + "textures/lavaplanet_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
-		textures.rocks.loadFromFile(getAssetPath() + "textures/texturearray_rocks_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue);
+		textures.planet.loadFromFile(getAssetPath() + "textures/lavaplanet_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, false, &uploadBatch);
+		textures.rocks.loadFromFile(getAssetPath() + "textures/texturearray_rocks_rgba.ktx", VK_FORMAT_R8G8B8A8_UNORM, vulkanDevice, queue, VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, &uploadBatch);
 	}
 
 	void setupDescriptors()
@@ -317,7 +317,7 @@ public:
 	}
 
 	// Create a buffer with per-instance data that is sourced in the shaders
-	void prepareInstanceData()
+	void prepareInstanceData(vks::UploadBatch& uploadBatch)
 	{
 		std::vector<InstanceData> instanceData;
 		instanceData.resize(INSTANCE_COUNT);
@@ -354,51 +354,19 @@ public:
 
 		instanceBuffer.size = instanceData.size() * sizeof(InstanceData);
 
-		// Staging
 		// Instanced data is static, copy to device local memory
 		// This results in better performance
-
-		struct {
-			VkDeviceMemory memory;
-			VkBuffer buffer;
-		} stagingBuffer;
-
-		VK_CHECK_RESULT(vulkanDevice->createBuffer(
-			VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-			instanceBuffer.size,
-			&stagingBuffer.buffer,
-			&stagingBuffer.memory,
-			instanceData.data()));
-
 		VK_CHECK_RESULT(vulkanDevice->createBuffer(
 			VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
 			VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
 			instanceBuffer.size,
 			&instanceBuffer.buffer,
 			&instanceBuffer.memory));
-
-		// Copy to staging buffer
-		VkCommandBuffer copyCmd = vulkanDevice->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-		VkBufferCopy copyRegion = { };
-		copyRegion.size = instanceBuffer.size;
-		vkCmdCopyBuffer(
-			copyCmd,
-			stagingBuffer.buffer,
-			instanceBuffer.buffer,
-			1,
-			&copyRegion);
-
-		vulkanDevice->flushCommandBuffer(copyCmd, queue, true);
+		uploadBatch.copyToBuffer(instanceBuffer.buffer, instanceData.data(), instanceBuffer.size);
 
 		instanceBuffer.descriptor.range = instanceBuffer.size;
 		instanceBuffer.descriptor.buffer = instanceBuffer.buffer;
 		instanceBuffer.descriptor.offset = 0;
-
-		// Destroy staging resources
-		vkDestroyBuffer(device, stagingBuffer.buffer, nullptr);
-		vkFreeMemory(device, stagingBuffer.memory, nullptr);
 	}
 
 	void prepareUniformBuffers()
@@ -425,8 +393,11 @@ public:
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		loadAssets();
-		prepareInstanceData();
+		// Textures and instance data share one upload batch, so they're uploaded with a single submit
+		vks::UploadBatch uploadBatch(vulkanDevice, queue);
+		loadAssets(uploadBatch);
+		prepareInstanceData(uploadBatch);
+		uploadBatch.flush();
 		prepareUniformBuffers();
 		setupDescriptors();
 		preparePipelines();
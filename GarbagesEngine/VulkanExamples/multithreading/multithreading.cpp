@@ -8,6 +8,7 @@
 
 #include "vulkanexamplebase.h"
 
+#include "jobsystem.hpp"
 #include "threadpool.hpp"
 #include "frustum.hpp"
 
@@ -36,13 +37,14 @@ public:
 		VkPipeline starsphere{ VK_NULL_HANDLE };
 	} pipelines;
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
-	VkCommandBuffer primaryCommandBuffer{ VK_NULL_HANDLE };
 
 	// Secondary scene command buffers used to store backdrop and user interface
 	struct SecondaryCommandBuffers {
 		VkCommandBuffer background{ VK_NULL_HANDLE };
 		VkCommandBuffer ui{ VK_NULL_HANDLE };
-	} secondaryCommandBuffers;
+	};
+	// One set of secondary command buffers per frame in flight
+	std::vector<SecondaryCommandBuffers> secondaryCommandBuffers;
 
 	// Number of animated objects to be renderer
 	// by using threads and secondary command buffers
@@ -73,8 +75,8 @@ public:
 
 	struct ThreadData {
 		VkCommandPool commandPool{ VK_NULL_HANDLE };
-		// One command buffer per render object
-		std::vector<VkCommandBuffer> commandBuffer;
+		// One command buffer per render object for each frame in flight
+		std::vector<std::vector<VkCommandBuffer>> commandBuffers;
 		// One push constant block per render object
 		std::vector<ThreadPushConstantBlock> pushConstBlock;
 		// Per object information (position, rotation, etc.)
@@ -82,15 +84,25 @@ public:
 	};
 	std::vector<ThreadData> threadData;
 
-	vks::ThreadPool threadPool;
-
-	// Fence to wait for all command buffers to finish before
-	// presenting to the swap chain
-	VkFence renderFence{ VK_NULL_HANDLE };
+	// Created on the main thread, which takes part in recording while it waits for the jobs
+	vks::JobSystem jobSystem;
 
 	// View frustum for culling invisible objects
 	vks::Frustum frustum;
 
+	// Results of the last job system benchmark, frame times in milliseconds
+	struct SchedulerStats {
+		double framesPerSecond = 0.0;
+		double medianFrameTime = 0.0;
+		double p99FrameTime = 0.0;
+	};
+	struct {
+		SchedulerStats threadPool;
+		SchedulerStats jobSystem;
+	} schedulerStats;
+	// Written by the benchmark jobs so their work can't be optimized away
+	std::vector<float> benchmarkResults;
+
 	std::default_random_engine rndEngine;
 
 	VulkanExample() : VulkanExampleBase()
@@ -109,9 +121,10 @@ public:
 #else
 		std::cout << "numThreads = " << numThreads << std::endl;
 #endif
-		threadPool.setThreadCount(numThreads);
 		numObjectsPerThread = 512 / numThreads;
 		rndEngine.seed(benchmark.active ? 0 : (unsigned)time(nullptr));
+		// Let the threads record the next frame while the GPU is still working on the previous one
+		maxConcurrentFrames = 2;
 	}
 
 	~VulkanExample()
@@ -121,10 +134,11 @@ public:
 			vkDestroyPipeline(device, pipelines.starsphere, nullptr);
 			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
 			for (auto& thread : threadData) {
-				vkFreeCommandBuffers(device, thread.commandPool, static_cast<uint32_t>(thread.commandBuffer.size()), thread.commandBuffer.data());
+				for (auto& commandBuffers : thread.commandBuffers) {
+					vkFreeCommandBuffers(device, thread.commandPool, static_cast<uint32_t>(commandBuffers.size()), commandBuffers.data());
+				}
 				vkDestroyCommandPool(device, thread.commandPool, nullptr);
 			}
-			vkDestroyFence(device, renderFence, nullptr);
 		}
 	}
 
@@ -138,19 +152,19 @@ public:
 	void prepareMultiThreadedRenderer()
 	{
 		// Since this demo updates the command buffers on each frame
-		// we don't use the per-framebuffer command buffers from the
-		// base class, and create a single primary command buffer instead
+		// the per-frame (in flight) command buffers of the base class are used as primary command buffers
+
+		// Create additional secondary CBs for background and ui for each frame in flight
 		VkCommandBufferAllocateInfo cmdBufAllocateInfo =
 			vks::initializers::commandBufferAllocateInfo(
 				cmdPool,
-				VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+				VK_COMMAND_BUFFER_LEVEL_SECONDARY,
 				1);
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &primaryCommandBuffer));
-
-		// Create additional secondary CBs for background and ui
-		cmdBufAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.background));
-		VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffers.ui));
+		secondaryCommandBuffers.resize(maxConcurrentFrames);
+		for (auto& secondaryCommandBuffer : secondaryCommandBuffers) {
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffer.background));
+			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &cmdBufAllocateInfo, &secondaryCommandBuffer.ui));
+		}
 
 		threadData.resize(numThreads);
 
@@ -167,15 +181,18 @@ public:
 			cmdPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 			VK_CHECK_RESULT(vkCreateCommandPool(device, &cmdPoolInfo, nullptr, &thread->commandPool));
 
-			// One secondary command buffer per object that is updated by this thread
-			thread->commandBuffer.resize(numObjectsPerThread);
-			// Generate secondary command buffers for each thread
-			VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo =
-				vks::initializers::commandBufferAllocateInfo(
-					thread->commandPool,
-					VK_COMMAND_BUFFER_LEVEL_SECONDARY,
-					static_cast<uint32_t>(thread->commandBuffer.size()));
-			VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, thread->commandBuffer.data()));
+			// One secondary command buffer per object that is updated by this thread, for each frame in flight
+			thread->commandBuffers.resize(maxConcurrentFrames);
+			for (auto& commandBuffers : thread->commandBuffers) {
+				commandBuffers.resize(numObjectsPerThread);
+				// Generate secondary command buffers for each thread
+				VkCommandBufferAllocateInfo secondaryCmdBufAllocateInfo =
+					vks::initializers::commandBufferAllocateInfo(
+						thread->commandPool,
+						VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+						static_cast<uint32_t>(commandBuffers.size()));
+				VK_CHECK_RESULT(vkAllocateCommandBuffers(device, &secondaryCmdBufAllocateInfo, commandBuffers.data()));
+			}
 
 			thread->pushConstBlock.resize(numObjectsPerThread);
 			thread->objectData.resize(numObjectsPerThread);
@@ -215,7 +232,7 @@ public:
 		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
 		commandBufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
 
-		VkCommandBuffer cmdBuffer = thread->commandBuffer[cmdBufferIndex];
+		VkCommandBuffer cmdBuffer = thread->commandBuffers[currentFrame][cmdBufferIndex];
 
 		VK_CHECK_RESULT(vkBeginCommandBuffer(cmdBuffer, &commandBufferBeginInfo));
 
@@ -267,6 +284,8 @@ public:
 
 	void updateSecondaryCommandBuffers(VkCommandBufferInheritanceInfo inheritanceInfo)
 	{
+		const SecondaryCommandBuffers& secondaryCommandBuffers = this->secondaryCommandBuffers[currentFrame];
+
 		// Secondary command buffer for the sky sphere
 		VkCommandBufferBeginInfo commandBufferBeginInfo = vks::initializers::commandBufferBeginInfo();
 		commandBufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
@@ -326,6 +345,8 @@ public:
 	// lat submitted to the queue for rendering
 	void updateCommandBuffers(VkFramebuffer frameBuffer)
 	{
+		const VkCommandBuffer primaryCommandBuffer = drawCmdBuffers[currentFrame];
+
 		// Contains the list of secondary command buffers to be submitted
 		std::vector<VkCommandBuffer> commandBuffers;
 
@@ -363,19 +384,17 @@ public:
 		updateSecondaryCommandBuffers(inheritanceInfo);
 
 		if (displayStarSphere) {
-			commandBuffers.push_back(secondaryCommandBuffers.background);
+			commandBuffers.push_back(secondaryCommandBuffers[currentFrame].background);
 		}
 
-		// Add a job to the thread's queue for each object to be rendered
-		for (uint32_t t = 0; t < numThreads; t++)
-		{
+		// One job per thread data block, as the block's command pool must not be used by multiple threads at the same time
+		// Workers that run out of blocks steal the remaining ones from the others
+		jobSystem.parallelFor(numThreads, 1, [&](uint32_t t) {
 			for (uint32_t i = 0; i < numObjectsPerThread; i++)
 			{
-				threadPool.threads[t]->addJob([=] { threadRenderCode(t, i, inheritanceInfo); });
+				threadRenderCode(t, i, inheritanceInfo);
 			}
-		}
-
-		threadPool.wait();
+		});
 
 		// Only submit if object is within the current view frustum
 		for (uint32_t t = 0; t < numThreads; t++)
@@ -384,14 +403,14 @@ public:
 			{
 				if (threadData[t].objectData[i].visible)
 				{
-					commandBuffers.push_back(threadData[t].commandBuffer[i]);
+					commandBuffers.push_back(threadData[t].commandBuffers[currentFrame][i]);
 				}
 			}
 		}
 
 		// Render ui last
 		if (ui.visible) {
-			commandBuffers.push_back(secondaryCommandBuffers.ui);
+			commandBuffers.push_back(secondaryCommandBuffers[currentFrame].ui);
 		}
 
 		// Execute render commands from the secondary command buffer
@@ -464,39 +483,75 @@ public:
 		frustum.update(matrices.projection * matrices.view);
 	}
 
+	// Compare the job system against the per-thread queues of vks::ThreadPool for frames of uneven jobs, with every 8th job taking nine times longer
+	// The thread pool gets as many threads as the job system uses including the calling thread, jobs are handed out round robin like this example did before
+	void runJobSystemBenchmark()
+	{
+		const uint32_t frameCount = 200;
+		const uint32_t jobCount = 512;
+		benchmarkResults.assign(jobCount, 0.0f);
+		auto job = [this](uint32_t index) {
+			const uint32_t iterations = (index % 8 == 0) ? 9 * 64 : 64;
+			glm::mat4 matrix(1.0f);
+			for (uint32_t i = 0; i < iterations; i++) {
+				matrix = glm::rotate(matrix, 0.001f, glm::vec3(0.0f, 1.0f, 0.0f));
+			}
+			benchmarkResults[index] = matrix[0][0];
+		};
+		auto measure = [&](const std::function<void()>& frame) {
+			std::vector<double> frameTimes(frameCount);
+			const auto tStart = std::chrono::high_resolution_clock::now();
+			for (uint32_t i = 0; i < frameCount; i++) {
+				const auto tFrameStart = std::chrono::high_resolution_clock::now();
+				frame();
+				frameTimes[i] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tFrameStart).count();
+			}
+			const double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+			std::sort(frameTimes.begin(), frameTimes.end());
+			SchedulerStats stats;
+			stats.framesPerSecond = frameCount / seconds;
+			stats.medianFrameTime = frameTimes[frameCount / 2];
+			stats.p99FrameTime = frameTimes[frameCount * 99 / 100];
+			return stats;
+		};
+
+		vks::ThreadPool threadPool;
+		threadPool.setThreadCount(jobSystem.getThreadCount() + 1);
+		schedulerStats.threadPool = measure([&]() {
+			for (uint32_t i = 0; i < jobCount; i++) {
+				threadPool.threads[i % threadPool.threads.size()]->addJob([&job, i]() { job(i); });
+			}
+			threadPool.wait();
+		});
+		schedulerStats.jobSystem = measure([&]() {
+			jobSystem.parallelFor(jobCount, 1, job);
+		});
+
+		std::cout << "Job scheduling (" << frameCount << " frames of " << jobCount << " jobs, " << jobSystem.getThreadCount() + 1 << " threads)\n";
+		auto print = [](const char* name, const SchedulerStats& stats) {
+			std::cout << name << ": " << stats.framesPerSecond << " frames/s, p50 " << stats.medianFrameTime << " ms, p99 " << stats.p99FrameTime << " ms\n";
+		};
+		print("vks::ThreadPool", schedulerStats.threadPool);
+		print("vks::JobSystem ", schedulerStats.jobSystem);
+	}
+
 	void prepare()
 	{
 		VulkanExampleBase::prepare();
-		// Create a fence for synchronization
-		VkFenceCreateInfo fenceCreateInfo = vks::initializers::fenceCreateInfo(VK_FENCE_CREATE_SIGNALED_BIT);
-		vkCreateFence(device, &fenceCreateInfo, nullptr, &renderFence);
 		loadAssets();
 		preparePipelines();
 		prepareMultiThreadedRenderer();
 		updateMatrices();
+		if (benchmark.active) {
+			runJobSystemBenchmark();
+		}
 		prepared = true;
 	}
 
-	void draw()
+	// Called by renderFrame after waiting for the fence of the current frame, so its command buffers can be safely re-recorded
+	virtual void buildFrameCommandBuffer()
 	{
-		// Wait for fence to signal that all command buffers are ready
-		VkResult fenceRes;
-		do {
-			fenceRes = vkWaitForFences(device, 1, &renderFence, VK_TRUE, 100000000);
-		} while (fenceRes == VK_TIMEOUT);
-		VK_CHECK_RESULT(fenceRes);
-		vkResetFences(device, 1, &renderFence);
-
-		VulkanExampleBase::prepareFrame();
-
 		updateCommandBuffers(frameBuffers[currentBuffer]);
-
-		submitInfo.commandBufferCount = 1;
-		submitInfo.pCommandBuffers = &primaryCommandBuffer;
-
-		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, renderFence));
-
-		VulkanExampleBase::submitFrame();
 	}
 
 	virtual void render()
@@ -504,7 +559,7 @@ public:
 		if (!prepared)
 			return;
 		updateMatrices();
-		draw();
+		VulkanExampleBase::renderFrame();
 	}
 
 	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
@@ -512,6 +567,15 @@ public:
 		if (overlay->header("Statistics")) {
 			overlay->text("Active threads: %d", numThreads);
 		}
+		if (overlay->header("Job system")) {
+			if (overlay->button("Run benchmark")) {
+				runJobSystemBenchmark();
+			}
+			if (schedulerStats.jobSystem.framesPerSecond > 0.0) {
+				overlay->text("ThreadPool: p50 %.2f ms, p99 %.2f ms", schedulerStats.threadPool.medianFrameTime, schedulerStats.threadPool.p99FrameTime);
+				overlay->text("JobSystem: p50 %.2f ms, p99 %.2f ms", schedulerStats.jobSystem.medianFrameTime, schedulerStats.jobSystem.p99FrameTime);
+			}
+		}
 		if (overlay->header("Settings")) {
 			overlay->checkBox("Stars", &displayStarSphere);
 		}
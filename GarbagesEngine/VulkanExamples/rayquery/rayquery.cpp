@@ -12,6 +12,7 @@
 #include "vulkanexamplebase.h"
 #include "VulkanRaytracingSample.h"
 #include "VulkanglTFModel.h"
+#include "jobsystem.hpp"
 #include "../../VulkanBase/Entrypoints.h"
 
 class VulkanExample : public VulkanRaytracingSample
@@ -29,6 +30,16 @@ public:
 
 	vkglTF::Model scene;
 
+	// CPU side ray queries against a bvh built from the retained scene geometry, for comparison with the hardware ray queries
+	vks::JobSystem jobSystem;
+	struct CpuRayStats {
+		double buildTime = 0.0;
+		uint32_t rayCount = 0;
+		double closestHitRate = 0.0;
+		double anyHitRate = 0.0;
+		double parallelClosestHitRate = 0.0;
+	} cpuRayStats;
+
 	VkPipeline pipeline{ VK_NULL_HANDLE };
 	VkPipelineLayout pipelineLayout{ VK_NULL_HANDLE };
 	VkDescriptorSet descriptorSet{ VK_NULL_HANDLE };
@@ -284,8 +295,71 @@ public:
 	void loadAssets()
 	{
 		vkglTF::memoryPropertyFlags = VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY;
+		const uint32_t glTFLoadingFlags = vkglTF::FileLoadingFlags::PreTransformVertices | vkglTF::FileLoadingFlags::PreMultiplyVertexColors | vkglTF::FileLoadingFlags::FlipY | vkglTF::FileLoadingFlags::RetainGeometry;
 		scene.loadFromFile(getAssetPath() + "models/vulkanscene_shadow.gltf", vulkanDevice, queue, glTFLoadingFlags);
+		auto tStart = std::chrono::high_resolution_clock::now();
+		scene.buildBvh(&jobSystem);
+		cpuRayStats.buildTime = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+	}
+
+	// Trace a primary ray per pixel of a grid covering the view and a shadow ray from each hit to the light, same as the fragment shader does on the GPU
+	void runCpuRayBenchmark()
+	{
+		const uint32_t gridSize = 256;
+		const glm::mat4 invViewProjection = glm::inverse(camera.matrices.perspective * camera.matrices.view);
+		auto primaryRay = [&](uint32_t x, uint32_t y, glm::vec3& origin, glm::vec3& direction) {
+			const glm::vec2 ndc = (glm::vec2(x, y) + 0.5f) / static_cast<float>(gridSize) * 2.0f - 1.0f;
+			const glm::vec4 nearPoint = invViewProjection * glm::vec4(ndc, 0.0f, 1.0f);
+			const glm::vec4 farPoint = invViewProjection * glm::vec4(ndc, 1.0f, 1.0f);
+			origin = glm::vec3(nearPoint) / nearPoint.w;
+			direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+		};
+
+		// Primary rays
+		std::vector<glm::vec3> hitPositions;
+		hitPositions.reserve(gridSize * gridSize);
+		auto tStart = std::chrono::high_resolution_clock::now();
+		for (uint32_t y = 0; y < gridSize; y++) {
+			for (uint32_t x = 0; x < gridSize; x++) {
+				glm::vec3 origin, direction;
+				primaryRay(x, y, origin, direction);
+				vkglTF::Model::RaycastHit hit;
+				if (scene.raycast(origin, direction, camera.getFarClip(), hit)) {
+					hitPositions.push_back(hit.position);
+				}
+			}
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+		cpuRayStats.rayCount = gridSize * gridSize;
+		cpuRayStats.closestHitRate = gridSize * gridSize / seconds / 1.0e6;
+
+		// Shadow rays only need to know if anything blocks the light
+		uint32_t shadowed = 0;
+		tStart = std::chrono::high_resolution_clock::now();
+		for (const glm::vec3& position : hitPositions) {
+			const glm::vec3 toLight = lightPos - position;
+			shadowed += scene.occluded(position + toLight * 1e-4f, toLight, 1.0f);
+		}
+		seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+		cpuRayStats.anyHitRate = hitPositions.empty() ? 0.0 : hitPositions.size() / seconds / 1.0e6;
+
+		// Primary rays again, with one row per job
+		tStart = std::chrono::high_resolution_clock::now();
+		jobSystem.parallelFor(gridSize, 1, [&](uint32_t y) {
+			for (uint32_t x = 0; x < gridSize; x++) {
+				glm::vec3 origin, direction;
+				primaryRay(x, y, origin, direction);
+				vkglTF::Model::RaycastHit hit;
+				scene.raycast(origin, direction, camera.getFarClip(), hit);
+			}
+		});
+		seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+		cpuRayStats.parallelClosestHitRate = gridSize * gridSize / seconds / 1.0e6;
+
+		std::cout << "CPU ray queries (" << scene.bvh.triangleCount() << " triangles, bvh build " << cpuRayStats.buildTime << " ms)\n";
+		std::cout << "closest hit: " << cpuRayStats.closestHitRate << " MRays/s (" << hitPositions.size() << " of " << cpuRayStats.rayCount << " rays hit)\n";
+		std::cout << "any hit    : " << cpuRayStats.anyHitRate << " MRays/s (" << shadowed << " shadowed)\n";
+		std::cout << "closest hit: " << cpuRayStats.parallelClosestHitRate << " MRays/s (all threads)\n";
 	}
 
 	void setupDescriptors()
@@ -451,6 +525,9 @@ public:
 		setupDescriptors();
 		preparePipelines();
 		buildCommandBuffers();
+		if (benchmark.active) {
+			runCpuRayBenchmark();
+		}
 		prepared = true;
 	}
 
@@ -464,6 +541,21 @@ public:
 		}
 		draw();
 	}
+
+	virtual void OnUpdateUIOverlay(vks::UIOverlay* overlay)
+	{
+		if (overlay->header("CPU ray queries")) {
+			if (overlay->button("Run benchmark")) {
+				runCpuRayBenchmark();
+			}
+			overlay->text("Bvh build: %.1f ms", cpuRayStats.buildTime);
+			if (cpuRayStats.rayCount > 0) {
+				overlay->text("Closest hit: %.2f MRays/s", cpuRayStats.closestHitRate);
+				overlay->text("Any hit: %.2f MRays/s", cpuRayStats.anyHitRate);
+				overlay->text("Closest hit (all threads): %.2f MRays/s", cpuRayStats.parallelClosestHitRate);
+			}
+		}
+	}
 };
 
 VULKAN_EXAMPLE_MAIN()
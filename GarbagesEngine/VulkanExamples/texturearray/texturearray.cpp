@@ -496,9 +496,10 @@ public:
 		uint8_t *pData;
 		uint32_t dataOffset = sizeof(uniformData.matrices);
 		uint32_t dataSize = layerCount * sizeof(PerInstanceData);
-		VK_CHECK_RESULT(vkMapMemory(device, uniformBuffer.memory, dataOffset, dataSize, 0, (void **)&pData));
+		VK_CHECK_RESULT(uniformBuffer.map(dataSize, dataOffset));
+		pData = static_cast<uint8_t*>(uniformBuffer.mapped);
 		memcpy(pData, uniformData.instance, dataSize);
-		vkUnmapMemory(device, uniformBuffer.memory);
+		uniformBuffer.unmap();
 
 		// Map persistent
 		VK_CHECK_RESULT(uniformBuffer.map());
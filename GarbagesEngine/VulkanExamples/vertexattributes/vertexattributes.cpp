@@ -167,11 +167,8 @@ VulkanExample::~VulkanExample()
 		separateVertexBuffers.tangent.destroy();
 		separateVertexBuffers.uv.destroy();
 		interleavedVertexBuffer.destroy();
-		for (Image image : scene.images) {
-			vkDestroyImageView(vulkanDevice->logicalDevice, image.texture.view, nullptr);
-			vkDestroyImage(vulkanDevice->logicalDevice, image.texture.image, nullptr);
-			vkDestroySampler(vulkanDevice->logicalDevice, image.texture.sampler, nullptr);
-			vkFreeMemory(vulkanDevice->logicalDevice, image.texture.deviceMemory, nullptr);
+		for (Image& image : scene.images) {
+			image.texture.destroy();
 		}
 	}
 }
@@ -564,6 +561,102 @@ void VulkanExample::updateUniformBuffers()
 	memcpy(shaderData.buffer.mapped, &shaderData.values, sizeof(shaderData.values));
 }
 
+// Check that the vectorized accessor conversion gives the same results as the scalar reference and compare their throughput
+// Covers tightly packed and interleaved input, normalized integers, half floats and fill values for missing components
+void VulkanExample::runAccessorBenchmark()
+{
+	using namespace vkglTF::accessor;
+	using clock = std::chrono::high_resolution_clock;
+	const size_t vertexCount = 1 << 18;
+	const uint32_t iterationCount = 10;
+
+	// Interleaved source vertex: float position[3], short normal[3], half uv[2], ubyte color[4], byte tangent[4] (32 bytes with padding)
+	const size_t sourceStride = 32;
+	std::default_random_engine rndEngine(0);
+	std::uniform_real_distribution<float> floatDist(-10.0f, 10.0f);
+	std::uniform_int_distribution<uint32_t> byteDist(0, 255);
+	std::vector<unsigned char> interleaved(vertexCount * sourceStride);
+	for (unsigned char& byte : interleaved) {
+		byte = static_cast<unsigned char>(byteDist(rndEngine));
+	}
+	std::vector<float> positions(vertexCount * 3);
+	for (size_t i = 0; i < vertexCount; i++) {
+		for (uint32_t c = 0; c < 3; c++) {
+			positions[i * 3 + c] = floatDist(rndEngine);
+		}
+		memcpy(&interleaved[i * sourceStride], &positions[i * 3], sizeof(float) * 3);
+	}
+	// Every half precision value, including signed zeros, denormals, infinities and NaNs
+	std::vector<uint16_t> halfValues(1 << 16);
+	for (size_t i = 0; i < halfValues.size(); i++) {
+		halfValues[i] = static_cast<uint16_t>(i);
+	}
+
+	auto makeView = [](const void* data, size_t count, size_t stride, ComponentType componentType, uint32_t componentCount, bool normalized) {
+		View view;
+		view.data = static_cast<const unsigned char*>(data);
+		view.count = count;
+		view.stride = stride;
+		view.componentType = componentType;
+		view.componentCount = componentCount;
+		view.normalized = normalized;
+		return view;
+	};
+	struct Test {
+		std::string name;
+		View view;
+		uint32_t dstComponents;
+	};
+	const std::vector<Test> tests = {
+		{ "float vec3 (packed)", makeView(positions.data(), vertexCount, 12, Float, 3, false), 3 },
+		{ "float vec3 (strided)", makeView(&interleaved[0], vertexCount, sourceStride, Float, 3, false), 3 },
+		{ "normalized short vec3 (strided)", makeView(&interleaved[12], vertexCount, sourceStride, Short, 3, true), 3 },
+		{ "short vec3 (strided)", makeView(&interleaved[12], vertexCount, sourceStride, Short, 3, false), 3 },
+		{ "half vec2 (strided)", makeView(&interleaved[18], vertexCount, sourceStride, HalfFloat, 2, false), 2 },
+		{ "normalized ubyte vec4 (strided)", makeView(&interleaved[22], vertexCount, sourceStride, UnsignedByte, 4, true), 4 },
+		{ "normalized ubyte vec3 to vec4 (strided)", makeView(&interleaved[22], vertexCount, sourceStride, UnsignedByte, 3, true), 4 },
+		{ "normalized byte vec4 (strided)", makeView(&interleaved[26], vertexCount, sourceStride, Byte, 4, true), 4 },
+		{ "half scalar (all values)", makeView(halfValues.data(), halfValues.size(), 2, HalfFloat, 1, false), 1 },
+	};
+
+	// Output is written into a vertex sized stride like the interleaved vertex buffers of vkglTF::Model
+	const size_t dstStride = 64;
+	const float fill[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	std::vector<float> vectorized(vertexCount * dstStride / sizeof(float));
+	std::vector<float> reference(vectorized.size());
+	accessorBenchmarkResults.clear();
+	bool allMatch = true;
+	for (const Test& test : tests) {
+		double vectorizedTime = 0.0, scalarTime = 0.0;
+		for (uint32_t i = 0; i < iterationCount; i++) {
+			auto tStart = clock::now();
+			readFloats(test.view, vectorized.data(), dstStride, test.dstComponents, fill);
+			auto tVectorized = clock::now();
+			readFloatsScalar(test.view, reference.data(), dstStride, test.dstComponents, fill);
+			auto tScalar = clock::now();
+			vectorizedTime += std::chrono::duration<double>(tVectorized - tStart).count();
+			scalarTime += std::chrono::duration<double>(tScalar - tVectorized).count();
+		}
+		// Results have to be bit identical, except for NaN payloads
+		bool matches = true;
+		for (size_t i = 0; i < test.view.count && matches; i++) {
+			for (uint32_t c = 0; c < test.dstComponents; c++) {
+				const float a = vectorized[i * dstStride / sizeof(float) + c];
+				const float b = reference[i * dstStride / sizeof(float) + c];
+				if (memcmp(&a, &b, sizeof(float)) != 0 && !(std::isnan(a) && std::isnan(b))) {
+					matches = false;
+					break;
+				}
+			}
+		}
+		allMatch &= matches;
+		const double vertices = static_cast<double>(test.view.count) * iterationCount / 1000000.0;
+		accessorBenchmarkResults.push_back({ test.name, vertices / vectorizedTime, vertices / scalarTime, matches });
+		std::cout << test.name << ": " << vertices / vectorizedTime << " Mverts/s (scalar " << vertices / scalarTime << " Mverts/s)" << (matches ? "" : ", MISMATCH") << "\n";
+	}
+	std::cout << "Accessor conversion " << (allMatch ? "matches" : "does not match") << " the scalar reference" << std::endl;
+}
+
 void VulkanExample::prepare()
 {
 	VulkanExampleBase::prepare();
@@ -572,6 +665,9 @@ void VulkanExample::prepare()
 	setupDescriptors();
 	preparePipelines();
 	buildCommandBuffers();
+	if (benchmark.active) {
+		runAccessorBenchmark();
+	}
 	prepared = true;
 }
 
@@ -595,6 +691,14 @@ void VulkanExample::OnUpdateUIOverlay(vks::UIOverlay* overlay)
 			buildCommandBuffers();
 		}
 	}
+	if (overlay->header("Accessor conversion")) {
+		if (overlay->button("Run benchmark")) {
+			runAccessorBenchmark();
+		}
+		for (const AccessorBenchmarkResult& result : accessorBenchmarkResults) {
+			overlay->text("%s: %.0f Mverts/s (scalar %.0f)%s", result.name.c_str(), result.vectorizedRate, result.scalarRate, result.matches ? "" : " MISMATCH");
+		}
+	}
 }
 
 VULKAN_EXAMPLE_MAIN()
@@ -17,6 +17,7 @@
 #include "tiny_gltf.h"
 
 #include "vulkanexamplebase.h"
+#include "VulkanglTFAccessor.h"
 
 struct PushConstBlock {
 	glm::mat4 nodeMatrix;
@@ -121,6 +122,15 @@ public:
 		std::vector<Material> materials;
 	} scene;
 
+	// Conversion rates of vkglTF::accessor::readFloats and its scalar reference in millions of vertices per second
+	struct AccessorBenchmarkResult {
+		std::string name;
+		double vectorizedRate;
+		double scalarRate;
+		bool matches;
+	};
+	std::vector<AccessorBenchmarkResult> accessorBenchmarkResults;
+
 	VulkanExample();
 	~VulkanExample();
 	virtual void getEnabledFeatures();
@@ -132,6 +142,7 @@ public:
 	void preparePipelines();
 	void prepareUniformBuffers();
 	void updateUniformBuffers();
+	void runAccessorBenchmark();
 	void prepare();
 	void loadSceneNode(const tinygltf::Node& inputNode, const tinygltf::Model& input, Node* parent);
 	void drawSceneNode(VkCommandBuffer commandBuffer, Node node);
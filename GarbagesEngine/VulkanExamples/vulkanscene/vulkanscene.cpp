@@ -10,6 +10,7 @@
 
 #include "vulkanexamplebase.h"
 #include "VulkanglTFModel.h"
+#include "frustum.hpp"
 #include "../../VulkanBase/Entrypoints.h"
 
 class VulkanExample : public VulkanExampleBase
@@ -43,6 +44,10 @@ public:
 
 	glm::vec4 lightPos = glm::vec4(1.0f, 4.0f, 0.0f, 0.0f);
 
+	// Primitives outside of the view are culled on the CPU before the frame's command buffer is recorded
+	bool frustumCulling = true;
+	vks::Frustum frustum;
+
 	VulkanExample() : VulkanExampleBase()
 	{
 		title = "Vulkan Demo Scene (c) by Sascha Willems";
@@ -185,6 +190,14 @@ public:
 	}
 
 	void buildCommandBuffers()
+	{
+		for (uint32_t i = 0; i < static_cast<uint32_t>(drawCmdBuffers.size()); ++i)
+		{
+			buildCommandBuffer(i);
+		}
+	}
+
+	void buildCommandBuffer(uint32_t index)
 	{
 		VkCommandBufferBeginInfo cmdBufInfo = vks::initializers::commandBufferBeginInfo();
 
@@ -200,39 +213,58 @@ public:
 		renderPassBeginInfo.renderArea.extent.height = height;
 		renderPassBeginInfo.clearValueCount = 2;
 		renderPassBeginInfo.pClearValues = clearValues;
+		renderPassBeginInfo.framebuffer = frameBuffers[index];
 
-		for (int32_t i = 0; i < drawCmdBuffers.size(); ++i)
-		{
-			renderPassBeginInfo.framebuffer = frameBuffers[i];
+		const VkCommandBuffer commandBuffer = drawCmdBuffers[index];
+		VK_CHECK_RESULT(vkBeginCommandBuffer(commandBuffer, &cmdBufInfo));
 
-			VK_CHECK_RESULT(vkBeginCommandBuffer(drawCmdBuffers[i], &cmdBufInfo));
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-			vkCmdBeginRenderPass(drawCmdBuffers[i], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+		VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
 
-			VkViewport viewport = vks::initializers::viewport((float)width, (float)height, 0.0f, 1.0f);
-			vkCmdSetViewport(drawCmdBuffers[i], 0, 1, &viewport);
+		VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-			VkRect2D scissor = vks::initializers::rect2D(width, height, 0, 0);
-			vkCmdSetScissor(drawCmdBuffers[i], 0, 1, &scissor);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
 
-			vkCmdBindDescriptorSets(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSet, 0, nullptr);
+		for (auto model : demoModels) {
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, *model.pipeline);
+			model.glTF->draw(commandBuffer);
+		}
 
-			for (auto model : demoModels) {
-				vkCmdBindPipeline(drawCmdBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, *model.pipeline);
-				model.glTF->draw(drawCmdBuffers[i]);
-			}
+		drawUI(commandBuffer);
 
-			drawUI(drawCmdBuffers[i]);
+		vkCmdEndRenderPass(commandBuffer);
 
-			vkCmdEndRenderPass(drawCmdBuffers[i]);
+		VK_CHECK_RESULT(vkEndCommandBuffer(commandBuffer));
+	}
 
-			VK_CHECK_RESULT(vkEndCommandBuffer(drawCmdBuffers[i]));
+	void cullModels()
+	{
+		// The models are pre-transformed with an identity model matrix, so the frustum is built from the camera alone
+		frustum.update(camera.matrices.perspective * camera.matrices.view);
+		for (auto model : demoModels) {
+			// The skybox is drawn around the camera, so it's always visible
+			if (model.pipeline == &pipelines.skybox) {
+				continue;
+			}
+			if (frustumCulling) {
+				model.glTF->cull(frustum);
+			} else {
+				model.glTF->frustumCulling = false;
+			}
 		}
 	}
 
 	void draw()
 	{
-		VulkanExampleBase::prepareFrame();
+		if (!VulkanExampleBase::prepareFrame()) {
+			return;
+		}
+		// The queue is idle after each frame, so the image's command buffer can be recorded again with the primitives visible from the current view
+		cullModels();
+		buildCommandBuffer(currentBuffer);
 		submitInfo.commandBufferCount = 1;
 		submitInfo.pCommandBuffers = &drawCmdBuffers[currentBuffer];
 		VK_CHECK_RESULT(vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE));
@@ -258,6 +290,21 @@ public:
 		draw();
 	}
 
+	virtual void OnUpdateUIOverlay(vks::UIOverlay *overlay)
+	{
+		if (overlay->header("Settings")) {
+			overlay->checkBox("Frustum culling", &frustumCulling);
+			uint32_t tested = 0, culled = 0;
+			for (auto model : demoModels) {
+				if (model.glTF->frustumCulling) {
+					tested += model.glTF->cullingStats.tested;
+					culled += model.glTF->cullingStats.culled;
+				}
+			}
+			overlay->text("Culled primitives: %u / %u", culled, tested);
+		}
+	}
+
 };
 
 VULKAN_EXAMPLE_MAIN()
\ No newline at end of file